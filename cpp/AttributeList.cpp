@@ -8,33 +8,103 @@
 #include "AttributeList.h"
 #include "_Core.h"
 #include <assert.h>
+#include <atomic>
+#include <ctype.h>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 /**
  * AttributeList.cpp - implements an attribute list, a sequence of name/value
  * pairs attached to another object. Searching by name is supported, as well as
  * iterating over the attributes (get the count, then access by index)
+ *
+ * The registry is an open-addressed hash table of names. Entries are only ever
+ * added, under a lock, and each is complete before it is published in its slot,
+ * so lookups need no lock.
  */
 
-static int findName(const char **names, const char *name, int count)
-{
-    //-- if name contains "$", everything after that is formatting info, so don't compare that part.
-    const char *cp = strchr(name, '$');
-    int len = (cp == 0) ? strlen(name) : cp - name;
-    char *name2 = new char[len+1];
-    strncpy(name2, name, len);
-    name2[len] = '\0';
-    int match = -1;
-    for (int i = 0; i < count; i++) {
-	if (strcasecmp(name2, names[i]) == 0) {
-	    match = i;
-	    break;
-	}
+struct AttributeName {
+    char *name; // without any "$" suffix
+    int length;
+    int id;
+};
+
+static const int REGISTRY_SLOTS = 4096; // a power of two
+static const int REGISTRY_MAX = REGISTRY_SLOTS / 2; // keeps probe sequences short
+static std::atomic<AttributeName*> registry[REGISTRY_SLOTS];
+static std::atomic<AttributeName*> registryById[REGISTRY_MAX];
+static int registryCount = 0;
+static std::mutex registryLock;
+
+//-- hash a name up to any "$", ignoring case; sets the length hashed
+static unsigned hashName(const char *name, int *length) {
+    unsigned hash = 2166136261u;
+    const char *cp;
+    for (cp = name; *cp && *cp != '$'; cp++) {
+        hash ^= (unsigned char) tolower((unsigned char) *cp);
+        hash *= 16777619u;
     }
-    delete [] name2;
-    return match;
+    *length = cp - name;
+    return hash;
+}
+
+//-- the slot holding a name, or the empty slot where it would go
+static int findSlot(const char *name, int length, unsigned hash, AttributeName **entry) {
+    for (int slot = hash & (REGISTRY_SLOTS - 1);; slot = (slot + 1) & (REGISTRY_SLOTS - 1)) {
+        AttributeName *found = registry[slot].load(std::memory_order_acquire);
+        if (found == NULL || (found->length == length && strncasecmp(found->name, name, length) == 0)) {
+            *entry = found;
+            return slot;
+        }
+    }
+}
+
+int AttributeList::findAttributeId(const char *name)
+{
+    int length;
+    unsigned hash = hashName(name, &length);
+    AttributeName *entry;
+    findSlot(name, length, hash, &entry);
+    return entry ? entry->id : -1;
+}
+
+int AttributeList::getAttributeId(const char *name)
+{
+    int length;
+    unsigned hash = hashName(name, &length);
+    AttributeName *entry;
+    findSlot(name, length, hash, &entry);
+    if (entry)
+        return entry->id;
+    std::lock_guard<std::mutex> guard(registryLock);
+    //-- another thread may have added it meanwhile
+    int slot = findSlot(name, length, hash, &entry);
+    if (entry)
+        return entry->id;
+    if (registryCount >= REGISTRY_MAX) {
+        printf("Error: too many attribute names (adding %s)\n", name);
+        exit(1);
+    }
+    entry = new AttributeName;
+    entry->name = new char[length + 1];
+    strncpy(entry->name, name, length);
+    entry->name[length] = '\0';
+    entry->length = length;
+    entry->id = registryCount++;
+    registryById[entry->id].store(entry, std::memory_order_release);
+    registry[slot].store(entry, std::memory_order_release);
+    return entry->id;
+}
+
+const char *AttributeList::getAttributeName(int id)
+{
+    if (id < 0 || id >= REGISTRY_MAX)
+        return NULL;
+    AttributeName *entry = registryById[id].load(std::memory_order_acquire);
+    return entry ? entry->name : NULL;
 }
 
 
@@ -42,62 +112,86 @@ AttributeList::AttributeList(int size)
 {
     attrCount = 0;
     maxAttrCount = size;
-    names = new const char*[maxAttrCount];
-    values = new double[maxAttrCount];
-    memset(names,0,maxAttrCount*sizeof(char));
-    memset(values,0,maxAttrCount*sizeof(double));
+    order = new int[maxAttrCount];
+    slotCount = 0;
+    values = NULL;
+    positions = NULL;
 }
 
 
 AttributeList::~AttributeList()
 {
-    if (names) delete [] names;
-    if (values) delete [] values;
+    delete [] order;
+    delete [] values;
+    delete [] positions;
 }
 
 
 long AttributeList::size()
 {
-    return sizeof(AttributeList) * maxAttrCount * (sizeof(char*) + sizeof(double));
+    return sizeof(AttributeList) + maxAttrCount * sizeof(int) + slotCount * (sizeof(double) + sizeof(int));
 }
 
 
 void AttributeList::reset()
 {
+    for (int i = 0; i < attrCount; i++)
+        positions[order[i]] = -1;
     attrCount = 0;
 }
 
 
-void AttributeList::setAttribute(const char *name, double value)
+void AttributeList::setAttributeById(int id, double value)
 {
     const int FACTOR = 2;
 
-    // if this attribute is already in the list, change it;
-    // otherwise, add a new one
-    int index = findName(names, name, attrCount);
-    if (index >= 0) values[index] = value;
-    else {
-	while (attrCount >= maxAttrCount) {
-	    names = (const char **) growStorage(names, maxAttrCount*sizeof(char*), FACTOR);
-	    values = (double*) growStorage(values, maxAttrCount*sizeof(double), FACTOR);
-	    maxAttrCount *=	FACTOR;
-	}
-	names[attrCount] = name;
-	values[attrCount++] = value;
+    //-- make room for this ID, then add it unless it is already set
+    if (id >= slotCount) {
+        int newCount = slotCount ? slotCount : 16;
+        while (newCount <= id)
+            newCount *= FACTOR;
+        double *newValues = new double[newCount];
+        int *newPositions = new int[newCount];
+        if (slotCount > 0) {
+            memcpy(newValues, values, slotCount * sizeof(double));
+            memcpy(newPositions, positions, slotCount * sizeof(int));
+        }
+        for (int i = slotCount; i < newCount; i++)
+            newPositions[i] = -1;
+        delete [] values;
+        delete [] positions;
+        values = newValues;
+        positions = newPositions;
+        slotCount = newCount;
+    }
+    if (positions[id] < 0) {
+        while (attrCount >= maxAttrCount) {
+            order = (int *) growStorage(order, maxAttrCount*sizeof(int), FACTOR);
+            maxAttrCount *= FACTOR;
+        }
+        positions[id] = attrCount;
+        order[attrCount++] = id;
     }
+    values[id] = value;
+}
+
+
+void AttributeList::setAttribute(const char *name, double value)
+{
+    setAttributeById(getAttributeId(name), value);
 }
 
 
 int AttributeList::getAttributeIndex(const char *name)
 {
-    return findName(names, name, attrCount);
+    int id = findAttributeId(name);
+    return (id >= 0 && id < slotCount) ? positions[id] : -1;
 }
 
 
 double AttributeList::getAttribute(const char *name)
 {
-    int index = findName(names, name, attrCount);
-    return (index >= 0) ? values[index] : -1.0;
+    return getAttributeById(findAttributeId(name));
 }
 
 
@@ -109,7 +203,19 @@ int AttributeList::getAttributeCount()
 
 double AttributeList::getAttributeByIndex(int index)
 {
-    return (index < attrCount) ? values[index] : -1.0;
+    return (index < attrCount) ? values[order[index]] : -1.0;
+}
+
+
+const char *AttributeList::getAttributeNameByIndex(int index)
+{
+    return (index < attrCount) ? getAttributeName(order[index]) : NULL;
+}
+
+
+int AttributeList::getAttributeIdByIndex(int index)
+{
+    return (index < attrCount) ? order[index] : -1;
 }
 
 
@@ -121,4 +227,3 @@ void AttributeList::dump()
     //printf("\t%s: %lf", names[i], values[i]);
     //}
 }
-
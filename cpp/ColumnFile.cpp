@@ -0,0 +1,87 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "ColumnFile.h"
+#include <string.h>
+
+/**
+ * ColumnFile.cpp - the header's space is reserved when the file is opened, and
+ * filled in by finish() once the offsets of the sections are known.
+ */
+
+static const char COLUMN_FILE_MAGIC[8] = { 'O', 'C', 'C', 'A', 'M', 'C', 'O', 'L' };
+
+ColumnFileWriter::ColumnFileWriter() :
+        fd(NULL), offset(0), kind(ColumnFileModels), failed(false) {
+}
+
+ColumnFileWriter::~ColumnFileWriter() {
+    if (fd) {
+        fclose(fd);
+        remove(temp.c_str());
+    }
+}
+
+bool ColumnFileWriter::open(const char *name, ColumnFileKind fileKind) {
+    filename = name;
+    temp = filename + ".tmp";
+    kind = fileKind;
+    strings.clear();
+    failed = false;
+    fd = fopen(temp.c_str(), "wb");
+    if (fd == NULL) {
+        printf("Error: couldn't write %s\n", temp.c_str());
+        return false;
+    }
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    offset = 0;
+    write(&header, sizeof(header));
+    return true;
+}
+
+uint64_t ColumnFileWriter::write(const void *data, size_t bytes) {
+    static const char zeros[8] = { 0 };
+    if (fd == NULL)
+        return 0;
+    size_t pad = (8 - offset % 8) % 8;
+    if (pad > 0 && fwrite(zeros, 1, pad, fd) != pad)
+        failed = true;
+    offset += pad;
+    uint64_t start = offset;
+    if (bytes > 0 && fwrite(data, 1, bytes, fd) != bytes)
+        failed = true;
+    offset += bytes;
+    return start;
+}
+
+uint64_t ColumnFileWriter::addString(const char *text) {
+    uint64_t start = strings.size();
+    strings.append(text ? text : "");
+    strings.push_back('\0');
+    return start;
+}
+
+bool ColumnFileWriter::finish(ColumnFileHeader &header) {
+    if (fd == NULL)
+        return false;
+    header.stringsOffset = write(strings.data(), strings.size());
+    header.stringsBytes = strings.size();
+    memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.kind = kind;
+    header.byteOrder = 0x01020304;
+    if (fseek(fd, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fd) != 1)
+        failed = true;
+    bool ok = fclose(fd) == 0 && !failed && rename(temp.c_str(), filename.c_str()) == 0;
+    fd = NULL;
+    if (!ok) {
+        printf("Error: couldn't write %s\n", filename.c_str());
+        remove(temp.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "ExpansionIterator.h"
+#include "Key.h"
+#include "Table.h"
+#include "VariableList.h"
+#include <string.h>
+
+/**
+ * ExpansionIterator.cpp - an odometer over the values of the missing variables,
+ * applied to each source tuple in turn. Only one key is held at a time, so the
+ * expansion can be arbitrarily large.
+ */
+
+ExpansionIterator::ExpansionIterator(Table *source, VariableList *vars, int *missingVars, int missingCount)
+{
+    table = source;
+    sourceKey = NULL;
+    sourceValue = 0;
+    tupleCount = source->getTupleCount();
+    init(vars, missingVars, missingCount);
+}
+
+
+ExpansionIterator::ExpansionIterator(KeySegment *source, double val, VariableList *vars, int *missingVars,
+        int missingCount)
+{
+    table = NULL;
+    keysize = vars->getKeySize();
+    sourceKey = new KeySegment[keysize];
+    memcpy(sourceKey, source, keysize * sizeof(KeySegment));
+    sourceValue = val;
+    tupleCount = 1;
+    init(vars, missingVars, missingCount);
+}
+
+
+void ExpansionIterator::init(VariableList *vars, int *missingVars, int count)
+{
+    varList = vars;
+    keysize = vars->getKeySize();
+    missingCount = count;
+    missing = new int[missingCount > 0 ? missingCount : 1];
+    values = new int[missingCount > 0 ? missingCount : 1];
+    memcpy(missing, missingVars, missingCount * sizeof(int));
+    key = new KeySegment[keysize];
+    reset();
+}
+
+
+ExpansionIterator::~ExpansionIterator()
+{
+    delete[] sourceKey;
+    delete[] missing;
+    delete[] values;
+    delete[] key;
+}
+
+
+void ExpansionIterator::reset()
+{
+    tupleIndex = -1;
+    value = 0;
+}
+
+
+void ExpansionIterator::loadTuple()
+{
+    if (table) {
+        table->copyKey(tupleIndex, key);
+        value = table->getValue(tupleIndex);
+    } else {
+        memcpy(key, sourceKey, keysize * sizeof(KeySegment));
+        value = sourceValue;
+    }
+    for (int m = 0; m < missingCount; m++) {
+        values[m] = 0;
+        Key::setKeyValue(key, keysize, varList, missing[m], 0);
+    }
+}
+
+
+bool ExpansionIterator::next()
+{
+    if (tupleIndex >= 0) {
+        //-- advance the odometer, last missing variable first
+        for (int m = missingCount - 1; m >= 0; m--) {
+            int var = missing[m];
+            if (++values[m] < varList->getVariable(var)->cardinality) {
+                Key::setKeyValue(key, keysize, varList, var, values[m]);
+                return true;
+            }
+            values[m] = 0;
+            Key::setKeyValue(key, keysize, varList, var, 0);
+        }
+    }
+    //-- all combinations done (or just starting); move to the next source tuple
+    if (++tupleIndex >= tupleCount) {
+        tupleIndex = tupleCount;
+        return false;
+    }
+    loadTuple();
+    return true;
+}
+
+
+double ExpansionIterator::getExpansionFactor()
+{
+    double factor = 1;
+    for (int m = 0; m < missingCount; m++) {
+        factor *= varList->getVariable(missing[m])->cardinality;
+    }
+    return factor;
+}
+
+
+double ExpansionIterator::getExpansionSize()
+{
+    return tupleCount * getExpansionFactor();
+}
@@ -10,16 +10,19 @@
 #include <gmp.h>
 #include <fenv.h>
 #include <math.h>
+#include "ExpansionIterator.h"
 #include "Input.h"
 #include "Key.h"
 #include "ManagerBase.h"
 #include "Math.h"
+#include "MemoryAccount.h"
 #include "Model.h"
 #include "ModelCache.h"
 #include "Options.h"
 #include "RelCache.h"
 #include "Relation.h"
 #include "StateConstraint.h"
+#include "StatsCache.h"
 #include "VariableList.h"
 #include "_Core.h"
 
@@ -32,9 +35,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <algorithm>
+#include <vector>
 using std::min;
 using std::make_pair;
 using std::pair;
+
+//-- orthogonal expansions larger than this (in cells) are not stored when starting IPF
+const double MAX_STORED_EXPANSION = 1000000;
+
 // Based on helpful answers at
 // http://stackoverflow.com/questions/77005/how-to-generate-a-stacktrace-when-my-gcc-c-app-crashes
 void backtrace_symbols_err(void** trace, size_t size) {
@@ -145,25 +153,22 @@ ManagerBase::ManagerBase(VariableList *vars, Table *input) :
     topRef = bottomRef = refModel = NULL;
     relCache = new RelCache;
     modelCache = new ModelCache;
+    statsCache = NULL;
+    statsCacheData = NULL;
     sampleSize = 0;
     testSampleSize = 0;
     options = new Options();
     inputH = -1;
-    stateSpaceSize = 0;
     dataLines = 0;
-    fitTable1 = NULL;
-    fitTable2 = NULL;
-    projTable = NULL;
     inputData = testData = NULL;
     DVOrder = NULL;
     searchDirection = Direction::Ascending;
     useInverseNotation = 0;
     valuesAreFunctions = false;
-    intersectArray = NULL;
-    intersectCount = 0;
-    intersectMax = 1;
     functionConstant = 0;
     negativeConstant = 0;
+    memoryLimit = -1;
+    evictionCount = 0;
     signal(SIGSEGV, segfault_handler);
 }
 
@@ -172,18 +177,83 @@ void ManagerBase::setAlphaThreshold(double thresh)
 	alpha_threshold = thresh;
 }
 
+FitWorkspace::FitWorkspace() :
+        fitTable1(NULL), fitTable2(NULL), projTable(NULL), intersectArray(NULL), intersectCount(0), intersectMax(1),
+        intersectBytes(0), relVars(NULL), relStates(NULL), relMask(NULL), relVarMax(0), relKeySize(0), lastUsed(0) {
+}
 
-
-ManagerBase::~ManagerBase() {
-    if (testData) delete testData;
+FitWorkspace::~FitWorkspace() {
     if (fitTable1) delete fitTable1;
     if (fitTable2) delete fitTable2;
     if (projTable) delete projTable;
     if (intersectArray) delete[] intersectArray;
+    delete[] relVars;
+    delete[] relStates;
+    delete[] relMask;
+    MemoryAccount::release(MemoryCategory::FitScratch, intersectBytes);
+}
+
+void FitWorkspace::accountIntersect() {
+    long long bytes = intersectArray ? intersectMax * sizeof(VarIntersect) : 0;
+    MemoryAccount::add(MemoryCategory::FitScratch, bytes - intersectBytes);
+    intersectBytes = bytes;
+}
+
+void FitWorkspace::reserveRelationKey(int varcount, int keysize) {
+    if (varcount > relVarMax) {
+        delete[] relVars;
+        delete[] relStates;
+        relVarMax = varcount;
+        relVars = new int[relVarMax];
+        relStates = new int[relVarMax];
+    }
+    if (keysize > relKeySize) {
+        delete[] relMask;
+        relKeySize = keysize;
+        relMask = new KeySegment[relKeySize];
+    }
+}
+
+//-- the workspace bound to this thread, and the manager it belongs to
+static thread_local ManagerBase *boundManager = NULL;
+static thread_local FitWorkspace *boundWorkspace = NULL;
+
+FitWorkspace *ManagerBase::getWorkspace() {
+    return boundManager == this ? boundWorkspace : &mainWorkspace;
+}
+
+void ManagerBase::bindWorkspace() {
+    std::lock_guard<std::mutex> guard(workspaceLock);
+    if (spareWorkspaces.empty()) {
+        boundWorkspace = new FitWorkspace();
+    } else {
+        boundWorkspace = spareWorkspaces.back();
+        spareWorkspaces.pop_back();
+    }
+    boundManager = this;
+}
+
+void ManagerBase::unbindWorkspace() {
+    if (boundManager != this)
+        return;
+    std::lock_guard<std::mutex> guard(workspaceLock);
+    boundWorkspace->lastUsed = MemoryAccount::nextUse();
+    spareWorkspaces.push_back(boundWorkspace);
+    boundManager = NULL;
+    boundWorkspace = NULL;
+}
+
+
+
+ManagerBase::~ManagerBase() {
+    if (testData) delete testData;
+    for (size_t i = 0; i < spareWorkspaces.size(); i++)
+        delete spareWorkspaces[i];
     if (DVOrder) delete[] DVOrder;
     delete options;
     delete modelCache;
     delete relCache;
+    if (statsCache) delete statsCache;
     if (varList) delete varList;
 }
 
@@ -245,37 +315,31 @@ int ManagerBase::addConstraint(int varcount, int *varindices, int *stateindices,
 //-- look in relCache and, if not found, make a new relation and store in relCache
 // *** warning: this function sorts varindices in place ***
 Relation *ManagerBase::getRelation(int *input_vars, int varcount, bool make_project, int *input_states) {
-    int* varindices = new int[varcount];
+    //-- sort the variables (and states) and build the mask in scratch space, so that
+    //-- a relation already in the cache is found without allocating anything
+    int keysize = getKeySize();
+    FitWorkspace *ws = getWorkspace();
+    ws->reserveRelationKey(varcount, keysize);
+    int *varindices = ws->relVars;
     memcpy(varindices, input_vars, varcount * sizeof(int));
-    int* stateindices = NULL;
+    int *stateindices = NULL;
     if (input_states != NULL) {
-        stateindices = new int[varcount];
+        stateindices = ws->relStates;
         memcpy(stateindices, input_states, varcount * sizeof(int));
     }
-    long stateconstsz = 0;
     Relation::sort(varindices, varcount, stateindices);
-    int keysize = getKeySize();
-    Relation *rel;
-    if (stateindices != NULL) {
-        int *stateindices1 = new int[varcount];
-        KeySegment* mask = new KeySegment[keysize];
-        KeySegment* start1 = new KeySegment[keysize];
-        memset(stateindices1, 0, varcount * sizeof(int));
-        memset(mask, 0, keysize * sizeof(KeySegment));
-        memset(start1, 0, keysize * sizeof(KeySegment));
-        Key::buildMask(mask, keysize, varList, varindices, varcount);
-        Key::buildMask(start1, keysize, varList, varindices, varcount);
-        stateconstsz = calcStateConstSize(varcount, varindices, stateindices);
-        rel = new Relation(varList, varList->getVarCount(), keysize, stateconstsz);
-        for (int i = 0; i < varcount; i++) {
-            rel->addVariable(varindices[i], stateindices[i]);
-        }
-        if (!relCache->addRelation(rel)) {
-            Relation *cached_rel = relCache->findRelation(rel->getPrintName());
-            delete rel;
-            rel = cached_rel;
-        } else {
+    Key::buildMask(ws->relMask, keysize, varList, varindices, varcount);
+    Relation *rel = relCache->findRelation(ws->relMask, keysize, stateindices, varcount);
+    if (rel == NULL) {
+        if (stateindices != NULL) {
+            long stateconstsz = calcStateConstSize(varcount, varindices, stateindices);
+            rel = new Relation(varList, varList->getVarCount(), keysize, stateconstsz);
+            for (int i = 0; i < varcount; i++) {
+                rel->addVariable(varindices[i], stateindices[i]);
+            }
             //make starting constraint
+            int *stateindices1 = new int[varcount];
+            KeySegment* start1 = new KeySegment[keysize];
             for (int i = 0; i < varcount; i++) {
                 if (stateindices[i] == DONT_CARE) {
                     stateindices1[i] = 0x00;
@@ -284,21 +348,22 @@ Relation *ManagerBase::getRelation(int *input_vars, int varcount, bool make_proj
                 }
             }
             //build the first constraint and then loop
+            Key::buildMask(start1, keysize, varList, varindices, varcount);
             Key::buildKey(start1, keysize, varList, varindices, stateindices1, varcount);
             rel->getStateConstraints()->addConstraint(start1);
             addConstraint(varcount, varindices, stateindices, stateindices1, start1, rel);
+            delete[] start1;
+            delete[] stateindices1;
+        } else {
+            rel = new Relation(varList, varList->getVarCount());
+            for (int i = 0; i < varcount; i++) {
+                rel->addVariable(varindices[i]);
+            }
         }
-        delete[] start1;
-        delete[] mask;
-        delete[] stateindices1;
-        delete[] stateindices;
-    } else {
-        rel = new Relation(varList, varList->getVarCount());
-        for (int i = 0; i < varcount; i++) {
-            rel->addVariable(varindices[i]);
-        }
-        if (!relCache->addRelation(rel)) {
-            Relation *cached_rel = relCache->findRelation(rel->getPrintName());
+        //-- the relation is complete before it is shared; another thread may have
+        //-- added the same relation in the meantime
+        Relation *cached_rel = relCache->findOrAddRelation(rel);
+        if (cached_rel != rel) {
             delete rel;
             rel = cached_rel;
         }
@@ -306,7 +371,6 @@ Relation *ManagerBase::getRelation(int *input_vars, int varcount, bool make_proj
     if (make_project) {
         makeProjection(rel);
     }
-    delete[] varindices;
     return rel;
 }
 
@@ -330,9 +394,19 @@ Relation *ManagerBase::getChildRelation(Relation *rel, int skip, bool makeProjec
 // This function is a special case of the other makeProjection(), further below.
 // It projects the input data into the table for a relation.
 bool ManagerBase::makeProjection(Relation *rel) {
+    std::lock_guard<std::recursive_mutex> guard(relationLock);
+    rel->setLastUsed(MemoryAccount::nextUse());
     if (rel->getTable())
         return true; // table already computed
 
+    if (useStatsCache()) {
+        Table *cached = statsCache->findTable(rel);
+        if (cached) {
+            rel->setTable(cached);
+            return true;
+        }
+    }
+
     //-- create the projection data for a given relation. Go through
     //-- the inputData, and for each tuple, sum it into the table for the relation.
     long long start_size = rel->getNC();
@@ -341,8 +415,8 @@ bool ManagerBase::makeProjection(Relation *rel) {
     }
     //logProjection(rel->getPrintName());
     Table *table = new Table(keysize, start_size);
-    rel->setTable(table);
     makeProjection(inputData, table, rel);
+    rel->setTable(table);
     return true;
 }
 
@@ -354,15 +428,14 @@ bool ManagerBase::makeProjection(Table *t1, Table *t2, Relation *rel) {
     t2->reset(keysize); // reset the output table
     KeySegment *key = new KeySegment[keysize];
     KeySegment *mask = rel->getMask();
-    long i, j, k;
+    long i, k;
     double value;
 
-    bool is_match = false;  // for state-based
     double remainder = 0;   // for state-based
     long c_count;            // for state-based
-    KeySegment *const_k;  // for state-based
+    StateConstraint *constraints = rel->getStateConstraints();  // for state-based
     if (rel->isStateBased()) { // for state-based
-        c_count = rel->getStateConstraints()->getConstraintCount();
+        c_count = constraints->getConstraintCount();
         makeSbExpansion(rel, t2);
     }
     for (i = 0; i < count; i++) {
@@ -377,15 +450,7 @@ bool ManagerBase::makeProjection(Table *t1, Table *t2, Relation *rel) {
         } else {
             // state based, so if the key matches one of the constraints we keep it,
             // otherwise add it to the remainder to be split up later
-            for (j = 0; j < c_count; j++) {
-                is_match = false;
-                const_k = rel->getStateConstraints()->getConstraint(j);
-                if (Key::compareKeys(key, const_k, keysize) == 0) {
-                    is_match = true;
-                    break;
-                }
-            }
-            if (is_match) {
+            if (constraints->contains(key)) {
                 t2->sumTuple(key, value);
             } else {
                 remainder += value;
@@ -397,15 +462,7 @@ bool ManagerBase::makeProjection(Table *t1, Table *t2, Relation *rel) {
         count = t2->getTupleCount();
         double spread = remainder / (count - c_count);
         for (i = 0; i < count; i++) {
-            is_match = false;
-            for (j = 0; j < c_count; j++) {
-                const_k = rel->getStateConstraints()->getConstraint(j);
-                if (Key::compareKeys(t2->getKey(i), const_k, keysize) == 0) {
-                    is_match = true;
-                    break;
-                }
-            }
-            if (is_match == false) {
+            if (!constraints->contains(t2->getKey(i))) {
                 t2->setValue(i, spread);
             }
         }
@@ -415,121 +472,148 @@ bool ManagerBase::makeProjection(Table *t1, Table *t2, Relation *rel) {
     return true;
 }
 
+//-- Order the tuples of a table by their keys with mask applied, so that tuples in the
+//-- same state of the masked-out relation are adjacent. Table order is kept within each
+//-- group. masked receives the masked keys (keysize segments per tuple, in table order).
+static void groupByMask(Table *t, KeySegment *mask, int keysize, std::vector<KeySegment> &masked,
+        std::vector<long long> &order) {
+    long long count = t->getTupleCount();
+    masked.resize(count * keysize);
+    order.resize(count);
+    for (long long i = 0; i < count; i++) {
+        KeySegment *key = t->getKey(i);
+        for (int k = 0; k < keysize; k++)
+            masked[i * keysize + k] = key[k] | mask[k];
+        order[i] = i;
+    }
+    KeySegment *base = masked.data();
+    std::stable_sort(order.begin(), order.end(), [base, keysize](long long a, long long b) {
+        return Key::compareKeys(base + a * keysize, base + b * keysize, keysize) < 0;
+    });
+}
+
+long long ManagerBase::countMaskedStates(Table *table, Relation *rel) {
+    std::vector<KeySegment> masked;
+    std::vector<long long> order;
+    groupByMask(table, rel->getMask(), keysize, masked, order);
+    long long count = order.size(), states = 0;
+    for (long long g = 0; g < count; g++) {
+        if (g == 0 || Key::compareKeys(&masked[order[g - 1] * keysize], &masked[order[g] * keysize], keysize) != 0)
+            states++;
+    }
+    return states;
+}
+
 bool ManagerBase::makeMaxProjection(Table *qt, Table *maxpt, Table *inputData, Relation *indRel,
         Relation *depRel, double *missedValues) {
     //-- create the max projection data for the IV relation, used for computing percent correct.
-    //-- Two new tables are created. maxqt contains a tuple for each distinct IV state,
-    //-- and the q value from the qt table. maxpt contains a corresponding tuple for each distinct
-    //-- IV state, and the p value (from the input data).
-    //-- A pass is made through the qt table, and for each tuple, it is checked against the
-    //-- maxqt table. If it has not been added yet, or if its q value is greater than the value
-    //-- already present on the matching tuple in maxqt, then both the maxqt tuple and the maxpt
-    //-- tuples are updated. At the end, maxpt has a tuple for each IV state, and the p value
-    //-- for the specific IV,DV state which corresponds to the greatest q value across the DV
-    //-- states for that IV state.
+    //-- maxpt gets a tuple for each distinct IV state in qt, holding the p value (from the
+    //-- input data) of the IV,DV state with the greatest q value across the DV states for
+    //-- that IV state. Ties are broken by the order of the DV values.
+    //-- The qt tuples are grouped by IV state once, and each group is scanned in table
+    //-- order, so this costs one sort rather than a set of table lookups per tuple.
     if (qt == NULL || maxpt == NULL || indRel == NULL || depRel == NULL)
         return false;
     long long count = qt->getTupleCount();
-    Table *maxqt = new Table(keysize, count);
-    Table *dvt = new Table(keysize, count);
     maxpt->reset(keysize); // reset the output table
-    KeySegment *key = new KeySegment[keysize];
     KeySegment *mask = indRel->getMask();
-    long long i, pindex, maxqindex, maxpindex, dvindex;
-    int k;
-    double qvalue, pvalue, maxqvalue;
-    int qdv, pdv, maxdv;
+    int dv = varList->getDV();
     int defaultDV = getDefaultDVIndex();
-    for (i = 0; i < count; i++) {
-        qt->copyKey(i, key);
-        qvalue = qt->getValue(i);
-        pindex = inputData->indexOf(key);
-        pvalue = 0.0;
-        if (pindex >= 0)
-            pvalue = inputData->getValue(pindex);
-        qdv = Key::getKeyValue(key, keysize, varList, varList->getDV());
-        //-- set up key to match just IVs
-        for (k = 0; k < keysize; k++)
-            key[k] |= mask[k];
-        maxqindex = maxqt->indexOf(key);
-        maxpindex = maxpt->indexOf(key);
-        dvindex = dvt->indexOf(key);
-        if (maxqindex >= 0 && maxpindex >= 0) {
-            //-- we already saw this IV state; see if the q value is greater
-            maxqvalue = maxqt->getValue(maxqindex);
+
+    //-- the p value for each q tuple. Both tables are sorted, so a single merge finds them.
+    double *pvalues = new double[count];
+    long long pi = 0, pcount = inputData->getTupleCount();
+    for (long long i = 0; i < count; i++) {
+        KeySegment *qkey = qt->getKey(i);
+        int cmp = 1;
+        while (pi < pcount && (cmp = Key::compareKeys(inputData->getKey(pi), qkey, keysize)) < 0)
+            pi++;
+        pvalues[i] = (pi < pcount && cmp == 0) ? inputData->getValue(pi) : 0.0;
+    }
+
+    std::vector<KeySegment> masked;
+    std::vector<long long> order;
+    groupByMask(qt, mask, keysize, masked, order);
+    for (long long g = 0; g < count;) {
+        long long i = order[g];
+        KeySegment *groupKey = &masked[i * keysize];
+        double maxqvalue = qt->getValue(i);
+        double maxpvalue = pvalues[i];
+        int maxdv = Key::getKeyValue(qt->getKey(i), keysize, varList, dv);
+        for (g++; g < count && Key::compareKeys(&masked[order[g] * keysize], groupKey, keysize) == 0; g++) {
+            i = order[g];
+            double qvalue = qt->getValue(i);
+            int qdv = Key::getKeyValue(qt->getKey(i), keysize, varList, dv);
             if (fabs(maxqvalue - qvalue) < DBL_EPSILON) {
                 // Break any ties by checking the order of the DV values
-                maxdv = (int) dvt->getValue(dvindex);
                 if (getDvOrder(qdv) < getDvOrder(maxdv)) {
-                    maxqt->setValue(maxqindex, qvalue);
-                    maxpt->setValue(maxpindex, pvalue);
-                    dvt->setValue(dvindex, (double) qdv);
+                    maxqvalue = qvalue;
+                    maxpvalue = pvalues[i];
+                    maxdv = qdv;
                 }
             } else if (maxqvalue < qvalue) {
-                maxqt->setValue(maxqindex, qvalue);
-                maxpt->setValue(maxpindex, pvalue);
-                dvt->setValue(dvindex, (double) qdv);
+                maxqvalue = qvalue;
+                maxpvalue = pvalues[i];
+                maxdv = qdv;
             }
-        } else {
-            //-- new IV state; add to both tables
-            //-- we have to call indexOf again to get the position, then do the insert
-            maxqt->insertTuple(key, qvalue, maxqt->indexOf(key, false));
-            maxpt->insertTuple(key, pvalue, maxpt->indexOf(key, false));
-            dvt->insertTuple(key, (double) qdv, dvt->indexOf(key, false));
         }
+        maxpt->addTuple(groupKey, maxpvalue); // groups come out in key order
     }
+    delete[] pvalues;
 
     //-- Add in entries for the default rule (i.e., if the model doesn't predict
     //-- a DV value for a particular IV, then just use the most likely DV value).
-    //-- To do this we go through the inputData and find tuples for which (a) the IV
-    //-- state does not exist in maxpt, and (b) where the DV value is the most likely value.
-    //-- These are the inputData tuples which are predicted correctly by the default rule.
-    //-- Their probabilities need to be accounted for.
+    //-- Input tuples whose IV state is not in maxpt are missed by the model; in each
+    //-- such IV state, the first tuple with the default DV value is predicted by the
+    //-- default rule, and accounts for that state from then on.
     if (missedValues != NULL) {
-        long long index;
-        double value;
-        count = inputData->getTupleCount();
-        (*missedValues) = 0;
-        for (i = 0; i < count; i++) {
-            inputData->copyKey(i, key);
-            for (k = 0; k < keysize; k++)
-                key[k] |= mask[k];
-            if (maxpt->indexOf(key) >= 0) {
-                continue; //-- model predicts this; don't need default
-            } else {
-                value = inputData->getValue(i);
-                (*missedValues) += value;
-                pdv = Key::getKeyValue(inputData->getKey(i), keysize, varList, varList->getDV());
-                if (pdv != defaultDV)
+        long long inCount = inputData->getTupleCount();
+        groupByMask(inputData, mask, keysize, masked, order);
+        bool *missed = new bool[inCount];
+        memset(missed, 0, inCount * sizeof(bool));
+        std::vector<long long> defaults;
+        for (long long g = 0; g < inCount;) {
+            KeySegment *groupKey = &masked[order[g] * keysize];
+            bool predicted = maxpt->indexOf(groupKey) >= 0; //-- model predicts this; don't need default
+            bool found = false;
+            for (; g < inCount && Key::compareKeys(&masked[order[g] * keysize], groupKey, keysize) == 0; g++) {
+                long long i = order[g];
+                if (predicted || found)
                     continue;
-
-                //-- add this entry to maxpt; default rule applies
-                if (value > 0) {
-                    index = maxpt->indexOf(key, false);
-                    maxpt->insertTuple(key, value, index);
+                missed[i] = true;
+                double value = inputData->getValue(i);
+                if (value > 0 && Key::getKeyValue(inputData->getKey(i), keysize, varList, dv) == defaultDV) {
+                    defaults.push_back(i);
+                    found = true;
                 }
             }
         }
+        //-- sum in table order, as the values were originally accumulated
+        (*missedValues) = 0;
+        for (long long i = 0; i < inCount; i++) {
+            if (missed[i])
+                (*missedValues) += inputData->getValue(i);
+        }
+        for (size_t d = 0; d < defaults.size(); d++) {
+            maxpt->addTuple(&masked[defaults[d] * keysize], inputData->getValue(defaults[d]));
+        }
+        delete[] missed;
     }
     maxpt->sort();
-    delete[] key;
-    delete maxqt;
     return true;
 }
 
 int ManagerBase::getDefaultDVIndex() {
     if (!varList->isDirected())
         return NULL; // can only do this for directed models
-    if (DVOrder == NULL)
-        createDvOrder();
+    createDvOrder();
     return DVOrder[0];
 }
 
 int ManagerBase::getDvOrder(int index) {
     if (!varList->isDirected())
         return NULL;
-    if (DVOrder == NULL)
-        createDvOrder();
+    createDvOrder();
     int dv_card = varList->getVariable(varList->getDV())->cardinality;
     for (int i = 0; i < dv_card; ++i) {
         if (DVOrder[i] == index)
@@ -538,50 +622,40 @@ int ManagerBase::getDvOrder(int index) {
     return NULL;
 }
 
-static double *sort_freq;
-static Variable *sort_dv_var;
-int sortDV(const void *d1, const void *d2) {
-    int a = *(int*) d1;
-    int b = *(int*) d2;
-    // Would prefer to use DBL_EPSILON here, but the frequencies we get for DV values (from the bottom reference)
-    // are not precise enough for some reason.
-    if (fabs(sort_freq[a] - sort_freq[b]) < 1e-10) {
-        return strcmp(sort_dv_var->valmap[a], sort_dv_var->valmap[b]);
-    }
-    if (sort_freq[a] > sort_freq[b]) {
-        return -1;
-    }
-    if (sort_freq[a] < sort_freq[b]) {
-        return 1;
-    }
-    // Put this again, just in case.
-    return strcmp(sort_dv_var->valmap[a], sort_dv_var->valmap[b]);
-}
-
 void ManagerBase::createDvOrder() {
     if (!varList->isDirected())
         return;
-    if (DVOrder != NULL)
-        return;
-    sort_dv_var = varList->getVariable(varList->getDV());
-    int dv_card = sort_dv_var->cardinality;
-    DVOrder = new int[dv_card];
-    // Build an array of frequencies, taken from the dependent relation (from the bottom reference)
-    long long k;
-    Table *depTable;
-    for (k = 0; k < bottomRef->getRelationCount(); ++k) {
-        if (!bottomRef->getRelation(k)->isIndependentOnly()) {
-            depTable = bottomRef->getRelation(k)->getTable();
-            break;
+    //-- percent correct may be computed on several threads, so the order is made
+    //-- once, and published only when it is complete
+    std::call_once(dvOrderOnce, [this] {
+        Variable *dvVar = varList->getVariable(varList->getDV());
+        int dv_card = dvVar->cardinality;
+        // Build an array of frequencies, taken from the dependent relation (from the bottom reference)
+        long long k;
+        Table *depTable;
+        for (k = 0; k < bottomRef->getRelationCount(); ++k) {
+            if (!bottomRef->getRelation(k)->isIndependentOnly()) {
+                makeProjection(bottomRef->getRelation(k));
+                depTable = bottomRef->getRelation(k)->getTable();
+                break;
+            }
         }
-    }
-    sort_freq = new double[dv_card];
-    for (k = 0; k < depTable->getTupleCount(); ++k) {
-        sort_freq[Key::getKeyValue(depTable->getKey(k), keysize, varList, varList->getDV())] = depTable->getValue(k);
-    }
-    for (int i = 0; i < dv_card; ++i)
-        DVOrder[i] = i;
-    qsort(DVOrder, dv_card, sizeof(int), sortDV);
+        std::vector<double> freq(dv_card);
+        for (k = 0; k < depTable->getTupleCount(); ++k) {
+            freq[Key::getKeyValue(depTable->getKey(k), keysize, varList, varList->getDV())] = depTable->getValue(k);
+        }
+        int *order = new int[dv_card];
+        for (int i = 0; i < dv_card; ++i)
+            order[i] = i;
+        std::stable_sort(order, order + dv_card, [&](int a, int b) {
+            // Would prefer to use DBL_EPSILON here, but the frequencies we get for DV values (from the bottom reference)
+            // are not precise enough for some reason.
+            if (fabs(freq[a] - freq[b]) >= 1e-10)
+                return freq[a] > freq[b];
+            return strcmp(dvVar->valmap[a], dvVar->valmap[b]) < 0;
+        });
+        DVOrder = order;
+    });
 }
 
 // Creates a product of the cardinalities of any variables missing from the model
@@ -687,7 +761,8 @@ bool ManagerBase::makeProjections(Model *model) {
 }
 
 void ManagerBase::deleteTablesFromCache() {
-    relCache->deleteTables();
+    //-- the top relation's table is the input data, which isn't ours to delete
+    relCache->deleteTables(inputData);
 }
 
 bool ManagerBase::deleteModelFromCache(Model *model) {
@@ -748,24 +823,25 @@ void ManagerBase::expandTuple(double tupleValue, KeySegment *key, int *missingVa
 }
 
 void ManagerBase::makeOrthoExpansion(Relation *rel, Table *outTable) {
-    //-- get an array of the variable indices which don't occur in the relation.
-    int varCount = rel->getVariableList()->getVarCount();
-    int missingVars[varCount];
-    int missingCount = rel->copyMissingVariables(missingVars, varCount);
-    Table *relTable = rel->getTable();
-
-    long long tupleCount = relTable->getTupleCount();
+    ExpansionIterator *expansion = makeOrthoIterator(rel);
     outTable->reset(keysize);
-    for (long long i = 0; i < tupleCount; i++) {
-        KeySegment key[keysize];
-        relTable->copyKey(i, key);
-        double value = relTable->getValue(i);
-        expandTuple(value, key, missingVars, missingCount, outTable, 0);
+    while (expansion->next()) {
+        outTable->addTuple(expansion->getKey(), expansion->getValue());
     }
+    delete expansion;
     outTable->sort();
     outTable->normalize();
 }
 
+ExpansionIterator *ManagerBase::makeOrthoIterator(Relation *rel) {
+    //-- get an array of the variable indices which don't occur in the relation.
+    int varCount = rel->getVariableList()->getVarCount();
+    int missingVars[varCount];
+    int missingCount = rel->copyMissingVariables(missingVars, varCount);
+    makeProjection(rel);
+    return new ExpansionIterator(rel->getTable(), getVariableList(), missingVars, missingCount);
+}
+
 void ManagerBase::makeSbExpansion(Relation *rel, Table *table) {
     int varCount = rel->getVariableCount();
     int vars[varCount];
@@ -775,8 +851,11 @@ void ManagerBase::makeSbExpansion(Relation *rel, Table *table) {
     for (int k = 0; k < keysize; k++) {
         dont_care_key[k] = DONT_CARE;
     }
-    expandTuple(0, dont_care_key, vars, varCount, table, 0);
-    delete dont_care_key;
+    ExpansionIterator expansion(dont_care_key, 0, getVariableList(), vars, varCount);
+    while (expansion.next()) {
+        table->addTuple(expansion.getKey(), expansion.getValue());
+    }
+    delete[] dont_care_key;
     //table->sort();
     //table->normalize();
 }
@@ -799,9 +878,21 @@ void ManagerBase::setSearchDirection(Direction dir) {
     searchDirection = dir;
 }
 
+bool ManagerBase::useStatsCache() {
+    return statsCache && inputData == statsCacheData;
+}
+
 double ManagerBase::computeDF(Relation *rel) { // degrees of freedom
+    std::lock_guard<std::recursive_mutex> guard(relationLock);
     double df = rel->getAttribute(ATTRIBUTE_DF);
     if (df < 0.0) { //-- not set yet
+        double h;
+        //-- (if H is already known, the cache has been checked for this relation)
+        if (rel->getAttribute(ATTRIBUTE_H) < 0 && useStatsCache() && statsCache->findStatistics(rel, &h, &df)) {
+            rel->setAttribute(ATTRIBUTE_DF, df);
+            rel->setAttribute(ATTRIBUTE_H, h);
+            return df;
+        }
         df = ::ocDegreesOfFreedom(rel);
         rel->setAttribute(ATTRIBUTE_DF, df);
     }
@@ -832,8 +923,15 @@ double ManagerBase::computeDF(Model *model) {
 
 double ManagerBase::computeH(Relation *rel) // uncertainty
         {
+    std::lock_guard<std::recursive_mutex> guard(relationLock);
     double h = rel->getAttribute(ATTRIBUTE_H);
     if (h < 0) { //-- not set yet
+        double df;
+        if (useStatsCache() && statsCache->findStatistics(rel, &h, &df)) {
+            rel->setAttribute(ATTRIBUTE_H, h);
+            rel->setAttribute(ATTRIBUTE_DF, df);
+            return h;
+        }
         Table *table = rel->getTable();
         if (table == NULL) {
             makeProjection(rel);
@@ -841,6 +939,8 @@ double ManagerBase::computeH(Relation *rel) // uncertainty
         }
         h = ocEntropy(table);
         rel->setAttribute(ATTRIBUTE_H, h);
+        if (useStatsCache())
+            statsCache->addStatistics(rel, h, computeDF(rel));
     }
     return h;
 }
@@ -862,7 +962,7 @@ double ManagerBase::computeH(Model *model, HMethod method, int SB) {
         h = model->getAttribute(ATTRIBUTE_FIT_H);
         if (h < 0) {
             makeFitTable(model);
-            h = ocEntropy(fitTable1);
+            h = ocEntropy(getWorkspace()->fitTable1);
             model->setAttribute(ATTRIBUTE_FIT_H, h);
             model->setAttribute(ATTRIBUTE_H, h);
         }
@@ -919,11 +1019,12 @@ struct DFAndHProc: public ocIntersectProcessor {
 void ManagerBase::calculateDfAndEntropy(Model *model) {
     if ((model->getAttribute(ATTRIBUTE_DF) < 0) || (model->getAttribute(ATTRIBUTE_ALG_H) < 0)) {
         DFAndHProc processor(this);
-        if (intersectArray != NULL) {
-            delete[] intersectArray;
-            intersectCount = 0;
-            intersectMax = model->getRelationCount();
-            intersectArray = NULL;
+        FitWorkspace *ws = getWorkspace();
+        if (ws->intersectArray != NULL) {
+            delete[] ws->intersectArray;
+            ws->intersectCount = 0;
+            ws->intersectMax = model->getRelationCount();
+            ws->intersectArray = NULL;
         }
         doIntersectionProcessing(model, &processor);
         model->setAttribute(ATTRIBUTE_DF, processor.df);
@@ -932,10 +1033,15 @@ void ManagerBase::calculateDfAndEntropy(Model *model) {
 }
 
 void ManagerBase::doIntersectionProcessing(Model *model, ocIntersectProcessor *proc) {
+    FitWorkspace *ws = getWorkspace();
+    VarIntersect *&intersectArray = ws->intersectArray;
+    int &intersectCount = ws->intersectCount;
+    int &intersectMax = ws->intersectMax;
     //-- allocate intersect storage; this grows later if needed
     if (intersectArray == NULL) {
         intersectMax = model->getRelationCount();
         intersectArray = new VarIntersect[intersectMax];
+        ws->accountIntersect();
     }
     int count = model->getRelationCount();
     VariableList *varList = model->getRelation(0)->getVariableList();
@@ -947,6 +1053,7 @@ void ManagerBase::doIntersectionProcessing(Model *model, ocIntersectProcessor *p
         while (intersectCount >= intersectMax) {
             intersectArray = (VarIntersect*) growStorage(intersectArray, sizeof(VarIntersect)*intersectMax, 2);
             intersectMax *= 2;
+            ws->accountIntersect();
         }
         VarIntersect *intersect = intersectArray + (intersectCount++);
         intersect->rel = rel;
@@ -1025,6 +1132,7 @@ void ManagerBase::doIntersectionProcessing(Model *model, ocIntersectProcessor *p
 // !!! This function computes dependent stats whether or not this is a directed system. !!!
 // Perhaps this should be fixed. [jsf]
 void ManagerBase::computeStatistics(Relation *rel) {
+    std::lock_guard<std::recursive_mutex> guard(relationLock);
     int varcount;
     int maxVars = rel->getVariableCount();
     int *varindices = new int[maxVars];
@@ -1119,6 +1227,24 @@ double ManagerBase::computeDDF(Model *model) {
     return ddf;
 }
 
+// The attributes each group of statistics provides; any other attribute gets
+// the L2 and dependent statistics, which cover most of the rest.
+void ManagerBase::computeSortStatistic(Model *model, const char *attr) {
+    if (strcmp(attr, "h") == 0 || strcmp(attr, "information") == 0 || strcmp(attr, "unexplained") == 0
+            || strcmp(attr, "alg_t") == 0) {
+        computeInformationStatistics(model);
+    } else if (strcmp(attr, "df") == 0 || strcmp(attr, "ddf") == 0) {
+        computeDFStatistics(model);
+    } else if (strcmp(attr, "bp_t") == 0 || strcmp(attr, "bp_information") == 0 || strcmp(attr, "bp_alpha") == 0) {
+        computeBPStatistics(model);
+    } else if (strcmp(attr, "pct_correct_data") == 0) {
+        computePercentCorrect(model);
+    } else {
+        computeL2Statistics(model);
+        computeDependentStatistics(model);
+    }
+}
+
 void ManagerBase::computeIncrementalAlpha(Model *model) {
     if (model == NULL)
         return;
@@ -1137,7 +1263,7 @@ void ManagerBase::computeIncrementalAlpha(Model *model) {
             prog_id = (double) progen->getID();
             double prog_ddf = computeDDF(progen);
             double prog_lr = computeLR(progen);
-            incr_alpha = csa(fabs(prog_lr - refL2), fabs(prog_ddf - refDDF));
+            incr_alpha = ocChiSquaredAlpha(fabs(prog_lr - refL2), fabs(prog_ddf - refDDF));
             if ((incr_alpha < alpha_threshold) && (progen->getAttribute(ATTRIBUTE_INCR_ALPHA_REACHABLE) == 1)) {
                 ia_reachable = 1;
             } else {
@@ -1305,9 +1431,9 @@ Model *ManagerBase::makeModel(const char *name, bool makeProject) {
     delete[] relname;
 
     //-- put it in the cache; return the cached one if present
-    if (!modelCache->addModel(model)) {
+    Model *cachedModel = modelCache->findOrAddModel(model);
+    if (cachedModel != model) {
         //-- already exists in cache; return that one
-        Model *cachedModel = modelCache->findModel(model->getPrintName());
         delete model;
         model = cachedModel;
     }
@@ -1367,15 +1493,15 @@ Model *ManagerBase::makeSbModel(const char *name, bool makeProject) {
             delete model, relName, vars;
             return NULL; // error in name
         }
-        model->addRelation(rel, true, getModelCache());
+        model->addRelation(rel, true);
         atStart = false;
     }
     model->completeSbModel();
 
     //-- put it in the cache; return the cached one if present
-    if (!modelCache->addModel(model)) {
+    Model *cachedModel = modelCache->findOrAddModel(model);
+    if (cachedModel != model) {
         //-- already exists in cache; return that one
-        Model *cachedModel = modelCache->findModel(model->getPrintName());
         delete model;
         model = cachedModel;
     }
@@ -1396,12 +1522,103 @@ void ManagerBase::printOptions(bool printHTML, bool skipNominal) {
     }
 }
 
+void ManagerBase::setMemoryLimit(long long bytes) {
+    memoryLimit = bytes < 0 ? 0 : bytes;
+}
+
+long long ManagerBase::getMemoryLimit() {
+    if (memoryLimit >= 0)
+        return memoryLimit;
+    double megabytes;
+    if (getOptionFloat("memory-limit", NULL, &megabytes) && megabytes > 0)
+        return (long long) (megabytes * 1048576);
+    return 0;
+}
+
+//-- eviction brings the cached tables down to this fraction of the memory limit, so
+//-- that a search running near the limit doesn't evict after every progenitor
+static const double MEMORY_LOW_WATER = 0.75;
+
+bool ManagerBase::reclaimMemory() {
+    long long limit = getMemoryLimit();
+    if (limit <= 0)
+        return true;
+    //-- every table but the data could be a cached one, so this is a bound on the
+    //-- cached bytes; only when it is over the limit are the caches searched
+    long long dataBytes = (inputData ? inputData->size() : 0) + (testData ? testData->size() : 0);
+    long long tableBytes = MemoryAccount::get(MemoryCategory::Tables) + MemoryAccount::get(MemoryCategory::FitScratch)
+            - dataBytes;
+    long long fixedBytes = MemoryAccount::get(MemoryCategory::Relations) + MemoryAccount::get(MemoryCategory::Models)
+            + dataBytes;
+    if (tableBytes <= limit)
+        return fixedBytes <= limit;
+
+    struct Cached {
+        long long lastUsed;
+        long long bytes;
+        Relation *rel;
+        Model *model;
+        FitWorkspace *ws;
+    };
+    std::vector<Cached> cached;
+    long long cachedBytes = 0;
+    std::lock_guard<std::recursive_mutex> relGuard(relationLock);
+    std::lock_guard<std::mutex> wsGuard(workspaceLock);
+    std::vector<Relation*> rels;
+    relCache->collectTables(rels, inputData);
+    for (size_t i = 0; i < rels.size(); i++) {
+        Cached entry = { rels[i]->getLastUsed(), rels[i]->getTable()->size(), rels[i], NULL, NULL };
+        cached.push_back(entry);
+    }
+    std::vector<Model*> models;
+    modelCache->collectFitTables(models);
+    for (size_t i = 0; i < models.size(); i++) {
+        Cached entry = { models[i]->getFitTableUsed(), models[i]->getFitTable()->size(), NULL, models[i], NULL };
+        cached.push_back(entry);
+    }
+    for (size_t i = 0; i < spareWorkspaces.size(); i++) {
+        FitWorkspace *ws = spareWorkspaces[i];
+        long long bytes = (ws->fitTable1 ? ws->fitTable1->size() : 0) + (ws->fitTable2 ? ws->fitTable2->size() : 0)
+                + (ws->projTable ? ws->projTable->size() : 0);
+        if (bytes > 0) {
+            Cached entry = { ws->lastUsed, bytes, NULL, NULL, ws };
+            cached.push_back(entry);
+        }
+    }
+    for (size_t i = 0; i < cached.size(); i++)
+        cachedBytes += cached[i].bytes;
+
+    if (cachedBytes > limit) {
+        evictionCount++;
+        std::sort(cached.begin(), cached.end(), [](const Cached &a, const Cached &b) {
+            return a.lastUsed < b.lastUsed;
+        });
+        long long lowWater = (long long) (limit * MEMORY_LOW_WATER);
+        for (size_t i = 0; i < cached.size() && cachedBytes > lowWater; i++) {
+            Cached &entry = cached[i];
+            if (entry.rel) {
+                entry.rel->deleteTable();
+            } else if (entry.model) {
+                entry.model->deleteFitTable();
+            } else {
+                delete entry.ws->fitTable1;
+                delete entry.ws->fitTable2;
+                delete entry.ws->projTable;
+                entry.ws->fitTable1 = entry.ws->fitTable2 = entry.ws->projTable = NULL;
+            }
+            cachedBytes -= entry.bytes;
+        }
+    }
+    return fixedBytes <= limit;
+}
+
 void ManagerBase::printSizes() {
     long size;
     size = relCache->size();
     printf("Rel-cache: %ld; ", size);
     size = modelCache->size();
     printf("Model cache: %ld; ", size);
+    MemoryAccount::print(stdout);
     //	relCache->dump();
     modelCache->dump();
 }
@@ -1443,67 +1660,111 @@ void ManagerBase::fitTestAlgebraic(Model* model, Table* algTable, double missing
     }
 }
 
+long long *ManagerBase::getInputIndexColumn(Relation *rel) {
+    std::lock_guard<std::recursive_mutex> guard(relationLock);
+    //-- the input data is swapped out while computing projected fits, so the
+    //-- cached column is only used if it was built from the current input data.
+    long long *cached = rel->getIndexColumn(inputData);
+    if (cached)
+        return cached;
+    makeProjection(rel);
+    Table *table = rel->getTable();
+    KeySegment *mask = rel->getMask();
+    KeySegment key[keysize];
+    long long inSize = inputData->getTupleCount();
+    long long *column = new long long[inSize];
+    for (long long ti = 0; ti < inSize; ti++) {
+        KeySegment *tupleKey = inputData->getKey(ti);
+        for (int k = 0; k < keysize; k++)
+            key[k] = tupleKey[k] | mask[k];
+        column[ti] = table->indexOf(key);
+    }
+    rel->setIndexColumn(column, inputData);
+    return column;
+}
+
+// The algebraic fit is the product over the intersection terms of each term's
+// marginal raised to its (signed) count. Each term's marginal is read through its
+// index column, and the product is accumulated as a sum of logs, so a fit is a few
+// linear passes over the input tuples once the columns are built.
 bool ManagerBase::makeFitTableAlgebraic(Model* model) {
     FitIntersectMap fitIs = computeIntersectLevels(model);
 
+    double missingCard = getMissingCardinalityFactor(model);
+
+    long long inSize = inputData->getTupleCount();
+    double *logFit = new double[inSize];
+    bool *zeroFit = new bool[inSize];
+    for (long long ti = 0; ti < inSize; ti++) {
+        logFit[ti] = 0.0;
+        zeroFit[ti] = false;
+    }
+
     for (auto it=fitIs.begin(); it != fitIs.end(); ++it) {
-        makeProjection(it->first);
+        Relation *rel = it->first;
+        long long *column = getInputIndexColumn(rel);
+        Table *table = rel->getTable();
+        double exponent = (double) it->second;
+
+        //-- take logs once per relation cell, rather than once per input tuple.
+        //-- cells too small to use are flagged with a NaN log.
+        long long relSize = table->getTupleCount();
+        double *logRel = new double[relSize];
+        for (long long c = 0; c < relSize; c++) {
+            double v = table->getValue(c);
+            logRel[c] = v <= DBL_EPSILON ? NAN : exponent * log(v);
+        }
+        for (long long ti = 0; ti < inSize; ti++) {
+            long long c = column[ti];
+            if (c < 0)
+                continue; // no matching cell; treated as a value of 1
+            double lv = logRel[c];
+            if (isnan(lv))
+                zeroFit[ti] = true;
+            else
+                logFit[ti] += lv;
+        }
+        delete[] logRel;
     }
 
-    double missingCard = getMissingCardinalityFactor(model);
-    
-    long long inSize = inputData->getTupleCount();
     Table *algTable = new Table(keysize, inSize);
-
-    // for every tuple in training data:
     for (long long ti = 0; ti < inSize; ti++) {
-        KeySegment* tupleKey = inputData->getKey(ti);
-       
-        double outValue = 1;    
-        // for each item in fitIntersectArray:
-        for (auto it=fitIs.begin(); it != fitIs.end(); ++it) {
-            
-            double v = it->first->getMatchingTupleValue(tupleKey);
-            
-            if (v <= DBL_EPSILON) {
-                outValue = 0;
-                break;
-            }
-            double vp = pow(v, it->second); 
-            outValue *= vp;
-        } 
-    
-        algTable->sumTuple(tupleKey, outValue / missingCard);
-    } 
+        double outValue = zeroFit[ti] ? 0.0 : exp(logFit[ti]);
+        algTable->sumTuple(inputData->getKey(ti), outValue / missingCard);
+    }
+    delete[] logFit;
+    delete[] zeroFit;
 
     if (testData) { fitTestAlgebraic(model, algTable, missingCard, fitIs); }
 
     algTable->sort();
-    if (fitTable1) delete fitTable1;
-    fitTable1 = algTable;
+    FitWorkspace *ws = getWorkspace();
+    if (ws->fitTable1) delete ws->fitTable1;
+    algTable->setMemoryCategory(MemoryCategory::FitScratch);
+    ws->fitTable1 = algTable;
  
     return true;
 }
 
 bool ManagerBase::makeFitTableIPF(Model* model) {
     // For looped & SB models, proceed to solve with IPF.
-    stateSpaceSize = (unsigned long long) ocDegreesOfFreedom(varList) + 1;
-    if (!fitTable1) {
-        //-- for large state spaces, start with less space and let it grow.
-        if (stateSpaceSize > 1000000)
-            stateSpaceSize = 1000000;
+    FitWorkspace *ws = getWorkspace();
+    Table *&fitTable1 = ws->fitTable1;
+    Table *&fitTable2 = ws->fitTable2;
+    Table *&projTable = ws->projTable;
+    unsigned long long stateSpaceSize = (unsigned long long) ocDegreesOfFreedom(varList) + 1;
+    //-- for large state spaces, start with less space and let it grow.
+    if (stateSpaceSize > 1000000)
+        stateSpaceSize = 1000000;
+    if (!fitTable1)
         fitTable1 = new Table(keysize, stateSpaceSize);
-    }
-    if (!fitTable2) {
-        if (stateSpaceSize > 1000000)
-            stateSpaceSize = 1000000;
+    if (!fitTable2)
         fitTable2 = new Table(keysize, stateSpaceSize);
-    }
-    if (!projTable) {
-        if (stateSpaceSize > 1000000)
-            stateSpaceSize = 1000000;
+    if (!projTable)
         projTable = new Table(keysize, stateSpaceSize);
-    }
+    fitTable1->setMemoryCategory(MemoryCategory::FitScratch);
+    fitTable2->setMemoryCategory(MemoryCategory::FitScratch);
+    projTable->setMemoryCategory(MemoryCategory::FitScratch);
     fitTable1->reset(keysize);
     fitTable2->reset(keysize);
     projTable->reset(keysize);
@@ -1534,7 +1795,27 @@ bool ManagerBase::makeFitTableIPF(Model* model) {
             expsize = newexpsize;
         }
     }
-    makeOrthoExpansion(relList[startRel], fitTable1);
+    //-- if the starting expansion is very large, don't store it. Instead the first
+    //-- scaling pass walks it on the fly, and only keeps the cells which are nonzero
+    //-- in every relation's marginal, since IPF would set any other cell to zero.
+    //-- (state-based projections need the whole relation table, so this only
+    //-- applies to variable-based models.)
+    ExpansionIterator *expansion = NULL;
+    double expansionScale = 1.0;
+    double maxStored;
+    if (!getOptionFloat("ipf-maxstored", NULL, &maxStored))
+        maxStored = MAX_STORED_EXPANSION;
+    if (!model->isStateBased() && expsize > maxStored) {
+        expansion = makeOrthoIterator(relList[startRel]);
+        double relSum = 0.0;
+        Table *startTable = tableList[startRel];
+        for (long long t = 0; t < startTable->getTupleCount(); t++) {
+            relSum += startTable->getValue(t);
+        }
+        expansionScale = 1.0 / (relSum * expansion->getExpansionFactor());
+    } else {
+        makeOrthoExpansion(relList[startRel], fitTable1);
+    }
 
     // configurable fitting parameters:  convergence error. This is approximately in units of samples.
     // if initial data was probabilities, an artificial scale of 1000 is used.
@@ -1549,14 +1830,66 @@ bool ManagerBase::makeFitTableIPF(Model* model) {
     if (hasLoops(model) || (model->isStateBased() && (model->getRelationCount() > 1))) {
         getOptionFloat("ipf-maxit", NULL, &maxiter);
     }
+    //-- if no scaling pass will run, the fit is the starting expansion itself
+    if (expansion && maxiter < 1) {
+        delete expansion;
+        expansion = NULL;
+        makeOrthoExpansion(relList[startRel], fitTable1);
+    }
 
     int iter, r;
     long long i, j;
     long long tupleCount;
-    double newValue, value, relValue, projValue;
+    double relValue, projValue;
     Relation *rel;
     Table *table;
     KeySegment *mask;
+
+    // scale one tuple of the current fit by the ratio of the projection from the
+    // input data and the computed projection from the previous iteration. In any
+    // cases where the input marginal is zero, or where the computed marginal is
+    // zero, skip this tuple (equivalent to setting it to zero, but conserves space).
+    // A tuple which isn't to be stored still counts toward the error.
+    auto scaleTuple = [&](KeySegment *tupleKey, double value, bool store) {
+        double newValue = 0.0;
+        memcpy(key, tupleKey, keysize * sizeof(KeySegment));
+        for (k = 0; k < keysize; k++)
+            key[k] |= mask[k];
+        j = table->indexOf(key);
+        if (j >= 0) {
+            relValue = table->getValue(j);
+            if (relValue > DBL_EPSILON) {
+                j = projTable->indexOf(key);
+                if (j >= 0) {
+                    projValue = projTable->getValue(j);
+                    if (projValue > DBL_EPSILON) {
+                        newValue = value * relValue / projValue;
+                    }
+                    error = fmax(error, fabs(relValue - projValue));
+                } else {
+                    error = fmax(error, relValue);
+                }
+            }
+        }
+        if (store && newValue > DBL_EPSILON) {
+            fitTable2->addTuple(tupleKey, newValue);
+        }
+    };
+
+    // true if the tuple's marginal is nonzero in every relation but the first, so
+    // that the fit can be nonzero there once every relation has scaled it
+    KeySegment *supportKey = new KeySegment[keysize];
+    auto inSupport = [&](KeySegment *tupleKey) {
+        for (int s = 1; s < relCount; s++) {
+            for (k = 0; k < keysize; k++)
+                supportKey[k] = tupleKey[k] | maskList[s][k];
+            long long n = tableList[s]->indexOf(supportKey);
+            if (n < 0 || tableList[s]->getValue(n) <= DBL_EPSILON)
+                return false;
+        }
+        return true;
+    };
+
     for (iter = 0; iter < maxiter; iter++) {
         error = 0.0; // absolute difference between original projection and computed values
         for (r = 0; r < relCount; r++) {
@@ -1565,39 +1898,30 @@ bool ManagerBase::makeFitTableIPF(Model* model) {
             mask = maskList[r];
             // create a projection of the computed data, based on the variables in the relation
             projTable->reset(keysize);
-            makeProjection(fitTable1, projTable, rel);
-            // for each tuple in fitTable1, create a scaled tuple in fitTable2, scaled by the
-            // ratio of the projection from the input data, and the computed projection
-            // from the previous iteration.  In any cases where the input marginal is
-            // zero, or where the computed marginal is zero, skip this tuple (equivalent
-            // to setting it to zero, but conserves space).
-            tupleCount = fitTable1->getTupleCount();
+            if (expansion) {
+                while (expansion->next()) {
+                    memcpy(key, expansion->getKey(), keysize * sizeof(KeySegment));
+                    for (k = 0; k < keysize; k++)
+                        key[k] |= mask[k];
+                    projTable->sumTuple(key, expansion->getValue() * expansionScale);
+                }
+            } else {
+                makeProjection(fitTable1, projTable, rel);
+            }
+            // for each tuple in the current fit, create a scaled tuple in fitTable2
             fitTable2->reset(keysize);
-            for (i = 0; i < tupleCount; i++) {
-                newValue = 0.0;
-                fitTable1->copyKey(i, key);
-                value = fitTable1->getValue(i);
-                for (k = 0; k < keysize; k++)
-                    key[k] |= mask[k];
-                j = table->indexOf(key);
-                if (j >= 0) {
-                    relValue = table->getValue(j);
-                    if (relValue > DBL_EPSILON) {
-                        j = projTable->indexOf(key);
-                        if (j >= 0) {
-                            projValue = projTable->getValue(j);
-                            if (projValue > DBL_EPSILON) {
-                                newValue = value * relValue / projValue;
-                            }
-                            error = fmax(error, fabs(relValue - projValue));
-                        } else {
-                            error = fmax(error, relValue);
-                        }
-                    }
+            if (expansion) {
+                expansion->reset();
+                while (expansion->next()) {
+                    scaleTuple(expansion->getKey(), expansion->getValue() * expansionScale,
+                            inSupport(expansion->getKey()));
                 }
-                if (newValue > DBL_EPSILON) {
-                    fitTable1->copyKey(i, key);
-                    fitTable2->addTuple(key, newValue);
+                delete expansion;
+                expansion = NULL;
+            } else {
+                tupleCount = fitTable1->getTupleCount();
+                for (i = 0; i < tupleCount; i++) {
+                    scaleTuple(fitTable1->getKey(i), fitTable1->getValue(i), true);
                 }
             }
             Table *ftswap = fitTable1;        // swap fitTable1 and fitTable2 for next pass
@@ -1607,10 +1931,12 @@ bool ManagerBase::makeFitTableIPF(Model* model) {
         if (error < delta2)         // check convergence
             break;
     }
+    delete expansion;
     fitTable1->sort();
     model->setAttribute(ATTRIBUTE_IPF_ITERATIONS, (double) iter);
     model->setAttribute(ATTRIBUTE_IPF_ERROR, error);
     delete[] key;
+    delete[] supportKey;
     return true;
 }
 
@@ -1702,8 +2028,9 @@ FitIntersectMap ManagerBase::computeIntersectLevels(Model* model) {
 
 
 Table* ManagerBase::disownTable() {
-    Table* ret = fitTable1;
-    fitTable1 = nullptr;
+    FitWorkspace *ws = getWorkspace();
+    Table* ret = ws->fitTable1;
+    ws->fitTable1 = nullptr;
     return ret;
 }
 
@@ -1711,9 +2038,10 @@ Table* ManagerBase::getIndepTable() {
     Table* oldFitTable1 = disownTable();
 
     makeFitTable(bottomRef);
-    Table* table = fitTable1;
+    FitWorkspace *ws = getWorkspace();
+    Table* table = ws->fitTable1;
 
-    fitTable1 = oldFitTable1;
+    ws->fitTable1 = oldFitTable1;
     return table;}
 
 
@@ -1729,9 +2057,10 @@ Table* ManagerBase::getIndepTable() {
 Table* ManagerBase::projectedFit(Relation* projectTo, Model* fitModel) {
 
     // save the work tables; also zero out the fitTable1.
-    Table* oldFitTable = fitTable1;
+    FitWorkspace *ws = getWorkspace();
+    Table* oldFitTable = ws->fitTable1;
     Table* oldData = inputData;
-    fitTable1 = nullptr;
+    ws->fitTable1 = nullptr;
 
 //    printf("<br>");
 //    printf("OLD FIT TABLE:");
@@ -1754,8 +2083,8 @@ Table* ManagerBase::projectedFit(Relation* projectTo, Model* fitModel) {
     makeFitTable(fitModel);
 
     // get out the result and reset the work tables
-    Table* result = fitTable1;
-    fitTable1 = oldFitTable;
+    Table* result = ws->fitTable1;
+    ws->fitTable1 = oldFitTable;
     inputData = oldData;
 
 
@@ -16,6 +16,7 @@
 #include "RelCache.h"
 #include "Relation.h"
 #include "StateConstraint.h"
+#include "StatsCache.h"
 #include "VariableList.h"
 #include "_Core.h"
 #include <assert.h>
@@ -118,5 +119,17 @@ bool ManagerBase::initFromCommandLine(int argc, char **argv) {
     testData = test;
     inputH = ocEntropy(inputData);
     keysize = vars->getKeySize();
+
+    //-- open the persistent statistics cache, if one was requested
+    const char *cacheDir;
+    if (getOptionString("stats-cache", NULL, &cacheDir) && cacheDir[0] != '\0') {
+        bool saveTables = getOptionString("stats-cache-tables", NULL, &option);
+        statsCache = new StatsCache(cacheDir, varList, inputData, saveTables);
+        statsCacheData = inputData;
+        if (!statsCache->isOpen()) {
+            delete statsCache;
+            statsCache = NULL;
+        }
+    }
     return true;
 }
@@ -7,8 +7,10 @@
 
 #include <math.h>
 
+#include "Key.h"
 #include "Math.h"
 #include "Model.h"
+#include "RankBasis.h"
 #include "Relation.h"
 #include "_Core.h"
 
@@ -16,35 +18,87 @@
 #include <string.h>
 #include <float.h>
 #include "Constants.h"
+#include <mutex>
+#include <unordered_map>
 
 #include <boost/math/distributions/chi_squared.hpp>
 
+//-- values are passed to the batched kernels in blocks of this many
+static const long long KERNEL_BLOCK = 1024;
+
 double ocEntropy(Table *p) {
     double h = 0.0;
+    double values[KERNEL_BLOCK];
     long long count = p->getTupleCount();
-    double pv;
-    for (long long i = 0; i < count; ++i) {
-        pv = p->getValue(i);
-        if (pv > PROB_MIN)
-            h -= pv * log(pv);
+    for (long long i = 0; i < count; i += KERNEL_BLOCK) {
+        long long n = p->copyValues(i, KERNEL_BLOCK, values);
+        h -= ocPLogPSum(values, n);
     }
     h /= log(2.0); // convert h to log2 rather than ln
     return h;
 }
 
+/**
+ * Merge-join helpers for comparing two tables. Tables are kept sorted by key, so
+ * a table can be matched against another in a single linear pass, rather than
+ * with a binary search per tuple.
+ */
+
+// MatchCursor - finds values in a sorted table for a (normally increasing) sequence
+// of keys. If a key is lower than the one before it, the cursor falls back to a
+// binary search to reposition, so the result is correct for any key order.
+class MatchCursor {
+    public:
+        MatchCursor(Table *table) :
+                table(table), index(0), count(table->getTupleCount()),
+                keysize(table->getKeySize()), lastKey(NULL) {
+        }
+
+        // the value of the tuple matching key, or zero if there is none
+        double valueOf(KeySegment *key) {
+            if (lastKey && Key::compareKeys(lastKey, key, keysize) > 0)
+                index = table->indexOf(key, false);
+            lastKey = key;
+            while (index < count && Key::compareKeys(table->getKey(index), key, keysize) < 0)
+                index++;
+            if (index < count && Key::compareKeys(table->getKey(index), key, keysize) == 0)
+                return table->getValue(index);
+            return 0.0;
+        }
+
+    private:
+        Table *table;
+        long long index;
+        long long count;
+        int keysize;
+        KeySegment *lastKey;
+};
+
+// call action(pv, qv) for each tuple in p, where qv is the matching value in q
+template <typename F>
+static void matchTuples(Table *p, Table *q, F action) {
+    MatchCursor qCursor(q);
+    long long count = p->getTupleCount();
+    for (long long i = 0; i < count; i++) {
+        action(p->getValue(i), qCursor.valueOf(p->getKey(i)));
+    }
+}
+
 double ocTransmission(Table *p, Table *q) {
     // To prevent underflow errors, probabilities
     // less than PROB_MIN are considered zero.
     double h = 0.0;
-    long long count = p->getTupleCount();
-    for (long long i = 0; i < count; i++) {
-        double pv = p->getValue(i);
-        KeySegment *pv_key = p->getKey(i);
-        long long qi_index = q->indexOf(pv_key); // find matching entry in q
-        double qi = qi_index >= 0 ? q->getValue(qi_index) : 0.0;
-        if (qi > PROB_MIN && pv > PROB_MIN)
-            h += pv * log(pv / qi);
-    }
+    double pValues[KERNEL_BLOCK], qValues[KERNEL_BLOCK];
+    long long n = 0;
+    matchTuples(p, q, [&](double pv, double qi) {
+        pValues[n] = pv;
+        qValues[n++] = qi;
+        if (n == KERNEL_BLOCK) {
+            h += ocPLogPQSum(pValues, qValues, n);
+            n = 0;
+        }
+    });
+    h += ocPLogPQSum(pValues, qValues, n);
     h /= log(2.0); // convert h to log2 rather than ln
     return h;
 }
@@ -75,17 +129,12 @@ double ocPearsonChiSquared(Table *p, Table *q, long sampleSize) {
     // To prevent underflow errors, probabilities
     // less than PROB_MIN are considered zero.
     double p2 = 0.0;
-    long count = p->getTupleCount();
-    for (long i = 0; i < count; i++) {
-        double pi = p->getValue(i);
-        KeySegment *pi_key = p->getKey(i);
-        long qi_index = q->indexOf(pi_key); // find matching entry in q
-        double qi = qi_index >= 0 ? q->getValue(qi_index) : 0.0;
+    matchTuples(p, q, [&](double pi, double qi) {
         if (pi < PROB_MIN)
             p2 += qi; // works even if q1 near zero
         else if (qi > PROB_MIN)
             p2 += (pi - qi) * (pi - qi) / qi;
-    }
+    });
     p2 *= sampleSize;
     return p2;
 }
@@ -1015,97 +1064,112 @@ unsigned chistat(unsigned ntab, double* obs, double* fit, double* g2_ptr, double
     return nz;
 }
 
-// Gaussian elimination method to calculate rank
-// source: http://www.wikipedia.org/wiki/Gauss_elimination_method
-double ocDegreesOfFreedomStateBased(Model *model) {
-    int nrows = 0, ncols = 0;
-    int i = 0, j = 0;
-    double **matrix = NULL;
-    int **struct_matrix = model->getStructMatrix(&ncols, &nrows);
-    if (struct_matrix == NULL) {
-        fprintf(stdout, "ocDegreesOfFreedomStateBased(): Error. Model %s: struct matrix not found.\n", model->getPrintName());
-        fflush(stdout);
-        exit(1);
-    }
-    // create a copy of the matrix to manipulate
-    matrix = new double *[nrows];
-    for (i = 0; i < nrows; i++) {
-        matrix[i] = new double[ncols];
+//-- Memoized chi-squared distribution values. Many models in a search level share a
+//-- DDF (and the critical value depends on nothing else), so the distribution
+//-- functions are cached by their arguments. Keys compare bit-for-bit, so a cached
+//-- value is exactly what the function would have returned.
+struct ChiSquaredKey {
+    int fn;
+    double a, b, c;
+    bool operator==(const ChiSquaredKey &other) const {
+        return fn == other.fn && memcmp(&a, &other.a, sizeof(double)) == 0
+                && memcmp(&b, &other.b, sizeof(double)) == 0 && memcmp(&c, &other.c, sizeof(double)) == 0;
     }
-    for (i = 0; i < nrows; i++) {
-        if (i < nrows - 1) {
-            for (j = 0; j < ncols; j++) {
-                matrix[i + 1][j] = (double)struct_matrix[i][j];
-            }
-        } else {
-            for (j = 0; j < ncols; j++) {
-                matrix[0][j] = (double)struct_matrix[i][j];
-            }
+};
+
+struct ChiSquaredKeyHash {
+    size_t operator()(const ChiSquaredKey &key) const {
+        unsigned long long h = 14695981039346656037ULL, bits;
+        const double *args[3] = { &key.a, &key.b, &key.c };
+        for (int i = 0; i < 3; i++) {
+            memcpy(&bits, args[i], sizeof(bits));
+            h = (h ^ bits) * 1099511628211ULL;
         }
+        return (size_t) (h ^ key.fn);
     }
-    model->deleteStructMatrix();
-    int irow, jrow, icol, jcol;
-    bool have_pivot = false;
-    int rowmax = 0;
-    icol = 0;
-    int i1, j1;
-    double *temp_ptr;
-    for (irow = 0; irow < nrows; irow++) {    // Find pivot in column j, starting in row i:
-        have_pivot = false;
-        do {
-            rowmax = irow;
-            if (icol >= ncols) break;
-            for (jrow = irow + 1; jrow < nrows; jrow++) {
-                if (fabs(matrix[jrow][icol]) > fabs(matrix[rowmax][icol])) {
-                    rowmax = jrow;
-                }
-            }
-            if (fabs(matrix[rowmax][icol]) > DBL_EPSILON) {
-                have_pivot = true;
-                if (rowmax != irow) {   //switch rows irow and rowmax
-                    temp_ptr = matrix[irow];
-                    matrix[irow] = matrix[rowmax];
-                    matrix[rowmax] = temp_ptr;
-                }
-            } else {
-                matrix[rowmax][icol] = 0.0;
-                icol = icol + 1;
-            }
-        } while ((!have_pivot) && (icol < ncols));
-        if (icol >= ncols) {
-            break;
-        }
-        double factor;
-        if (fabs(matrix[irow][icol]) > DBL_EPSILON) {
-            for (jrow = irow+1; jrow < nrows; jrow++) {
-                factor = matrix[jrow][icol] / matrix[irow][icol];
-                for (jcol = icol+1; jcol < ncols; jcol++) {
-                    matrix[jrow][jcol] -= matrix[irow][jcol] * factor;
-                }
-                matrix[jrow][icol] = 0.0;
-            }
-        }
-        icol++;
+};
+
+struct ChiSquaredValue {
+    double value;
+    int ifault;
+};
+
+//-- the cache is simply emptied when it reaches this size
+static const size_t CHI_CACHE_LIMIT = 1 << 16;
+enum { CHI_ALPHA, CHI_CRITICAL, CHI_POWER };
+static std::unordered_map<ChiSquaredKey, ChiSquaredValue, ChiSquaredKeyHash> chiCache;
+static std::mutex chiCacheLock; // models may be evaluated on several threads
+
+static bool chiLookup(int fn, double a, double b, double c, ChiSquaredValue *result) {
+    ChiSquaredKey key = { fn, a, b, c };
+    std::lock_guard<std::mutex> guard(chiCacheLock);
+    std::unordered_map<ChiSquaredKey, ChiSquaredValue, ChiSquaredKeyHash>::iterator it = chiCache.find(key);
+    if (it == chiCache.end())
+        return false;
+    *result = it->second;
+    return true;
+}
+
+static void chiStore(int fn, double a, double b, double c, double value, int ifault) {
+    std::lock_guard<std::mutex> guard(chiCacheLock);
+    if (chiCache.size() >= CHI_CACHE_LIMIT)
+        chiCache.clear();
+    ChiSquaredKey key = { fn, a, b, c };
+    ChiSquaredValue result = { value, ifault };
+    chiCache[key] = result;
+}
+
+double ocChiSquaredAlpha(double x, double df) {
+    ChiSquaredValue result;
+    if (!chiLookup(CHI_ALPHA, x, df, 0, &result)) {
+        result.value = csa(x, df);
+        chiStore(CHI_ALPHA, x, df, 0, result.value, 0);
     }
-    double rank = 0;
-    double limit = pow(FLT_RADIX, DBL_MANT_DIG);
-    for (i = 0; i < nrows; i++) {
-        for (j = i; j < ncols; j++) {
-            if (fabs(matrix[i][j]) > DBL_EPSILON) {
-                if (rank >= limit) {
-                    fprintf(stdout, "ocDegreesOfFreedomStateBased(): Error. DF exceeds current limits of State-based OCCAM.\n");
-                    fflush(stdout);
-                    exit(1);
-                } else {
-                    rank++;
-                    break;
-                }
-            }
-        }
+    return result.value;
+}
+
+double ocChiSquaredCritical(double alpha, double df, int *ifault) {
+    ChiSquaredValue result;
+    if (!chiLookup(CHI_CRITICAL, alpha, df, 0, &result)) {
+        result.value = ppchi(alpha, df, &result.ifault);
+        chiStore(CHI_CRITICAL, alpha, df, 0, result.value, result.ifault);
     }
-    for (i = 0; i < nrows; i++) {
-        delete[] matrix[i];
+    *ifault = result.ifault;
+    return result.value;
+}
+
+double ocChiSquaredPower(double critX2, double df, double lambda, int *ifault) {
+    ChiSquaredValue result;
+    if (!chiLookup(CHI_POWER, critX2, df, lambda, &result)) {
+        result.value = 1.0 - chin2(critX2, df, lambda, &result.ifault);
+        chiStore(CHI_POWER, critX2, df, lambda, result.value, result.ifault);
+    }
+    *ifault = result.ifault;
+    return result.value;
+}
+
+void ocChiSquaredAlphaPower(long count, const double *x, const double *df, double critAlpha, double *alpha,
+        double *power) {
+    int errcode;
+    for (long i = 0; i < count; i++) {
+        alpha[i] = ocChiSquaredAlpha(x[i], df[i]);
+        double critX2 = x[i];
+        errcode = 0;
+        if (critAlpha > 0)
+            critX2 = ocChiSquaredCritical(critAlpha, df[i], &errcode);
+        if (errcode)
+            printf("ppchi: errcode=%d\n", errcode);
+        power[i] = ocChiSquaredPower(critX2, df[i], x[i], &errcode);
+    }
+}
+
+// Degrees of freedom of a state-based model: the rank of its structure matrix, less one.
+double ocDegreesOfFreedomStateBased(Model *model) {
+    RankBasis *basis = model->getRankBasis();
+    if (basis == NULL) {
+        fprintf(stdout, "ocDegreesOfFreedomStateBased(): Error. Model %s: struct matrix not found.\n", model->getPrintName());
+        fflush(stdout);
+        exit(1);
     }
-    delete[] matrix;
-    return rank - 1;
+    return basis->getRank() - 1;
 }
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "MemoryAccount.h"
+#include <atomic>
+
+/**
+ * MemoryAccount.cpp - one relaxed atomic counter per category. The counters are
+ * only read to compare against a limit or to print, so no ordering is needed.
+ */
+
+static std::atomic<long long> counters[(int) MemoryCategory::Count];
+
+static std::atomic<long long> useClock(0);
+
+static const char *categoryNames[] = { "Tables", "Relations", "Models", "Fit scratch" };
+
+void MemoryAccount::add(MemoryCategory cat, long long bytes) {
+    counters[(int) cat].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+long long MemoryAccount::get(MemoryCategory cat) {
+    return counters[(int) cat].load(std::memory_order_relaxed);
+}
+
+long long MemoryAccount::total() {
+    long long sum = 0;
+    for (int c = 0; c < (int) MemoryCategory::Count; c++) {
+        sum += counters[c].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+const char *MemoryAccount::name(MemoryCategory cat) {
+    return categoryNames[(int) cat];
+}
+
+void MemoryAccount::print(FILE *fd) {
+    for (int c = 0; c < (int) MemoryCategory::Count; c++) {
+        fprintf(fd, "%s: %lld; ", categoryNames[c], get((MemoryCategory) c));
+    }
+    fprintf(fd, "Total: %lld\n", total());
+}
+
+long long MemoryAccount::nextUse() {
+    return useClock.fetch_add(1, std::memory_order_relaxed) + 1;
+}
@@ -9,8 +9,10 @@
 #include "ManagerBase.h"
 #include "AttributeList.h"
 #include "Math.h"
+#include "MemoryAccount.h"
 #include "Model.h"
 #include "ModelCache.h"
+#include "RankBasis.h"
 #include "Relation.h"
 #include "StateConstraint.h"
 #include "_Core.h"
@@ -36,19 +38,26 @@ Model::Model(int size) {
     totalConstraints = 0;
     relations = new Relation*[size];
     fitTable = NULL;
+    fitTableUsed = 0;
     attributeList = new AttributeList(6);
     printName = NULL;
     inverseName = NULL;
+    structHash = 0;
     hashNext = NULL;
     progenitor = NULL;
     ID = 0;
     structMatrix = NULL;
+    structRowStart = NULL;
+    rankBasis = NULL;
+    MemoryAccount::add(MemoryCategory::Models, sizeof(Model) + size * sizeof(Relation*));
 }
 
 Model::~Model() {
     if (structMatrix) {
         this->deleteStructMatrix();
     }
+    if (rankBasis)
+        delete rankBasis;
     if (printName) {
         delete printName;
         printName = NULL;
@@ -65,14 +74,14 @@ Model::~Model() {
     }
     if (attributeList)
         delete attributeList;
+    MemoryAccount::release(MemoryCategory::Models, sizeof(Model) + maxRelationCount * sizeof(Relation*));
 }
 
 void Model::deleteStructMatrix() {
-    for (int i = 0; i < totalConstraints; i++) {
-        delete[] structMatrix[i];
-    }
     delete[] structMatrix;
+    delete[] structRowStart;
     structMatrix = NULL;
+    structRowStart = NULL;
 }
 
 long Model::size() {
@@ -81,6 +90,8 @@ long Model::size() {
         size += fitTable->size();
     if (attributeList)
         size += attributeList->size();
+    if (rankBasis)
+        size += rankBasis->size();
     return size;
 }
 
@@ -99,11 +110,16 @@ void Model::deleteRelationLinks() {
 
 void Model::copyRelations(Model &model, int skip1, int skip2) {
     int count = model.getRelationCount();
+    bool wasEmpty = relationCount == 0;
     for (int i = 0; i < count; i++) {
         Relation *rel = model.getRelation(i);
         if (skip1 != i && skip2 != i)
             addRelation(rel, false);
     }
+    //-- a straight copy can start from the other model's rank basis, so that
+    //-- adding one more relation only has to reduce that relation's rows
+    if (wasEmpty && skip1 < 0 && skip2 < 0 && model.rankBasis != NULL && rankBasis == NULL)
+        rankBasis = new RankBasis(*model.rankBasis);
 }
 
 void Model::setAttribute(const char *name, double value) {
@@ -115,53 +131,86 @@ double Model::getAttribute(const char *name) {
     return attributeList->getAttribute(name);
 }
 
-//state space array
-int * Model::getIndicesFromKey(KeySegment *key, VariableList *vars, int statespace, int **stateSpaceArr,
-        int *counter) {
+void Model::setAttributeById(int id, double value) {
+    attributeList->setAttributeById(id, value);
+}
+
+double Model::getAttributeById(int id) {
+    return attributeList->getAttributeById(id);
+}
+
+// The states of the structure matrix are numbered in mixed radix, with the last
+// variable changing fastest. A constraint fixes the values of some variables, so
+// its states are one fixed offset plus every combination of the free variables.
+// Trailing free variables give runs of consecutive states; the remaining free
+// variables are stepped through like an odometer, one run at a time.
+int * Model::getIndicesFromKey(KeySegment *key, VariableList *vars, int *counter) {
     int varcount = vars->getVarCount();
-    int *value_l = new int[varcount];
-    //maximum number of states that can constrained by a relation
-    int *indices = new int[statespace];
-    for (int i = 0; i < varcount; i++) {
+    int *stride = new int[varcount];
+    int *freeVars = new int[varcount];
+    int *values = new int[varcount];
+    int freeCount = 0;
+    int base = 0;
+    int runLength = 1;
+    int matchCount = 1;
+    bool anyFixed = false;
+    bool trailing = true;
+    int s = 1;
+    for (int i = varcount - 1; i >= 0; i--) {
         Variable *var = vars->getVariable(i);
-        KeySegment mask = var->mask;
-        int segment = var->segment;
-        int value = 0;
-        KeySegment mask1;
-        if ((mask1 = (mask & key[segment])) == mask)
-            value_l[i] = DONT_CARE;
-        else {
-            value = (key[segment] & mask) >> var->shift;
-            value_l[i] = value;
+        stride[i] = s;
+        if ((var->mask & key[var->segment]) == var->mask) {
+            matchCount *= var->cardinality;
+            if (trailing)
+                runLength *= var->cardinality;
+            else
+                freeVars[freeCount++] = i; // collected last-first
+        } else {
+            base += ((key[var->segment] & var->mask) >> var->shift) * s;
+            anyFixed = true;
+            trailing = false;
         }
+        s *= var->cardinality;
     }
     *counter = 0;
-    int not_a_match = -1;
-    for (int i = 0; i < statespace; i++) {
-        for (int j = 0; j < varcount; j++) {
-            if (value_l[j] == DONT_CARE)
-                continue;
-            if (value_l[j] != stateSpaceArr[i][j]) {
-                not_a_match = 1;
-                break;
-            } else {
-                not_a_match = 0;
-            }
+    //-- a key with no fixed values doesn't constrain any states
+    if (!anyFixed) {
+        delete[] stride;
+        delete[] freeVars;
+        delete[] values;
+        return new int[0];
+    }
+    int *indices = new int[matchCount];
+    for (int i = 0; i < freeCount; i++) {
+        values[i] = 0;
+    }
+    int offset = base;
+    for (;;) {
+        for (int k = 0; k < runLength; k++) {
+            indices[(*counter)++] = offset + k;
         }
-        if (not_a_match == 0) {
-            indices[(*counter)] = i;
-            (*counter)++;
-
+        // advance the odometer; freeVars[0] is the fastest-changing free variable
+        int l = 0;
+        while (l < freeCount) {
+            int var = freeVars[l];
+            offset += stride[var];
+            if (++values[l] < vars->getVariable(var)->cardinality)
+                break;
+            offset -= values[l] * stride[var];
+            values[l] = 0;
+            l++;
         }
-        not_a_match = -1;
-
+        if (l >= freeCount)
+            break;
     }
-    delete[] value_l;
+    delete[] stride;
+    delete[] freeVars;
+    delete[] values;
     return indices;
 }
 
 // State-Based Structure matrix generation
-void Model::makeStructMatrix(int statespace, VariableList *vars, int **stateSpaceArr) {
+void Model::makeStructMatrix(int statespace, VariableList *vars) {
     if (structMatrix != NULL) return;
     int relCount = getRelationCount();
     long constraintCount = 0;
@@ -174,17 +223,10 @@ void Model::makeStructMatrix(int statespace, VariableList *vars, int **stateSpac
     }
     totalConstraints = constraintCount + 1;
     stateSpaceSize = statespace;
-    structMatrix = new int *[constraintCount + 1];
-    for (i = 0; i <= constraintCount; i++) {
-        structMatrix[i] = new int[statespace];
-    }
-    for (i = 0; i < statespace; i++) {
-        for (int j = 0; j < constraintCount; j++) {
-            structMatrix[j][i] = 0;
-        }
-        structMatrix[constraintCount][i] = 1; //the default constraint
-    }
-    constraintCount = 0;
+    structRowStart = new long[totalConstraints + 1];
+    int **rowIndices = new int *[constraintCount];
+    int *rowCounts = new int[constraintCount];
+    long nonzeros = statespace; //the default constraint
     int totalConstraintCount = 0;
     for (i = 0; i < relCount; i++) {
         Relation *rel = getRelation(i);
@@ -205,17 +247,40 @@ void Model::makeStructMatrix(int statespace, VariableList *vars, int **stateSpac
                 exit(1);
             }
             int counter;
-            int *indices = getIndicesFromKey(key, vars, statespace, stateSpaceArr, &counter);
-            for (int k = 0; k < counter; k++) {
-                structMatrix[totalConstraintCount + j][indices[k]] = 1;
-            }
-            delete[] indices;
+            rowIndices[totalConstraintCount + j] = getIndicesFromKey(key, vars, &counter);
+            rowCounts[totalConstraintCount + j] = counter;
+            nonzeros += counter;
         }
         totalConstraintCount += constraintCount;
     }
+    // pack the rows; getIndicesFromKey returns indices in increasing order
+    structMatrix = new int[nonzeros];
+    long pos = 0;
+    for (i = 0; i < totalConstraintCount; i++) {
+        structRowStart[i] = pos;
+        memcpy(structMatrix + pos, rowIndices[i], rowCounts[i] * sizeof(int));
+        pos += rowCounts[i];
+        delete[] rowIndices[i];
+    }
+    structRowStart[totalConstraintCount] = pos;
+    for (i = 0; i < statespace; i++) {
+        structMatrix[pos++] = i;
+    }
+    structRowStart[totalConstraints] = pos;
+    delete[] rowIndices;
+    delete[] rowCounts;
 }
 
 void Model::completeSbModel() {
+    if (getRelationCount() == 0) {
+        fprintf(stdout, "Error. completeSbModel(): Model contains no relations.\n");
+        fflush(stdout);
+        exit(1);
+    }
+    getRankBasis();
+}
+
+void Model::buildStructMatrix() {
     if (getRelationCount() == 0) {
         fprintf(stdout, "Error. completeSbModel(): Model contains no relations.\n");
         fflush(stdout);
@@ -224,65 +289,57 @@ void Model::completeSbModel() {
     if (structMatrix != NULL) return;
     VariableList *varList = getRelation(0)->getVariableList();
     int stateSpace = (int) ocDegreesOfFreedom(varList) + 1; // ought to be using something longer than int
-    int **stateSpaceArray = Model::makeStateSpaceArray(varList, stateSpace);
-    this->makeStructMatrix(stateSpace, varList, stateSpaceArray);
-    for (int i=0; i < stateSpace; i++) {
-        delete[] stateSpaceArray[i];
-    }
-    delete[] stateSpaceArray;
+    this->makeStructMatrix(stateSpace, varList);
 }
 
-int** Model::makeStateSpaceArray(VariableList *varList, int statespace) {
-    int **stateSpaceArray = new int *[statespace];
-    int varCount = varList->getVarCount();
-    for (int i = 0; i < statespace; i++) {
-        stateSpaceArray[i] = new int[varCount];
-    }
-
-    for (int i = 0; i < statespace; i++) {
-        for (int j = 0; j < varCount; j++) {
-            stateSpaceArray[i][j] = 0;
+RankBasis *Model::getRankBasis() {
+    if (rankBasis == NULL) {
+        buildStructMatrix();
+        rankBasis = new RankBasis();
+        for (int i = 0; i < totalConstraints; i++) {
+            rankBasis->addRow(structMatrix + structRowStart[i], structRowStart[i + 1] - structRowStart[i]);
         }
+        deleteStructMatrix();
     }
-    for (int k = 0; k < varCount; k++) {
-        stateSpaceArray[0][k] = 0;
+    return rankBasis;
+}
+
+bool Model::reduceRelationRows(Relation *rel, bool insert) {
+    RankBasis *basis = getRankBasis();
+    StateConstraint *sc = rel->getStateConstraints();
+    if (sc == NULL) {
+        printf("error happened in file : Model.cpp after getStateConstraints for rel: %s\n", rel->getPrintName());
+        exit(1);
     }
-    int l = varCount - 1;
-    int i = 0;
-    int loop1 = 0;
-    while (i < statespace - 1) {    // first copy from previous state
-        for (int j = 0; j < varCount; j++) {
-            stateSpaceArray[i + 1][j] = stateSpaceArray[i][j];
+    VariableList *varList = rel->getVariableList();
+    bool spanned = true;
+    long constraintCount = sc->getConstraintCount();
+    for (long j = 0; j < constraintCount; j++) {
+        int counter;
+        int *indices = getIndicesFromKey(sc->getConstraint(j), varList, &counter);
+        if (insert) {
+            if (basis->addRow(indices, counter))
+                spanned = false;
+        } else if (!basis->spans(indices, counter)) {
+            spanned = false;
         }
-        rap: if (i + 1 == statespace)
+        delete[] indices;
+        if (!spanned && !insert)
             break;
-        Variable *var = varList->getVariable(l);
-        int card = var->cardinality;
-        if (stateSpaceArray[i][l] == (card - 1)) {
-            stateSpaceArray[i + 1][l] = 0;
-            l--;
-            if (l < 0)
-                break;
-            goto rap;
-        } else {
-            stateSpaceArray[i + 1][l]++;
-            l = varCount - 1;
-        }
-        i++;
     }
-    return stateSpaceArray;
+    return spanned;
 }
 
-
-void Model::addRelation(Relation *newRelation, bool normalize, ModelCache *cache) {
+void Model::addRelation(Relation *newRelation, bool normalize) {
     if (newRelation == NULL)
         return;
     const int FACTOR = 2;
     int i, j;
+    bool removed = false;
     //-- if normalize, compare new relation to existing relations
     if (normalize && getRelationCount() > 0) {
         if (this->isStateBased() || newRelation->isStateBased()) {
-            if (this->containsRelation(newRelation, cache))
+            if (this->containsRelation(newRelation))
                 return;
         } else {
             for (i = 0; i < relationCount; i++) {
@@ -295,6 +352,7 @@ void Model::addRelation(Relation *newRelation, bool normalize, ModelCache *cache
                         relations[j] = relations[j + 1];
                     }
                     relationCount--;
+                    removed = true;
                     i--; // fix loop counter since we deleted one
                 }
             }
@@ -302,6 +360,7 @@ void Model::addRelation(Relation *newRelation, bool normalize, ModelCache *cache
     }
     while (relationCount >= maxRelationCount) {     //-- grow storage if needed
         relations = (Relation**) growStorage(relations, maxRelationCount*sizeof(Relation*), FACTOR);
+        MemoryAccount::add(MemoryCategory::Models, (FACTOR - 1) * maxRelationCount * sizeof(Relation*));
         maxRelationCount *= FACTOR;
     }
     for (i = 0; i < relationCount; i++) {       // now find the spot for this newRelation and add it in
@@ -313,6 +372,7 @@ void Model::addRelation(Relation *newRelation, bool normalize, ModelCache *cache
     }
     relations[i] = newRelation;
     relationCount++;
+    structHash = 0;
     if (printName) {
         delete printName;
         printName = NULL;
@@ -322,11 +382,16 @@ void Model::addRelation(Relation *newRelation, bool normalize, ModelCache *cache
         inverseName = NULL;
     }
     if (structMatrix) {
-        for (int i = 0; i < totalConstraints; i++) {
-            delete[] structMatrix[i];
+        deleteStructMatrix();
+    }
+    //-- the basis only ever grows; extend it with the new rows rather than refactoring
+    if (rankBasis) {
+        if (removed) {
+            delete rankBasis;
+            rankBasis = NULL;
+        } else {
+            reduceRelationRows(newRelation, true);
         }
-        delete[] structMatrix;
-        structMatrix = NULL;
     }
     if (fitTable) {
         delete fitTable;
@@ -349,55 +414,15 @@ Relation *Model::getRelation(int index) {
 }
 
 // Returns true if this model contains the specified relation; false otherwise.
-bool Model::containsRelation(Relation *relation, ModelCache *cache) {
+bool Model::containsRelation(Relation *relation) {
     if (this->isStateBased() || relation->isStateBased()) {
         for (int i = 0; i < relationCount; i++) {
             if (relations[i] == relation)
                 return true;
         }
-        Model *new_model = new Model(this->getRelationCount() + 1);
-        new_model->copyRelations(*this);
-        new_model->addRelation(relation,false);
-        Model *temp_old = NULL;
-        Model *temp_new = NULL;
-        double new_df;
-        if (cache) {
-            temp_new = cache->findModel(new_model->getPrintName());
-        }
-        if (temp_new) {
-            new_df = temp_new->getAttribute(ATTRIBUTE_DF);
-            if (new_df < 0.0) {
-                temp_new->completeSbModel();
-                new_df = ::ocDegreesOfFreedomStateBased(temp_new);
-                temp_new->setAttribute(ATTRIBUTE_DF, new_df);
-            }
-        } else {
-            new_model->completeSbModel();
-            new_df = ::ocDegreesOfFreedomStateBased(new_model);
-        }
-        double df = this->getAttribute(ATTRIBUTE_DF);
-        if (df < 0.0) { //-- not set yet
-            if (cache) {
-                temp_old = cache->findModel(this->getPrintName());
-            }
-            if (temp_old) {
-                df = temp_old->getAttribute(ATTRIBUTE_DF);
-                if (df < 0.0) {
-                    temp_old->completeSbModel();
-                    df = ::ocDegreesOfFreedomStateBased(temp_old);
-                    temp_old->setAttribute(ATTRIBUTE_DF, df);
-                }
-            } else {
-                this->completeSbModel();
-                df = ::ocDegreesOfFreedomStateBased(this);
-                this->setAttribute(ATTRIBUTE_DF, df);
-            }
-        }
-        delete new_model;
-        if (fabs(df - new_df) < DBL_EPSILON) {
-            return true;
-        }
-        return false;
+        // the relation adds nothing (the DF is unchanged) exactly when
+        // all of its constraint rows are in the span of this model's
+        return reduceRelationRows(relation, false);
     } else {
         for (int i = 0; i < relationCount; i++) {
             if (relations[i]->contains(relation))
@@ -417,21 +442,61 @@ bool Model::containsModel(Model *other) {
 }
 
 bool Model::isEquivalentTo(Model *other) {
+    if ((this == other) || hasSameStructure(other)) {
+        return true;
+    }
     if (this->isStateBased() || other->isStateBased()) {
         // might be good to check if DFs are equal first, as a faster check
-        if ((this == other) || strcmp(this->getPrintName(),other->getPrintName()) == 0) {
-            return true;
-        }
         if (this->containsModel(other) && other->containsModel(this)) {
             return true;
         }
+    }
+    return false;
+}
+
+//-- the relation hashes are mixed and summed, so the order of the relations does not matter
+unsigned long long Model::structureHash(Relation **rels, int count) {
+    unsigned long long key = count;
+    for (int i = 0; i < count; i++) {
+        unsigned long long h = rels[i]->getStructureHash();
+        h ^= h >> 31;
+        h *= 0x9e3779b97f4a7c15ULL;
+        key += h ^ (h >> 29);
+    }
+    return key ? key : 1; // zero marks a hash not yet computed
+}
+
+unsigned long long Model::getStructureHash() {
+    if (structHash == 0)
+        structHash = structureHash(relations, relationCount);
+    return structHash;
+}
+
+bool Model::hasSameStructure(Model *other) {
+    return hasRelations(other->relations, other->relationCount, other->getStructureHash());
+}
+
+//-- relations come from the relation cache, so most match by pointer; the hash
+//-- rules out nearly all non-matching models before the relations are compared
+bool Model::hasRelations(Relation **rels, int count, unsigned long long hash) {
+    if (relationCount != count || getStructureHash() != hash)
         return false;
-    } else {
-        if (this == other) {
-            return true;
+    for (int i = 0; i < count; i++) {
+        Relation *rel = rels[i];
+        int j;
+        for (j = 0; j < relationCount; j++) {
+            Relation *myRel = relations[j];
+            if (myRel == rel)
+                break;
+            if (myRel->getStructureHash() == rel->getStructureHash()
+                    && myRel->hasStructure(rel->getMask(), rel->getKeySize(), rel->getStateIndices(),
+                            rel->getVariableCount()))
+                break;
         }
+        if (j == relationCount)
+            return false;
     }
-    return false;
+    return true;
 }
 
 int Model::getRelationCount() {
@@ -444,6 +509,7 @@ Table *Model::getFitTable() {
 
 void Model::setFitTable(Table *tbl) {
     fitTable = tbl;
+    fitTableUsed = MemoryAccount::nextUse();
 }
 
 void Model::deleteFitTable() {
@@ -521,23 +587,31 @@ const char * Model::getPrintName(int useInverse) {
 void Model::printStructMatrix() {
     int statespace;
     int Total_const;
-    int **str_matrix = getStructMatrix(&statespace, &Total_const);
+    long *rowStart;
+    int *str_matrix = getStructMatrix(&statespace, &Total_const, &rowStart);
     if (str_matrix != NULL) {
         for (int i = 0; i < Total_const; i++) {
+            long k = rowStart[i];
             for (int j = 0; j < statespace; j++) {
-                printf("%d,", str_matrix[i][j]);
+                int value = 0;
+                if (k < rowStart[i + 1] && str_matrix[k] == j) {
+                    value = 1;
+                    k++;
+                }
+                printf("%d,", value);
             }
             printf("\n");
         }
     }
 }
 
-int **Model::getStructMatrix(int *statespace, int *totalConst) {
+int *Model::getStructMatrix(int *statespace, int *totalConst, long **rowStart) {
     if (structMatrix == NULL) {
-        this->completeSbModel();
+        this->buildStructMatrix();
     }
     *statespace = stateSpaceSize;
     *totalConst = totalConstraints;
+    *rowStart = structRowStart;
     return structMatrix;
 }
 
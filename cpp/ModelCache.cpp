@@ -13,56 +13,104 @@
 #include <memory.h>
 #include <string.h>
 
-static int hashcode(const char *name, int hashsize) {
-    unsigned int key = 0;
-    for (const char *cp = name; *cp; cp++)
-        key = (key << 1) + *cp;
-    return key % hashsize;
+//-- the low bits of the structure hash pick the shard, the rest the chain within it
+static inline long chainIndex(unsigned long long key, long hashSize) {
+    return (key / MODELCACHE_SHARDS) % hashSize;
 }
 
 ModelCache::ModelCache() {
-    hash = new Model*[MODELCACHE_HASHSIZE];
-    memset(hash, 0, MODELCACHE_HASHSIZE * sizeof(Model*));
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        shards[s].hashSize = MODELCACHE_SHARDSIZE;
+        shards[s].hash = new Model*[MODELCACHE_SHARDSIZE];
+        memset(shards[s].hash, 0, MODELCACHE_SHARDSIZE * sizeof(Model*));
+        shards[s].count = 0;
+    }
 }
 
 //-- destroy Model cache.  This also deletes all the Models held in the cache.
 ModelCache::~ModelCache() {
     Model *r1, *r2;
-    int i;
-    for (i = 0; i < MODELCACHE_HASHSIZE; i++) {
-        r1 = hash[i];
-        while (r1) {
-            r2 = r1->getHashNext();
-            delete r1;
-            r1 = r2;
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                r2 = r1->getHashNext();
+                delete r1;
+                r1 = r2;
+            }
         }
+        delete[] shards[s].hash;
     }
-    delete hash;
 }
 
 long ModelCache::size() {
-    long size = MODELCACHE_HASHSIZE * sizeof(Model*);
+    long size = 0;
     Model *r1;
-    int i;
-    for (i = 0; i < MODELCACHE_HASHSIZE; i++) {
-        r1 = hash[i];
-        while (r1) {
-            size += r1->size();
-            r1 = r1->getHashNext();
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        size += shards[s].hashSize * sizeof(Model*);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                size += r1->size();
+                r1 = r1->getHashNext();
+            }
         }
     }
     return size;
 }
 
+//-- delete fit tables from all models
+void ModelCache::deleteFitTables() {
+    Model *r1;
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                r1->deleteFitTable();
+                r1 = r1->getHashNext();
+            }
+        }
+    }
+}
+
+void ModelCache::collectFitTables(std::vector<Model*> &models) {
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            for (Model *r1 = shards[s].hash[i]; r1; r1 = r1->getHashNext()) {
+                if (r1->getFitTable())
+                    models.push_back(r1);
+            }
+        }
+    }
+}
+
 //-- addModel - put a new Model in the cache. If a matching Model already
 //-- exists, an error is returned.
 bool ModelCache::addModel(class Model *model) {
-    if (findModel(model->getPrintName()) != NULL)
-        return false; //error; exists
-    int hashindex = hashcode(model->getPrintName(), MODELCACHE_HASHSIZE);
-    model->setHashNext(hash[hashindex]);
-    hash[hashindex] = model;
-    return true;
+    return findOrAddModel(model) == model;
+}
+
+//-- findOrAddModel - the lookup and the insertion are done under one lock, so two
+//-- threads making the same model both get the same (first) one back. The lazily
+//-- built name is filled in before the model is shared.
+class Model *ModelCache::findOrAddModel(class Model *model) {
+    model->getPrintName();
+    unsigned long long key = model->getStructureHash();
+    Shard &shard = shards[key % MODELCACHE_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Model *found = findInChain(shard, model);
+    if (found)
+        return found;
+    if (shard.count >= 2 * shard.hashSize)
+        grow(shard);
+    long hashindex = chainIndex(key, shard.hashSize);
+    model->setHashNext(shard.hash[hashindex]);
+    shard.hash[hashindex] = model;
+    shard.count++;
+    return model;
 }
 
 //-- deleteModel - deletes a model from the cache.
@@ -70,19 +118,24 @@ bool ModelCache::addModel(class Model *model) {
 bool ModelCache::deleteModel(class Model *model) {
     if (model == NULL)
         return false;
-    int hashindex = hashcode(model->getPrintName(), MODELCACHE_HASHSIZE);
-    Model *rp = hash[hashindex];
+    unsigned long long key = model->getStructureHash();
+    Shard &shard = shards[key % MODELCACHE_SHARDS];
+    std::unique_lock<std::mutex> guard(shard.lock);
+    long hashindex = chainIndex(key, shard.hashSize);
+    Model *rp = shard.hash[hashindex];
     Model *prev = NULL;
     while (rp && (rp != model)) {
         prev = rp;
         rp = rp->getHashNext();
     }
     if (rp != NULL) {
-        if (rp == hash[hashindex]) {
-            hash[hashindex] = rp->getHashNext();
+        if (rp == shard.hash[hashindex]) {
+            shard.hash[hashindex] = rp->getHashNext();
         } else {
             prev->setHashNext(rp->getHashNext());
         }
+        shard.count--;
+        guard.unlock();
         //		printf("deleting: %s\n", model->getPrintName());
         delete rp;
         return true;
@@ -91,26 +144,61 @@ bool ModelCache::deleteModel(class Model *model) {
     }
 }
 
-//-- findModel - find a Model in the cache.  Null is returned if the given
-//-- Model doesn't exist.
-class Model *ModelCache::findModel(const char *name) {
-    int hashindex = hashcode(name, MODELCACHE_HASHSIZE);
-    Model *rp = hash[hashindex];
-    while (rp && strcmp(name, rp->getPrintName()) != 0)
+class Model *ModelCache::findModel(class Model *model) {
+    Shard &shard = shards[model->getStructureHash() % MODELCACHE_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return findInChain(shard, model);
+}
+
+class Model *ModelCache::findModel(class Relation **rels, int count) {
+    unsigned long long key = Model::structureHash(rels, count);
+    Shard &shard = shards[key % MODELCACHE_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Model *rp = shard.hash[chainIndex(key, shard.hashSize)];
+    while (rp && !rp->hasRelations(rels, count, key))
+        rp = rp->getHashNext();
+    return rp;
+}
+
+//-- search one hash chain; the caller holds the shard's lock
+class Model *ModelCache::findInChain(Shard &shard, class Model *model) {
+    Model *rp = shard.hash[chainIndex(model->getStructureHash(), shard.hashSize)];
+    while (rp && rp != model && !rp->hasSameStructure(model))
         rp = rp->getHashNext();
     return rp; // either NULL, or the matching one
 }
 
+//-- double the number of chains in a shard; the caller holds the shard's lock
+void ModelCache::grow(Shard &shard) {
+    long newSize = shard.hashSize * 2;
+    Model **newHash = new Model*[newSize];
+    memset(newHash, 0, newSize * sizeof(Model*));
+    for (long i = 0; i < shard.hashSize; i++) {
+        Model *rp = shard.hash[i];
+        while (rp) {
+            Model *next = rp->getHashNext();
+            long hashindex = chainIndex(rp->getStructureHash(), newSize);
+            rp->setHashNext(newHash[hashindex]);
+            newHash[hashindex] = rp;
+            rp = next;
+        }
+    }
+    delete[] shard.hash;
+    shard.hash = newHash;
+    shard.hashSize = newSize;
+}
+
 //-- dump - print out all Models in the cache
 void ModelCache::dump() {
     printf("\nDump ModelCache:\n");
-    for (int i = 0; i < MODELCACHE_HASHSIZE; i++) {
-        if (hash[i]) {
-            printf("hash chain [%d]:\n", i);
-            for (Model *model = hash[i]; model; model = model->getHashNext()) {
-                model->dump();
+    for (int s = 0; s < MODELCACHE_SHARDS; s++) {
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            if (shards[s].hash[i]) {
+                printf("hash chain [%d:%ld]:\n", s, i);
+                for (Model *model = shards[s].hash[i]; model; model = model->getHashNext()) {
+                    model->dump();
+                }
             }
         }
     }
 }
-
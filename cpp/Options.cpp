@@ -129,6 +129,27 @@ static void setStandardOptions(Options *opts) {
     opts->addOptionValue(def, "lr", "Chi-squared likelihood ratio");
     def = opts->addOptionName("optimize-search-width", "w", "Max models to keep at each level");
     opts->addOptionValue(def, "#", "");
+    def = opts->addOptionName("search-threads", "", "Threads used to generate and evaluate models during search, default=all cores");
+    opts->addOptionValue(def, "#", "");
+    def = opts->addOptionName("memory-limit", "", "Megabytes of tables to hold during search before cached tables are evicted");
+    opts->addOptionValue(def, "#", "");
+    def = opts->addOptionName("search-prune", "", "Skip evaluating models whose bound shows they can't be kept");
+    def = opts->addOptionName("search-beams", "", "Search several beams at once, one per attribute[:direction] listed");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("report-stream", "", "File to write each level's kept models to as the search goes");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("report-stream-format", "", "Format of the report stream, default from the file name");
+    opts->addOptionValue(def, "csv", "comma-separated values");
+    opts->addOptionValue(def, "tsv", "tab-separated values");
+    opts->addOptionValue(def, "ndjson", "one JSON object per line");
+    def = opts->addOptionName("report-columns", "", "File to write the report's models to, as binary columns");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("fit-columns", "", "File to write the fit table to, as binary columns");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("search-checkpoint", "", "File to save the search state in after each level");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("search-resume", "", "Checkpoint file to resume a search from");
+    opts->addOptionValue(def, "$", "");
     def = opts->addOptionName("reference-model", "f",
             "Specify reference model (default undirected=top, directed=bottom)");
     opts->addOptionValue(def, "top", "reference is saturated model");
@@ -141,6 +162,8 @@ static void setStandardOptions(Options *opts) {
     opts->addOptionValue(def, "#", "");
     def = opts->addOptionName("ipf-maxdev", "i", "Max error in IPF, default=0.25");
     opts->addOptionValue(def, "#", "");
+    def = opts->addOptionName("ipf-maxstored", "", "Largest starting expansion (in cells) IPF stores rather than streams, default=1000000");
+    opts->addOptionValue(def, "#", "");
     def = opts->addOptionName("no-frequency", "", "There is no frequency data in table");
     def = opts->addOptionName("function-values", "", "Values represent function data, not frequencies.");
     opts->addOptionValue(def, "$", "");
@@ -177,6 +200,9 @@ static void setStandardOptions(Options *opts) {
     def = opts->addOptionName("no-parse", "", "Assume the input is pure data");
     def = opts->addOptionName("verbose", "v", "Print variable and interaction lists");
     def = opts->addOptionName("re-bin", "B", "Re-binning of data required");
+    def = opts->addOptionName("stats-cache", "C", "Directory for relation statistics kept between runs");
+    opts->addOptionValue(def, "$", "");
+    def = opts->addOptionName("stats-cache-tables", "", "Also keep relation projections in the statistics cache");
 
     //-- default option (if no command line switch) - can also be used explicitly
     def = opts->defaultOptDef = opts->addOptionName("datafile", "", "Specify data file");
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "RankBasis.h"
+#include <stddef.h>
+
+/**
+ * RankBasis.cpp - sparse Gaussian elimination with exact modular arithmetic.
+ * Rows are merged in column order, so the cost of a reduction step is the length
+ * of the two rows rather than the width of the state space.
+ */
+
+static const unsigned long long RANK_PRIME = (1ULL << 61) - 1;
+
+static unsigned long long mulMod(unsigned long long a, unsigned long long b) {
+    unsigned __int128 x = (unsigned __int128) a * b;
+    unsigned long long r = (unsigned long long) (x & RANK_PRIME) + (unsigned long long) (x >> 61);
+    return r >= RANK_PRIME ? r - RANK_PRIME : r;
+}
+
+static unsigned long long inverseMod(unsigned long long a) {
+    unsigned long long result = 1, e = RANK_PRIME - 2;
+    while (e) {
+        if (e & 1)
+            result = mulMod(result, a);
+        a = mulMod(a, a);
+        e >>= 1;
+    }
+    return result;
+}
+
+RankBasis::RankBasis() {
+}
+
+RankBasis::RankBasis(const RankBasis &other) :
+        rows(other.rows), pivotOf(other.pivotOf) {
+}
+
+long RankBasis::size() {
+    long size = sizeof(RankBasis) + rows.capacity() * sizeof(Row);
+    for (size_t i = 0; i < rows.size(); i++) {
+        size += rows[i].cols.capacity() * sizeof(int);
+        size += rows[i].vals.capacity() * sizeof(unsigned long long);
+    }
+    size += pivotOf.size() * 2 * sizeof(int) + pivotOf.bucket_count() * sizeof(void*);
+    return size;
+}
+
+//-- row -= factor * pivot, dropping any entries which cancel
+void RankBasis::eliminate(Row &row, const Row &pivot, unsigned long long factor, Row &scratch) {
+    scratch.cols.clear();
+    scratch.vals.clear();
+    unsigned long long negFactor = RANK_PRIME - factor;
+    size_t i = 0, j = 0;
+    size_t rn = row.cols.size(), pn = pivot.cols.size();
+    while (i < rn || j < pn) {
+        if (j >= pn || (i < rn && row.cols[i] < pivot.cols[j])) {
+            scratch.cols.push_back(row.cols[i]);
+            scratch.vals.push_back(row.vals[i]);
+            i++;
+        } else if (i >= rn || pivot.cols[j] < row.cols[i]) {
+            scratch.cols.push_back(pivot.cols[j]);
+            scratch.vals.push_back(mulMod(pivot.vals[j], negFactor));
+            j++;
+        } else {
+            unsigned long long v = row.vals[i] + mulMod(pivot.vals[j], negFactor);
+            if (v >= RANK_PRIME)
+                v -= RANK_PRIME;
+            if (v != 0) {
+                scratch.cols.push_back(row.cols[i]);
+                scratch.vals.push_back(v);
+            }
+            i++;
+            j++;
+        }
+    }
+    row.cols.swap(scratch.cols);
+    row.vals.swap(scratch.vals);
+}
+
+void RankBasis::reduce(Row &row, Row &scratch) {
+    while (!row.cols.empty()) {
+        std::unordered_map<int, int>::const_iterator p = pivotOf.find(row.cols[0]);
+        if (p == pivotOf.end())
+            return;
+        eliminate(row, rows[p->second], row.vals[0], scratch);
+    }
+}
+
+//-- the rows being reduced are local, so lookups on a shared basis don't collide
+bool RankBasis::spans(const int *cols, int count) {
+    Row work, scratch;
+    work.cols.assign(cols, cols + count);
+    work.vals.assign(count, 1);
+    reduce(work, scratch);
+    return work.cols.empty();
+}
+
+bool RankBasis::addRow(const int *cols, int count) {
+    Row work, scratch;
+    work.cols.assign(cols, cols + count);
+    work.vals.assign(count, 1);
+    reduce(work, scratch);
+    if (work.cols.empty())
+        return false;
+    unsigned long long inv = inverseMod(work.vals[0]);
+    for (size_t k = 0; k < work.vals.size(); k++) {
+        work.vals[k] = mulMod(work.vals[k], inv);
+    }
+    pivotOf[work.cols[0]] = rows.size();
+    rows.push_back(Row());
+    rows.back().cols.swap(work.cols);
+    rows.back().vals.swap(work.vals);
+    return true;
+}
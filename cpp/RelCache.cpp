@@ -14,93 +14,157 @@
 #include <memory.h>
 #include <string.h>
 
-static int hashcode(const char *name, int hashsize) {
-    unsigned int key = 0;
-    for (const char *cp = name; *cp; cp++)
-        key = (key << 1) + *cp;
-    return key % hashsize;
+//-- the low bits pick the shard, the rest the chain within it
+static inline long chainIndex(unsigned long long key, long hashSize) {
+    return (key / RELCACHE_SHARDS) % hashSize;
 }
 
 RelCache::RelCache() {
-    hash = new Relation*[RELCACHE_HASHSIZE];
-    memset(hash, 0, RELCACHE_HASHSIZE * sizeof(Relation*));
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        shards[s].hashSize = RELCACHE_SHARDSIZE;
+        shards[s].hash = new Relation*[RELCACHE_SHARDSIZE];
+        memset(shards[s].hash, 0, RELCACHE_SHARDSIZE * sizeof(Relation*));
+        shards[s].count = 0;
+    }
 }
 
 //-- destroy relation cache.  This also deletes all the relations held in the cache.
 RelCache::~RelCache() {
     Relation *r1, *r2;
-    int i;
-    for (i = 0; i < RELCACHE_HASHSIZE; i++) {
-        r1 = hash[i];
-        while (r1) {
-            r2 = r1->getHashNext();
-            delete r1;
-            r1 = r2;
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                r2 = r1->getHashNext();
+                delete r1;
+                r1 = r2;
+            }
         }
+        delete[] shards[s].hash;
     }
-    delete hash;
 }
 
 long RelCache::size() {
-    long size = RELCACHE_HASHSIZE * sizeof(Relation*);
+    long size = 0;
     Relation *r1;
-    int i;
-    for (i = 0; i < RELCACHE_HASHSIZE; i++) {
-        r1 = hash[i];
-        while (r1) {
-            size += r1->size();
-            r1 = r1->getHashNext();
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        size += shards[s].hashSize * sizeof(Relation*);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                size += r1->size();
+                r1 = r1->getHashNext();
+            }
         }
     }
     return size;
 }
 
 //-- delete tables from all relations
-void RelCache::deleteTables() {
+void RelCache::deleteTables(Table *keep) {
     Relation *r1;
-    int i;
-    for (i = 0; i < RELCACHE_HASHSIZE; i++) {
-        r1 = hash[i];
-        while (r1) {
-            r1->deleteTable();
-            r1 = r1->getHashNext();
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            r1 = shards[s].hash[i];
+            while (r1) {
+                if (r1->getTable() != keep)
+                    r1->deleteTable();
+                r1 = r1->getHashNext();
+            }
+        }
+    }
+}
+
+void RelCache::collectTables(std::vector<Relation*> &rels, Table *keep) {
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        std::lock_guard<std::mutex> guard(shards[s].lock);
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            for (Relation *r1 = shards[s].hash[i]; r1; r1 = r1->getHashNext()) {
+                if (r1->getTable() && r1->getTable() != keep)
+                    rels.push_back(r1);
+            }
         }
     }
 }
 
 //-- addRelation - put a new relation in the cache. If a matching relation already
 //-- exists, an error is returned.
-// [JSF] This doesn't seem to check for matches, or return errors.
 bool RelCache::addRelation(class Relation *rel) {
-    if (findRelation(rel->getPrintName()) != NULL)
-        return false; //error; exists
-    KeySegment *mask = rel->getMask();
-    int hashindex = hashcode(rel->getPrintName(), RELCACHE_HASHSIZE);
-    rel->setHashNext(hash[hashindex]);
-    hash[hashindex] = rel;
-    return true;
+    return findOrAddRelation(rel) == rel;
 }
 
-//-- findRelation - find a relation in the cache.  Null is returned if the given
-//-- relation doesn't exist.
-class Relation *RelCache::findRelation(const char *name) {
-    int hashindex = hashcode(name, RELCACHE_HASHSIZE);
-    Relation *rp = hash[hashindex];
-    while (rp && strcmp(name, rp->getPrintName()) != 0)
-        rp = rp->getHashNext();
-    return rp; // either NULL, or the matching one
+//-- findOrAddRelation - the lookup and the insertion are done under one lock, so two
+//-- threads making the same relation both get the same (first) one back. The lazily
+//-- built parts of the relation are filled in before it is shared.
+class Relation *RelCache::findOrAddRelation(class Relation *rel) {
+    rel->getPrintName();
+    rel->isIndependentOnly();
+    unsigned long long key = rel->getStructureHash();
+    Shard &shard = shards[key % RELCACHE_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Relation *found = findInChain(shard, key, rel->getMask(), rel->getKeySize(), rel->getStateIndices(),
+            rel->getVariableCount());
+    if (found)
+        return found;
+    if (shard.count >= 2 * shard.hashSize)
+        grow(shard);
+    long hashindex = chainIndex(key, shard.hashSize);
+    rel->setHashNext(shard.hash[hashindex]);
+    shard.hash[hashindex] = rel;
+    shard.count++;
+    return rel;
+}
+
+class Relation *RelCache::findRelation(const KeySegment *mask, int keysize, const int *states, int varcount) {
+    unsigned long long key = Relation::structureHash(mask, keysize, states, varcount);
+    Shard &shard = shards[key % RELCACHE_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return findInChain(shard, key, mask, keysize, states, varcount);
+}
+
+//-- search one hash chain; the caller holds the shard's lock
+class Relation *RelCache::findInChain(Shard &shard, unsigned long long key, const KeySegment *mask, int keysize,
+        const int *states, int varcount) {
+    for (Relation *rp = shard.hash[chainIndex(key, shard.hashSize)]; rp; rp = rp->getHashNext()) {
+        if (rp->getStructureHash() == key && rp->hasStructure(mask, keysize, states, varcount))
+            return rp;
+    }
+    return NULL;
+}
+
+//-- double the number of chains in a shard; the caller holds the shard's lock
+void RelCache::grow(Shard &shard) {
+    long newSize = shard.hashSize * 2;
+    Relation **newHash = new Relation*[newSize];
+    memset(newHash, 0, newSize * sizeof(Relation*));
+    for (long i = 0; i < shard.hashSize; i++) {
+        Relation *rp = shard.hash[i];
+        while (rp) {
+            Relation *next = rp->getHashNext();
+            long hashindex = chainIndex(rp->getStructureHash(), newSize);
+            rp->setHashNext(newHash[hashindex]);
+            newHash[hashindex] = rp;
+            rp = next;
+        }
+    }
+    delete[] shard.hash;
+    shard.hash = newHash;
+    shard.hashSize = newSize;
 }
 
 //-- dump - print out all relations in the cache
 void RelCache::dump() {
     printf("\nDumping RelCache:\n");
-    for (int i = 0; i < RELCACHE_HASHSIZE; i++) {
-        if (hash[i]) {
-            printf("hash chain [%d]:\n", i);
-            for (Relation *rel = hash[i]; rel; rel = rel->getHashNext()) {
-                rel->dump();
+    for (int s = 0; s < RELCACHE_SHARDS; s++) {
+        for (long i = 0; i < shards[s].hashSize; i++) {
+            if (shards[s].hash[i]) {
+                printf("hash chain [%d:%ld]:\n", s, i);
+                for (Relation *rel = shards[s].hash[i]; rel; rel = rel->getHashNext()) {
+                    rel->dump();
+                }
             }
         }
     }
 }
-
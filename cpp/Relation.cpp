@@ -7,6 +7,7 @@
 
 #include "AttributeList.h"
 #include "Key.h"
+#include "MemoryAccount.h"
 #include "Relation.h"
 #include "StateConstraint.h"
 #include "_Core.h"
@@ -22,6 +23,9 @@ Relation::Relation(VariableList *list, int size, int keysz, long stateconstsz) {
     varCount = 0;
     vars = new int[size];
     table = NULL;
+    lastUsed = 0;
+    indexColumn = NULL;
+    indexSource = NULL;
     stateConstraints = NULL;
     states = NULL;
     if (stateconstsz >= 0) {
@@ -35,6 +39,10 @@ Relation::Relation(VariableList *list, int size, int keysz, long stateconstsz) {
     printName = NULL;
     inverseName = NULL;
     indepOnly = -1;
+    structHash = 0;
+    indexBytes = 0;
+    accounted = sizeof(Relation) + (states ? 2 : 1) * size * sizeof(int);
+    MemoryAccount::add(MemoryCategory::Relations, accounted);
 }
 
 Relation::~Relation() {
@@ -52,8 +60,10 @@ Relation::~Relation() {
         delete stateConstraints;
     if (table)
         delete table;
+    delete[] indexColumn;
     if (mask)
         delete[] mask;
+    MemoryAccount::release(MemoryCategory::Relations, accounted + indexBytes);
 }
 
 long Relation::size() {
@@ -234,6 +244,18 @@ void Relation::deleteTable() {
         delete table;
         table = NULL;
     }
+    setIndexColumn(NULL, NULL);
+}
+
+// sets the index column, replacing any previous one
+void Relation::setIndexColumn(long long *column, Table *source) {
+    if (indexColumn != column)
+        delete[] indexColumn;
+    indexColumn = column;
+    indexSource = source;
+    long long bytes = (column && source) ? source->getTupleCount() * sizeof(long long) : 0;
+    MemoryAccount::add(MemoryCategory::Relations, bytes - indexBytes);
+    indexBytes = bytes;
 }
 
 // sets/gets the state constraints for the relation
@@ -316,15 +338,45 @@ KeySegment *Relation::getMask() {
     return mask;
 }
 
-static int sortCompare(const void *k1, const void *k2) {
-    return *((int*) k1) - *((int*) k2);
+//-- a missing state list is the same as one of all DONT_CARE states
+static inline int stateAt(const int *states, int i) {
+    return states ? states[i] : DONT_CARE;
+}
+
+//-- FNV-1a over the mask words and states, with a final mix so the low bits
+//-- (which pick a hash chain) depend on all of them
+unsigned long long Relation::structureHash(const KeySegment *mask, int keysize, const int *states, int varcount) {
+    unsigned long long key = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < keysize; i++)
+        key = (key ^ mask[i]) * 0x100000001b3ULL;
+    for (int i = 0; i < varcount; i++)
+        key = (key ^ (unsigned int) stateAt(states, i)) * 0x100000001b3ULL;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key ? key : 1; // zero marks a hash not yet computed
+}
+
+unsigned long long Relation::getStructureHash() {
+    if (structHash == 0)
+        structHash = structureHash(getMask(), getKeySize(), states, varCount);
+    return structHash;
+}
+
+bool Relation::hasStructure(const KeySegment *msk, int keysize, const int *stateList, int count) {
+    if (count != varCount)
+        return false;
+    if (memcmp(getMask(), msk, keysize * sizeof(KeySegment)) != 0)
+        return false;
+    for (int i = 0; i < varCount; i++) {
+        if (stateAt(states, i) != stateAt(stateList, i))
+            return false;
+    }
+    return true;
 }
 
-static int *sorting_vars;
-//static int sbSortCompare(void *thunk, const void *k1, const void *k2) {
-static int sbSortCompare(const void *k1, const void *k2) {
-    //int* vars = (int *) thunk;
-    return sorting_vars[*((int *) k1)] - sorting_vars[*((int *) k2)];
+static int sortCompare(const void *k1, const void *k2) {
+    return *((int*) k1) - *((int*) k2);
 }
 
 void Relation::sort(int *vars, int varCount, int *states) {
@@ -333,26 +385,19 @@ void Relation::sort(int *vars, int varCount, int *states) {
         qsort(vars, varCount, sizeof(int), sortCompare);
     } else {
         // when there are states, we must arrange both lists in unison, by the vars values.
-        // we do this by sorting an index list based on the vars values, and then arranging
-        // both vars & states using the index list afterwards.
-        int* order = new int[varCount];
-        for (int i = 0; i < varCount; i++)
-            order[i] = i;
-        // order of args must be changed for qsort_r, and its compare function, from BSD to GNU.
-        // last 2 args of qsort_r must be switched, and the thunk moved to the end of compare.
-        sorting_vars = vars;
-        qsort(order, varCount, sizeof(int), sbSortCompare);
-        int *vars_copy = new int[varCount];
-        int *states_copy = new int[varCount];
-        memcpy(vars_copy, vars, varCount * sizeof(int));
-        memcpy(states_copy, states, varCount * sizeof(int));
-        for (int i = 0; i < varCount; i++) {
-            vars[i] = vars_copy[order[i]];
-            states[i] = states_copy[order[i]];
+        // relations are short, so an insertion sort does this in place, without the
+        // index list (and shared compare state) that qsort would need.
+        for (int i = 1; i < varCount; i++) {
+            int var = vars[i];
+            int state = states[i];
+            int j = i;
+            for (; j > 0 && vars[j - 1] > var; j--) {
+                vars[j] = vars[j - 1];
+                states[j] = states[j - 1];
+            }
+            vars[j] = var;
+            states[j] = state;
         }
-        delete[] states_copy;
-        delete[] vars_copy;
-        delete[] order;
     }
 }
 
@@ -369,6 +414,14 @@ double Relation::getAttribute(const char *name) {
     return attributeList->getAttribute(name);
 }
 
+void Relation::setAttributeById(int id, double value) {
+    attributeList->setAttributeById(id, value);
+}
+
+double Relation::getAttributeById(int id) {
+    return attributeList->getAttributeById(id);
+}
+
 const char* Relation::getPrintName(int useInverse) {
     if (useInverse == 0 || states != NULL) {
         if (printName == NULL) {
@@ -461,6 +514,8 @@ double Relation::getMatchingTupleValue(KeySegment *key) {
 void Relation::buildMask() {
     int keysize = varList->getKeySize();
     mask = new KeySegment[keysize];
+    accounted += keysize * sizeof(KeySegment);
+    MemoryAccount::add(MemoryCategory::Relations, keysize * sizeof(KeySegment));
     Key::buildMask(mask, keysize, varList, vars, varCount);
 }
 
@@ -7,6 +7,8 @@
 
 #include <math.h>
 #include "attrDescs.h"
+#include "AttributeList.h"
+#include "ColumnFile.h"
 #include "_Core.h"
 #include "Report.h"
 #include "ManagerBase.h"
@@ -14,6 +16,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <unordered_map>
+#include <vector>
 
 /* Global and static variables...
  * collected towards the top in an attempt to increase my understanding */
@@ -89,9 +93,12 @@ void Report::setAttributes(const char *attrlist) {
 
 void Report::sort(const char *attr, Direction dir) {
     extern const char *sortAttr;
+    extern int sortAttrId, sortLevelId;
     extern Direction sortDir;
     extern Direction searchDir;
     sortAttr = attr;
+    sortAttrId = AttributeList::findAttributeId(attr);
+    sortLevelId = AttributeList::findAttributeId("Level");
     sortDir = dir;
     searchDir = manager->getSearchDirection();
     qsort(models, modelCount, sizeof(Model*), sortCompare);
@@ -99,8 +106,11 @@ void Report::sort(const char *attr, Direction dir) {
 
 void Report::sort(class Model** models, long modelCount, const char *attr, Direction dir) {
     extern const char *sortAttr;
+    extern int sortAttrId, sortLevelId;
     extern Direction sortDir;
     sortAttr = attr;
+    sortAttrId = AttributeList::findAttributeId(attr);
+    sortLevelId = AttributeList::findAttributeId("Level");
     sortDir = dir;
     qsort(models, modelCount, sizeof(Model*), sortCompare);
 }
@@ -126,8 +136,10 @@ void Report::print(FILE *fd) {
             maxNameLength = strlen(models[m]->getPrintName());
     }
 
-    // Create a mapping for IDs so they are listed in order.
-    int idOrder[modelCount + 1];
+    // Create a mapping for IDs so they are listed in order. The IDs needn't run
+    // from 1 to modelCount (a report may hold some of the models of a search),
+    // so only those present are mapped; any other progenitor maps to 0.
+    std::unordered_map<int, int> idOrder;
     idOrder[0] = 0;
     if (manager->getSearchDirection() == Direction::Descending) {
         for (int m = 0; m < modelCount; m++) {
@@ -143,8 +155,8 @@ void Report::print(FILE *fd) {
     // If progenitors are being tracked, map the progenitor values too.
     if (models[0]->getProgenitor() != NULL) {
         for (int m = 0; m < modelCount; m++) {
-            models[m]->setAttribute(ATTRIBUTE_PROG_ID,
-                    (double) idOrder[(int) models[m]->getAttribute(ATTRIBUTE_PROG_ID)]);
+            auto id = idOrder.find((int) models[m]->getAttribute(ATTRIBUTE_PROG_ID));
+            models[m]->setAttribute(ATTRIBUTE_PROG_ID, (double) (id == idOrder.end() ? 0 : id->second));
         }
     }
 
@@ -437,6 +449,56 @@ void Report::print(int fd) {
     fclose(f);
 }
 
+bool Report::writeColumns(const char *filename) {
+    //-- one column for each attribute any model has, in the order first seen
+    std::vector<int> ids;
+    std::vector<int> column;
+    for (long m = 0; m < modelCount; m++) {
+        AttributeList *attrList = models[m]->getAttributeList();
+        for (int a = 0; a < attrList->getAttributeCount(); a++) {
+            int id = attrList->getAttributeIdByIndex(a);
+            if (id >= (int) column.size())
+                column.resize(id + 1, -1);
+            if (column[id] < 0) {
+                column[id] = ids.size();
+                ids.push_back(id);
+            }
+        }
+    }
+
+    ColumnFileWriter writer;
+    if (!writer.open(filename, ColumnFileModels))
+        return false;
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rows = modelCount;
+    header.columns = ids.size();
+
+    std::vector<int64_t> modelIds(modelCount);
+    std::vector<uint64_t> names(modelCount);
+    for (long m = 0; m < modelCount; m++) {
+        modelIds[m] = models[m]->getID();
+        names[m] = writer.addString(models[m]->getPrintName());
+    }
+    header.rowIdsOffset = writer.write(modelIds.data(), modelCount * sizeof(int64_t));
+    header.rowNamesOffset = writer.write(names.data(), modelCount * sizeof(uint64_t));
+
+    std::vector<ColumnFileColumn> columns(ids.size());
+    std::vector<double> values(modelCount);
+    for (size_t c = 0; c < ids.size(); c++) {
+        for (long m = 0; m < modelCount; m++) {
+            AttributeList *attrList = models[m]->getAttributeList();
+            values[m] = attrList->hasAttributeById(ids[c]) ? attrList->getAttributeById(ids[c]) : NAN;
+        }
+        columns[c].attrId = ids[c];
+        columns[c].pad = 0;
+        columns[c].name = writer.addString(AttributeList::getAttributeName(ids[c]));
+        columns[c].dataOffset = writer.write(values.data(), modelCount * sizeof(double));
+    }
+    header.columnsOffset = writer.write(columns.data(), columns.size() * sizeof(ColumnFileColumn));
+    return writer.finish(header);
+}
+
 void printd(double d) {
     if (isnan(d)) {
         printf("undefined");
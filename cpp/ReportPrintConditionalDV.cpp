@@ -90,6 +90,7 @@ void Report::printConditional_DV(FILE *fd, Model *model, Relation *rel, bool cal
                 manager->makeProjection(test_data, test_table, predRelWithDV);
             iv_rel = predRelWithDV;
         } else {
+            manager->makeProjection(rel);
             fit_table = rel->getTable();
             manager->makeProjection(input_data, input_table, rel);
             if (test_sample_size > 0.0)
@@ -20,6 +20,8 @@ int *sort_vars;
 KeySegment **sort_keys;
 Table *sort_table;
 const char *sortAttr;
+int sortAttrId; // the IDs of sortAttr and "Level", so comparing is only array reads
+int sortLevelId;
 Direction sortDir;
 Direction searchDir;
 
@@ -43,10 +45,10 @@ int strcmpAccountingForNumbers(const char* s1, const char* s2) {
 int sortCompare(const void *k1, const void *k2) {
     Model *m1 = *((Model**) k1);
     Model *m2 = *((Model**) k2);
-    double a1 = m1->getAttribute(sortAttr);
-    double a2 = m2->getAttribute(sortAttr);
-    double l1 = m1->getAttribute("Level");
-    double l2 = m2->getAttribute("Level");
+    double a1 = m1->getAttributeById(sortAttrId);
+    double a2 = m2->getAttributeById(sortAttrId);
+    double l1 = m1->getAttributeById(sortLevelId);
+    double l2 = m2->getAttributeById(sortLevelId);
     int levelPref = 0;
     if      (searchDir == Direction::Ascending)  { levelPref = (l1 > l2) ? -1 : (l1 < l2) ? 1 : 0; } 
     else if (searchDir == Direction::Descending) { levelPref = (l1 < l2) ? -1 : (l1 > l2) ? 1 : 0; }
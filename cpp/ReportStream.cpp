@@ -0,0 +1,298 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "ReportStream.h"
+#include "Model.h"
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <queue>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * ReportStream.cpp - each run in the run file is a sequence of records, a
+ * RunRecord followed by the formatted row. Records are ordered by key (the sort
+ * attribute, negated for a descending sort), then by level key, then by ID, so
+ * that runs can be merged by comparing only the record headers.
+ */
+
+struct RunRecord {
+    double key;
+    double levelKey;
+    int id;
+    int length; // of the row which follows
+};
+
+static bool recordBefore(const RunRecord &a, const RunRecord &b) {
+    if (a.key != b.key)
+        return a.key < b.key;
+    if (a.levelKey != b.levelKey)
+        return a.levelKey < b.levelKey;
+    return a.id < b.id;
+}
+
+//-- append printf output to a row
+static void append(std::vector<char> &row, const char *fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > (int) sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+    row.insert(row.end(), buf, buf + len);
+}
+
+//-- append a string, quoted as the format requires
+static void appendString(std::vector<char> &row, const char *text, ReportStream::Format format) {
+    char delimiter = format == ReportStream::TSV ? '\t' : ',';
+    bool quote = format == ReportStream::NDJSON || strchr(text, delimiter) || strchr(text, '"') || strchr(text, '\n');
+    if (!quote) {
+        row.insert(row.end(), text, text + strlen(text));
+        return;
+    }
+    row.push_back('"');
+    for (const char *cp = text; *cp; cp++) {
+        if (*cp == '"')
+            row.push_back(format == ReportStream::NDJSON ? '\\' : '"');
+        else if (*cp == '\\' && format == ReportStream::NDJSON)
+            row.push_back('\\');
+        row.push_back(*cp);
+    }
+    row.push_back('"');
+}
+
+ReportStream::ReportStream() :
+        out(NULL), runFile(NULL), format(CSV), sortAttr(NULL), sortDir(Direction::Descending),
+        searchDir(Direction::Ascending) {
+}
+
+ReportStream::~ReportStream() {
+    close();
+    for (size_t a = 0; a < attrs.size(); a++)
+        delete[] attrs[a].name;
+    delete[] sortAttr;
+}
+
+bool ReportStream::findFormat(const char *name, Format *format) {
+    if (strcasecmp(name, "csv") == 0)
+        *format = CSV;
+    else if (strcasecmp(name, "tsv") == 0)
+        *format = TSV;
+    else if (strcasecmp(name, "ndjson") == 0)
+        *format = NDJSON;
+    else
+        return false;
+    return true;
+}
+
+bool ReportStream::open(const char *filename, Format fmt, const char *attrList, const char *sort, Direction dir,
+        Direction search) {
+    close();
+    out = fopen(filename, "w");
+    if (out == NULL) {
+        printf("Error: couldn't write report stream %s\n", filename);
+        return false;
+    }
+    runFile = tmpfile();
+    if (runFile == NULL) {
+        printf("Error: couldn't create a temporary file for report stream %s\n", filename);
+        fclose(out);
+        out = NULL;
+        return false;
+    }
+    format = fmt;
+    delete[] sortAttr;
+    sortAttr = new char[strlen(sort) + 1];
+    strcpy(sortAttr, sort);
+    sortDir = dir;
+    searchDir = search;
+
+    //-- the attribute list is as for Report::setAttributes: names separated by
+    //-- commas, each perhaps followed by "$" and formatting
+    for (size_t a = 0; a < attrs.size(); a++)
+        delete[] attrs[a].name;
+    attrs.clear();
+    for (const char *cp = attrList; *cp;) {
+        while (isspace(*cp) || *cp == ',')
+            cp++;
+        if (*cp == '\0')
+            break;
+        const char *end = cp;
+        while (*end && *end != ',' && *end != '$' && !isspace(*end))
+            end++;
+        Attr attr;
+        attr.name = new char[end - cp + 1];
+        strncpy(attr.name, cp, end - cp);
+        attr.name[end - cp] = '\0';
+        attr.integer = end[0] == '$' && toupper(end[1]) == 'I';
+        attrs.push_back(attr);
+        cp = end;
+        while (*cp && *cp != ',')
+            cp++;
+    }
+    runs.clear();
+    writeHeader(out);
+    fflush(out);
+    return true;
+}
+
+void ReportStream::writeHeader(FILE *fd) {
+    if (format == NDJSON)
+        return;
+    char delimiter = format == TSV ? '\t' : ',';
+    fprintf(fd, "ID%cMODEL", delimiter);
+    for (size_t a = 0; a < attrs.size(); a++)
+        fprintf(fd, "%c%s", delimiter, attrs[a].name);
+    fprintf(fd, "\n");
+}
+
+void ReportStream::formatRow(Model *model, std::vector<char> &row) {
+    char delimiter = format == TSV ? '\t' : ',';
+    row.clear();
+    if (format == NDJSON) {
+        append(row, "{\"id\":%d,\"model\":", model->getID());
+        appendString(row, model->getPrintName(), format);
+    } else {
+        append(row, "%d%c", model->getID(), delimiter);
+        appendString(row, model->getPrintName(), format);
+    }
+    for (size_t a = 0; a < attrs.size(); a++) {
+        double value = model->getAttribute(attrs[a].name);
+        if (format == NDJSON) {
+            append(row, ",");
+            appendString(row, attrs[a].name, format);
+            append(row, ":");
+        } else {
+            row.push_back(delimiter);
+        }
+        if (!isfinite(value))
+            append(row, format == NDJSON ? "null" : "%g", value);
+        else if (attrs[a].integer)
+            append(row, "%.0f", value);
+        else
+            append(row, "%.10g", value);
+    }
+    if (format == NDJSON)
+        row.push_back('}');
+    row.push_back('\n');
+}
+
+void ReportStream::writeLevel(Model **models, long count) {
+    if (out == NULL)
+        return;
+    std::vector<RunRecord> records(count);
+    std::vector<long> order(count);
+    for (long i = 0; i < count; i++) {
+        RunRecord &rec = records[i];
+        rec.key = models[i]->getAttribute(sortAttr);
+        if (sortDir == Direction::Descending)
+            rec.key = -rec.key;
+        rec.levelKey = models[i]->getAttribute("Level");
+        if (searchDir == Direction::Ascending)
+            rec.levelKey = -rec.levelKey;
+        rec.id = models[i]->getID();
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](long a, long b) {
+        return recordBefore(records[a], records[b]);
+    });
+
+    Run run;
+    fseek(runFile, 0, SEEK_END);
+    run.offset = ftell(runFile);
+    run.count = count;
+    std::vector<char> row;
+    for (long i = 0; i < count; i++) {
+        formatRow(models[order[i]], row);
+        RunRecord &rec = records[order[i]];
+        rec.length = row.size();
+        fwrite(row.data(), 1, row.size(), out);
+        fwrite(&rec, sizeof(rec), 1, runFile);
+        fwrite(row.data(), 1, row.size(), runFile);
+    }
+    runs.push_back(run);
+    fflush(out);
+}
+
+bool ReportStream::writeSorted(const char *filename) {
+    if (runFile == NULL)
+        return false;
+    FILE *fd = fopen(filename, "w");
+    if (fd == NULL) {
+        printf("Error: couldn't write sorted report %s\n", filename);
+        return false;
+    }
+    writeHeader(fd);
+    fflush(runFile);
+
+    //-- merge the runs, holding one record header from each
+    struct Cursor {
+        RunRecord rec;
+        long pos; // of the record's row
+        long remaining; // records after this one
+    };
+    auto after = [](const Cursor &a, const Cursor &b) {
+        return recordBefore(b.rec, a.rec);
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(after)> heads(after);
+    auto readHead = [this](long pos, long remaining, Cursor &cursor) {
+        fseek(runFile, pos, SEEK_SET);
+        if (fread(&cursor.rec, sizeof(cursor.rec), 1, runFile) != 1)
+            return false;
+        cursor.pos = pos + sizeof(cursor.rec);
+        cursor.remaining = remaining;
+        return true;
+    };
+    bool ok = true;
+    for (size_t r = 0; r < runs.size(); r++) {
+        Cursor cursor;
+        if (runs[r].count > 0) {
+            if (readHead(runs[r].offset, runs[r].count - 1, cursor))
+                heads.push(cursor);
+            else
+                ok = false;
+        }
+    }
+    std::vector<char> row;
+    while (!heads.empty()) {
+        Cursor cursor = heads.top();
+        heads.pop();
+        row.resize(cursor.rec.length);
+        fseek(runFile, cursor.pos, SEEK_SET);
+        if (fread(row.data(), 1, row.size(), runFile) != row.size()) {
+            ok = false;
+            break;
+        }
+        fwrite(row.data(), 1, row.size(), fd);
+        if (cursor.remaining > 0) {
+            Cursor next;
+            if (readHead(cursor.pos + cursor.rec.length, cursor.remaining - 1, next))
+                heads.push(next);
+            else
+                ok = false;
+        }
+    }
+    if (ferror(fd))
+        ok = false;
+    if (fclose(fd) != 0)
+        ok = false;
+    if (!ok)
+        printf("Error: couldn't write sorted report %s\n", filename);
+    return ok;
+}
+
+void ReportStream::close() {
+    if (out)
+        fclose(out);
+    if (runFile)
+        fclose(runFile);
+    out = NULL;
+    runFile = NULL;
+}
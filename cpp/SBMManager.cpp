@@ -128,14 +128,14 @@ void SBMManager::makeReferenceModels(Relation *top) {
             }
         }
         rel = getRelation(varindices, pos, true, state_indices);
-        model->addRelation(rel, true, getModelCache());
+        model->addRelation(rel, true);
         //-- now add a unary relation for each dependent variable
         for (i = 0; i < varCount; i++) {
             var = varList->getVariable(i);
             if (var->dv) {
                 varindices[0] = i;
                 rel = getRelation(varindices, 1, true, state_indices);
-                model->addRelation(rel, true, getModelCache());
+                model->addRelation(rel, true);
             }
         }
         model->completeSbModel();
@@ -148,7 +148,7 @@ void SBMManager::makeReferenceModels(Relation *top) {
         for (i = 0; i < varCount; i++) {
             varindices[0] = i;
             rel = getRelation(varindices, 1, true, state);
-            model->addRelation(rel, true, getModelCache());
+            model->addRelation(rel, true);
             /*
              int inputCells = 1;
              int varcount = varList->getVarCount();
@@ -178,7 +178,7 @@ void SBMManager::makeReferenceModels(Relation *top) {
     }
     bottomRef = model;
     if (!modelCache->addModel(bottomRef)) {
-        Model *cached_model = modelCache->findModel(bottomRef->getPrintName());
+        Model *cached_model = modelCache->findModel(bottomRef);
         delete bottomRef;
         bottomRef = cached_model;
     }
@@ -313,7 +313,7 @@ void SBMManager::computeL2Statistics(Model *model) {
     if (refModelL2 <= 0.0)
         refModelL2 = 0.0;
 
-    double refL2Prob = csa(refModelL2, refDDF);
+    double refL2Prob = ocChiSquaredAlpha(refModelL2, refDDF);
 
     double critX2 = 0, refL2Power = 0;
 
@@ -322,12 +322,12 @@ void SBMManager::computeL2Statistics(Model *model) {
     if (!getOptionFloat("alpha", NULL, &alpha))
         alpha = 0.0;
     if (alpha > 0)
-        critX2 = ppchi(alpha, refDDF, &errcode);
+        critX2 = ocChiSquaredCritical(alpha, refDDF, &errcode);
     else
         critX2 = refModelL2;
     if (errcode)
         printf("ppchi: errcode=%d\n", errcode);
-    refL2Power = 1.0 - chin2(critX2, refDDF, refModelL2, &errcode);
+    refL2Power = ocChiSquaredPower(critX2, refDDF, refModelL2, &errcode);
 
     //?? do something with these returned errors
     model->setAttribute(ATTRIBUTE_DDF, refDDF);
@@ -350,26 +350,35 @@ void SBMManager::computeL2Statistics(Model *model) {
 
 }
 
+void SBMManager::computeL2Statistics(Model **models, long count) {
+    //-- each model's statistics are recomputed in full; models sharing a DDF
+    //-- share the chi-squared evaluations through the memoized functions
+    for (long i = 0; i < count; i++) {
+        computeL2Statistics(models[i]);
+    }
+}
+
 void SBMManager::computePearsonStatistics(Model *model) {
     //-- these statistics require a full contingency table, so make
     //-- sure one has been created.
     if (model == NULL || bottomRef == NULL)
         return;
     makeFitTable(model);
+    FitWorkspace *ws = getWorkspace();
 
-    Table *modelFitTable = new Table(keysize, fitTable1->getTupleCount());
+    Table *modelFitTable = new Table(keysize, ws->fitTable1->getTupleCount());
 
-    modelFitTable->copy(fitTable1);
+    modelFitTable->copy(ws->fitTable1);
     makeFitTable(bottomRef);
     double modelP2 = ocPearsonChiSquared(inputData, modelFitTable, (long) round(sampleSize));
-    double refP2 = ocPearsonChiSquared(inputData, fitTable1, (long) round(sampleSize));
+    double refP2 = ocPearsonChiSquared(inputData, ws->fitTable1, (long) round(sampleSize));
 
     int errcode;
     double modelDF = computeDfSb(model);
     double refDF = computeDF(refModel);
     double refDDF = fabs(modelDF - refDF);
     double refModelP2 = refP2 - modelP2;
-    double refP2Prob = csa(refModelP2, refDDF);
+    double refP2Prob = ocChiSquaredAlpha(refModelP2, refDDF);
 
     double critX2, refP2Power;
     errcode = 0;
@@ -378,12 +387,12 @@ void SBMManager::computePearsonStatistics(Model *model) {
     if (!getOptionFloat("alpha", NULL, &alpha))
         alpha = 0.0;
     if (alpha > 0)
-        critX2 = ppchi(alpha, refDDF, &errcode);
+        critX2 = ocChiSquaredCritical(alpha, refDDF, &errcode);
     else
         critX2 = modelP2;
     if (errcode)
         printf("ppchi: errcode=%d\n", errcode);
-    refP2Power = 1.0 - chin2(critX2, refDDF, modelP2, &errcode);
+    refP2Power = ocChiSquaredPower(critX2, refDDF, modelP2, &errcode);
     if (errcode)
         printf("chin2: errcode=%d, %.2f, %.2f\n", errcode, refDDF, modelP2);
     //?? do something with these returned errors
@@ -517,14 +526,16 @@ void SBMManager::computeBPStatistics(Model *model) {
     long fullDimension = (long) ocDegreesOfFreedom(topRef->getRelation(0)) + 1;
 
     BPIntersectProcessor processor(inputData, model->getRelationCount(), fullDimension);
-    if (intersectArray != NULL) {
-        delete[] intersectArray;
-        intersectCount = 0;
-        intersectMax = model->getRelationCount();
-        ;
-        intersectArray = NULL;
+    FitWorkspace *ws = getWorkspace();
+    if (ws->intersectArray != NULL) {
+        delete[] ws->intersectArray;
+        ws->intersectCount = 0;
+        ws->intersectMax = model->getRelationCount();
+        ws->intersectArray = NULL;
     }
 
+    //-- the terms read the relations' projections, which may have been evicted
+    makeProjections(model);
     doIntersectionProcessing(model, &processor);
     double t = processor.getTransmission();
     model->setAttribute(ATTRIBUTE_BP_T, t);
@@ -543,7 +554,7 @@ void SBMManager::computePercentCorrect(Model *model) {
         printf("ERROR: Failed to create state-based fit table. Terminating.\n");
         exit(1);
     }
-    Table *modelTable = fitTable1;
+    Table *modelTable = getWorkspace()->fitTable1;
     Table *maxTable = new Table(modelTable->getKeySize(), modelTable->getTupleCount());
 
     int maxCount = varList->getVarCount();
@@ -16,6 +16,10 @@
 #include "Math.h"
 #include <assert.h>
 #include <iostream>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 using namespace std;
 
 //----- Full search down through the lattice -----
@@ -58,9 +62,9 @@ Model **SearchFullDown::search(Model *start) {
  * finding maximal variable sets satisfying (1) and (2). When one is found, it is
  * tested against (3).
  *
- * Each stack entry contains a relation and a list of variables, along with some
+ * Each stack entry contains a relation and a set of variables, along with some
  * position information about where we are in the search. The stack is initialized
- * with R0 = a relation in M, and V0 a list of all variables not in R0. A variable in V0
+ * with R0 = a relation in M, and V0 the set of all variables not in R0. A variable in V0
  * is chosen. The next stack entry is constructed by finding a new relation containing
  * the selected variable; the R1 is set to the intersection of the new relation and R0,
  * and V1 is set to all variables in R0 and not in R1. This stack building continues
@@ -70,249 +74,173 @@ Model **SearchFullDown::search(Model *start) {
  * and (b) for all variables in each variable set. If at any point no additional relations
  * can be found which need the criteria for addition to the stack, no candidate relation
  * is produced.
+ *
+ * Variable sets are bitsets of "words" 64-bit words. Their storage, and that of the
+ * stack, is kept by the SearchFullUp object and reused from one search to the next,
+ * so that no allocation is done while the stack is worked.
  */
 
+typedef unsigned long long VarWord;
+
 struct SearchStackEntry {
         int relIndex; // index of the next relation to consider, among the relations in the starting model
         int nextRelIndex; // the next index to check
-        int varIndex; // index of the current variable in varList
-        int *innerList; // list of variable indices in all stack entries so far
-        int *outerList; // list of all variable indices in all relations but this one
-        int innerListCount;
-        int outerListCount;
-
-        // trivial constructor, for array allocation
-        SearchStackEntry() :
-                relIndex(-1), nextRelIndex(-1), varIndex(-1), innerList(0), outerList(0), innerListCount(0), outerListCount(
-                        0) {
-        }
-        ;
-
-        // destructor
-        ~SearchStackEntry() {
-            delete[] innerList;
-            delete[] outerList;
-        }
-
-        // assignment
-        void set(int relIndex, int varIndex, int *innerList, int innerListCount, int *outerList, int outerListCount) {
-            this->relIndex = relIndex;
-            this->nextRelIndex = relIndex + 1;
-            this->varIndex = varIndex;
-            this->innerListCount = innerListCount;
-            this->outerListCount = outerListCount;
-            if (this->innerList)
-                delete[] this->innerList;
-            this->innerList = innerList;
-            if (this->outerList)
-                delete[] this->outerList;
-            this->outerList = outerList;
-        }
-
-        void clean() {
-            if (innerList)
-                delete[] innerList;
-            this->innerList = NULL;
-            if (outerList)
-                delete[] outerList;
-            this->outerList = NULL;
-        }
-
-        void dump(Model *model);
+        int var; // the current variable in outer, or -1 when all have been tried
+        VarWord *inner; // variables in all stack entries so far
+        VarWord *outer; // variables in the previous entry's inner set, but not in this relation
 };
 
-void SearchStackEntry::dump(Model *model) {
-    char name[1000];
-    VariableList *varlist = model->getRelation(0)->getVariableList();
-    varlist->getPrintName(name, 1000, innerListCount, innerList);
-    varlist->getPrintName(name, 1000, outerListCount, outerList);
+//-- the first variable at or after "from" in a set, or -1 if there is none
+static int nextVar(const VarWord *set, int words, int from) {
+    int w = from >> 6;
+    if (w >= words)
+        return -1;
+    VarWord bits = set[w] & (~0ULL << (from & 63));
+    for (;;) {
+        if (bits)
+            return (w << 6) + __builtin_ctzll(bits);
+        if (++w >= words)
+            return -1;
+        bits = set[w];
+    }
 }
 
-//-- construct the complement variable list for a given list
-static void getComplement(int *innerList, int innerListCount, int *outerList, int maxcount) {
-    int here = 0;
-    int *outp = outerList;
-    int index;
-    //-- note: this code assumes innerList is sorted
-    for (int i = 0; i < maxcount; i++) {
-        while (here < innerListCount && (index = innerList[here]) < i) {
-            here++;
-        }
-        if (i != index) {
-            *(outp++) = i;
-        }
-        //assert(outp - outerList <= maxcount - innerListCount);
+static bool isEmpty(const VarWord *set, int words) {
+    for (int w = 0; w < words; w++) {
+        if (set[w])
+            return false;
     }
-    //assert(outp - outerList == maxcount - innerListCount);
+    return true;
 }
 
-//-- check the given variable list to see if it is a subset of the given relation
-bool varSubset(int *vars, int varcount, Relation *rel) {
-    int i, j;
-    int relvarcount = rel->getVariableCount();
-    int *relvars = rel->getVariables();
-    for (i = 0; i < varcount; i++) {
-        for (j = 0; j < relvarcount; j++) {
-            if (vars[i] == relvars[j])
-                break;
-        }
-        //-- if got to the end of the list, no match
-        if (j >= relvarcount)
+//-- check whether every variable in a is also in b
+static bool isSubset(const VarWord *a, const VarWord *b, int words) {
+    for (int w = 0; w < words; w++) {
+        if (a[w] & ~b[w])
             return false;
     }
     return true;
 }
 
-//-- build a list of the current variables for each stack entry
-void currentVars(int *vars, SearchStackEntry *stack, int top) {
-    SearchStackEntry *stackEntry;
+//-- build the set of the current variables for each stack entry
+static void currentVars(VarWord *vars, int words, SearchStackEntry *stack, int top) {
+    memset(vars, 0, words * sizeof(VarWord));
     for (int i = 0; i < top; i++) {
-        stackEntry = &stack[i];
-        vars[i] = stackEntry->outerList[stackEntry->varIndex];
+        int var = stack[i].var;
+        vars[var >> 6] |= 1ULL << (var & 63);
     }
 }
 
-//-- construct starting stack entry. Returns false on error
-static bool pushStartingRelation(SearchStackEntry *stack, int &top, Model *model, int relIndex) {
-    top = 0;
-    Relation *rel = model->getRelation(relIndex);
-    int maxcount = rel->getVariableList()->getVarCount(); // full var list size
-    int varcount = rel->getVariableCount(); // size in this rel
-    if (varcount == maxcount)
-        return false; // must be top relation
-    int *innerList = new int[varcount];
-    rel->copyVariables(innerList, varcount);
-    int *outerList = new int[maxcount - varcount];
-    getComplement(rel->getVariables(), rel->getVariableCount(), outerList, maxcount);
-    stack[top].set(relIndex, 0, innerList, varcount, outerList, maxcount - varcount);
-    top++;
-    return true;
-}
-
-//-- This function splits all the variables in the top of the stack, according to
-//-- whether they are in the given relation or not. Those which are in go in the
-//-- inner list, the rest go into the outer list.
-static void splitVariables(int *relvars, int relvarcount, int *topvars, int topvarcount, int **innerList,
-        int *innerListCount, int **outerList, int *outerListCount) {
-    //-- rather than figuring the list sizes exactly, we'll pick an upper bound
-    //-- for storage allocation
-    int alloc = topvarcount;
-    int *ilist, *olist, icount, ocount;
-    ilist = new int[alloc];
-    olist = new int[alloc];
-    icount = 0;
-    ocount = 0;
-    //-- note: this code assumes the variables are sorted
-    int index = 0;
-    int here = 0;
-    for (int i = 0; i < topvarcount; i++) {
-        int topindex = topvars[i];
-        while (here < relvarcount && (index = relvars[here]) < topindex) {
-            here++;
+//-- construct a stack entry. For the starting entry, the inner set is the relation and
+//-- the outer set is all variables not in it; this returns false if there are none (the
+//-- top relation). Otherwise the inner set contains the intersection of this relation
+//-- and the next entry on the stack, and the outer set contains all variables in the next
+//-- stack entry but not in this relation.
+static bool pushRelation(SearchStackEntry *stack, int &top, VarWord *relSets, int words, int varCount,
+        int relIndex) {
+    SearchStackEntry *entry = &stack[top];
+    VarWord *rel = relSets + (long) relIndex * words;
+    if (top == 0) {
+        VarWord last = (varCount & 63) ? (1ULL << (varCount & 63)) - 1 : ~0ULL;
+        for (int w = 0; w < words; w++) {
+            entry->inner[w] = rel[w];
+            entry->outer[w] = ~rel[w] & (w == words - 1 ? last : ~0ULL);
+        }
+        if (isEmpty(entry->outer, words))
+            return false;
+    } else {
+        VarWord *prev = stack[top - 1].inner;
+        for (int w = 0; w < words; w++) {
+            entry->inner[w] = prev[w] & rel[w];
+            entry->outer[w] = prev[w] & ~rel[w];
         }
-        if (index == topindex)
-            ilist[icount++] = topindex;
-        else
-            olist[ocount++] = topindex;
     }
-    *innerList = ilist;
-    *outerList = olist;
-    *innerListCount = icount;
-    *outerListCount = ocount;
-}
-
-//-- construct stack entry. not at the bottom. The inner list contains the
-//-- intersection of this relation's list and the next entry on the stack.
-//-- the outer list contains all variables in the next stack entry but not in this relation
-static bool pushRelation(SearchStackEntry *stack, int &top, Model *model, int relIndex) {
-    //-- if stack is empty, do special initialization
-    if (top == 0)
-        return pushStartingRelation(stack, top, model, relIndex);
-
-    Relation *rel = model->getRelation(relIndex);
-    int maxcount = rel->getVariableList()->getVarCount(); // full var list size
-    int varcount = rel->getVariableCount(); // size in this rel
-    int *innerList, *outerList;
-    int innerListCount, outerListCount;
-    SearchStackEntry *topEntry = &stack[top - 1];
-    splitVariables(rel->getVariables(), varcount, topEntry->innerList, topEntry->innerListCount, &innerList,
-            &innerListCount, &outerList, &outerListCount);
-    stack[top].set(relIndex, 0, innerList, innerListCount, outerList, outerListCount);
+    entry->relIndex = relIndex;
+    entry->nextRelIndex = relIndex + 1;
+    entry->var = nextVar(entry->outer, words, 0);
     top++;
     return true;
 }
 
 //-- Given the top of the stack, find a relation which contains all variables for
-//-- entries on the stack. The search goes through all models later in the list, and
-//-- all variables in the outerList
-static bool pushMatchingRelation(SearchStackEntry *stack, int &top, Model *model) {
-    //-- create a list of all variables in the stack
-    int varcount = top;
-    SearchStackEntry *stackEntry;
-    int *vars = new int[top];
-
-    //-- find a relation containing these variables
-    stackEntry = &stack[top - 1];
-    currentVars(vars, stack, top);
-    for (; stackEntry->nextRelIndex < model->getRelationCount(); stackEntry->nextRelIndex++) {
-        if (varSubset(vars, varcount, model->getRelation(stackEntry->nextRelIndex))) {
-            pushRelation(stack, top, model, stackEntry->nextRelIndex);
+//-- entries on the stack. The search goes through all relations later in the list.
+static bool pushMatchingRelation(SearchStackEntry *stack, int &top, VarWord *relSets, int words, int varCount,
+        int relCount, VarWord *vars) {
+    SearchStackEntry *stackEntry = &stack[top - 1];
+    currentVars(vars, words, stack, top);
+    for (; stackEntry->nextRelIndex < relCount; stackEntry->nextRelIndex++) {
+        if (isSubset(vars, relSets + (long) stackEntry->nextRelIndex * words, words)) {
+            pushRelation(stack, top, relSets, words, varCount, stackEntry->nextRelIndex);
             stackEntry->nextRelIndex++;
-            delete[] vars;
             return true;
         }
     }
     //-- no further candidates found
-    delete[] vars;
     return false;
 }
 
-static bool pop(SearchStackEntry *stack, int &top) {
-    if (top <= 0)
-        return false;
-    top--;
-    stack[top].clean();
-    return true;
+SearchFullUp::~SearchFullUp() {
+    delete[] stack;
+    delete[] sets;
+    delete[] candidates;
+    delete[] scratchRels;
 }
 
 void SearchFullUp::makeCandidate(SearchStackEntry *stack, int top, Model *start) {
-    int varcount = top;
-    SearchStackEntry *stackEntry;
-    int *vars = new int[top];
-    for (int i = 0; i < top; i++) {
-        stackEntry = &stack[i];
-        vars[i] = stackEntry->outerList[stackEntry->varIndex];
+    int relCount = start->getRelationCount();
+    VarWord *vars = sets + (long) 3 * relCount * words;
+    currentVars(vars, words, stack, top);
+
+    //-- a relation within one of the starting model's adds nothing to it
+    for (int r = 0; r < relCount; r++) {
+        if (isSubset(vars, sets + (long) r * words, words))
+            return;
+    }
+
+    //-- each distinct relation gives a distinct parent, so one found before is skipped
+    for (long c = 0; c < candidateCount; c++) {
+        if (memcmp(vars, candidates + c * words, words * sizeof(VarWord)) == 0)
+            return;
+    }
+    if ((candidateCount + 1) * words > candidateMax) {
+        long newMax = candidateMax ? candidateMax * 2 : 64 * words;
+        VarWord *newCandidates = new VarWord[newMax];
+        memcpy(newCandidates, candidates, candidateCount * words * sizeof(VarWord));
+        delete[] candidates;
+        candidates = newCandidates;
+        candidateMax = newMax;
+    }
+    memcpy(candidates + candidateCount * words, vars, words * sizeof(VarWord));
+    candidateCount++;
+
+    int varList[top];
+    int varcount = 0;
+    for (int v = nextVar(vars, words, 0); v >= 0; v = nextVar(vars, words, v + 1))
+        varList[varcount++] = v;
+    Relation *rel = manager->getRelation(varList, varcount, true);
+
+    //-- the parent holds the new relation, and the starting relations not within it.
+    //-- It is only built if the cache doesn't already have it.
+    int count = 0;
+    for (int r = 0; r < relCount; r++) {
+        if (!isSubset(sets + (long) r * words, vars, words))
+            scratchRels[count++] = start->getRelation(r);
     }
-    Relation::sort(vars, varcount);
-    Relation *rel = manager->getRelation(vars, varcount, true);
-    Model *newModel = new Model(start->getRelationCount() + 1);
-    newModel->copyRelations(*start);
-    newModel->addRelation(rel, true);
+    scratchRels[count++] = rel;
     ModelCache *cache = manager->getModelCache();
-    if (!cache->addModel(newModel)) {
-        //-- already exists in cache; return that one
-        Model *cachedModel = cache->findModel(newModel->getPrintName());
-        delete newModel;
-        newModel = cachedModel;
-        //-- since all models come from the cache, we can do pointer compares to see if
-        //-- this model is already in the list. The model might also be the current model
-        if (newModel == start)
-            newModel = NULL;
-        else if (((VBMManager *) manager)->applyFilter(newModel)) {
-            int i;
-            for (i = 0; i < parentListCount; i++) {
-                if (parentList[i] == newModel)
-                    break;
-            }
-            if (i >= parentListCount) {
-                parentList[parentListCount++] = newModel;
-            } else
-                newModel = NULL;
+    Model *newModel = cache->findModel(scratchRels, count);
+    if (newModel == NULL) {
+        newModel = new Model(relCount + 1);
+        newModel->copyRelations(*start);
+        newModel->addRelation(rel, true);
+        Model *cachedModel = cache->findOrAddModel(newModel);
+        if (cachedModel != newModel) {
+            delete newModel;
+            newModel = cachedModel;
         }
-    } else if (((VBMManager *) manager)->applyFilter(newModel)) {
-        parentList[parentListCount++] = newModel;
     }
-    delete[] vars;
+    if (((VBMManager *) manager)->applyFilter(newModel))
+        parentList[parentListCount++] = newModel;
 }
 
 Model **SearchFullUp::search(Model *start) {
@@ -320,103 +248,213 @@ Model **SearchFullUp::search(Model *start) {
     //-- verifying that all its immediate subrelations are present in the model. This
     //-- must be done for all candidate relations.
     int relationCount = start->getRelationCount();
+    int varCount = start->getRelation(0)->getVariableList()->getVarCount();
+    words = (varCount + 63) / 64;
 
     //-- allocate model storage. Since each relation in the model can be augmented with at
     //-- most one variable, an upper bound on the number of parents is the number of variables
     //-- times the number of relations in this model.
-    int parentListMax = relationCount * (start->getRelation(0)->getVariableList()->getVarCount() - 1);
+    parentListMax = relationCount * (varCount - 1);
     parentList = new Model*[parentListMax];
     memset(parentList, 0, parentListMax * sizeof(Model*));
     parentListCount = 0;
-
-    //-- The stack depth can be no more than the number of relations in the model. Allocate
-    //-- the stack.
-    SearchStackEntry *stack = new SearchStackEntry[relationCount];
+    candidateCount = 0;
+
+    //-- The stack depth can be no more than the number of relations in the model. Variable
+    //-- sets are needed for each relation, for the inner and outer sets of each stack
+    //-- entry, and for the current candidate.
+    if (relationCount > stackMax) {
+        delete[] stack;
+        delete[] scratchRels;
+        stack = new SearchStackEntry[relationCount];
+        scratchRels = new Relation*[relationCount + 1];
+        stackMax = relationCount;
+    }
+    long setsNeeded = (long) (3 * relationCount + 1) * words;
+    if (setsNeeded > setsMax) {
+        delete[] sets;
+        sets = new VarWord[setsNeeded];
+        setsMax = setsNeeded;
+    }
+    memset(sets, 0, relationCount * words * sizeof(VarWord));
+    for (int r = 0; r < relationCount; r++) {
+        Relation *rel = start->getRelation(r);
+        VarWord *set = sets + (long) r * words;
+        int *relVars = rel->getVariables();
+        for (int v = 0; v < rel->getVariableCount(); v++)
+            set[relVars[v] >> 6] |= 1ULL << (relVars[v] & 63);
+        stack[r].inner = sets + (long) (relationCount + 2 * r) * words;
+        stack[r].outer = stack[r].inner + words;
+    }
+    VarWord *vars = sets + (long) 3 * relationCount * words;
 
     //-- For each model up to the next-to-last one, push the relation on the
     //-- stack and do the processing.
-    for (int relIndex = 0; relIndex < start->getRelationCount() - 1; relIndex++) {
+    for (int relIndex = 0; relIndex < relationCount - 1; relIndex++) {
         int top = 0;
-        pushRelation(stack, top, start, relIndex);
+        if (!pushRelation(stack, top, sets, words, varCount, relIndex))
+            continue;
         for (;;) {
             SearchStackEntry *stacktop = &stack[top - 1];
-            //-- if the innerList is empty, we can't add more relations.
-            if (stacktop->innerListCount == 0) {
-                while (stacktop->varIndex < stacktop->outerListCount) {
+            //-- if the inner set is empty, we can't add more relations.
+            if (isEmpty(stacktop->inner, words)) {
+                while (stacktop->var >= 0) {
                     if (top > 1)
                         makeCandidate(stack, top, start);
-                    stacktop->varIndex++;
+                    stacktop->var = nextVar(stacktop->outer, words, stacktop->var + 1);
                     stacktop->nextRelIndex = stacktop->relIndex + 1;
                 }
-                pop(stack, top);
+                top--;
                 if (top == 0)
                     break;
             }
             //-- if we can't push another matching relation, then this is a candidate
             else {
-                while (stacktop->varIndex < stacktop->outerListCount && !pushMatchingRelation(stack, top, start)) {
+                while (stacktop->var >= 0
+                        && !pushMatchingRelation(stack, top, sets, words, varCount, relationCount, vars)) {
                     if (top > 1) {
                         makeCandidate(stack, top, start);
                     }
-                    stacktop->varIndex++;
+                    stacktop->var = nextVar(stacktop->outer, words, stacktop->var + 1);
                     stacktop->nextRelIndex = stacktop->relIndex + 1;
                 }
-                if (stacktop->varIndex >= stacktop->outerListCount)
-                    pop(stack, top);
+                if (stacktop->var < 0)
+                    top--;
                 if (top == 0)
                     break;
             }
         }
     }
-    delete[] stack;
     return parentList;
 }
 
-void SearchSbFullUp::recurseDirected(Model *start, int cur_var, int cur_index, int *var_indices, int *state_indices,
-        int &models_found, Model **model_list) {
-    VariableList *var_list = manager->getVariableList();
-    bool is_directed = var_list->isDirected();
-    if (cur_var >= var_list->getVarCount()) {
-        if ((is_directed && (cur_index >= 2)) || (!is_directed && (cur_index >= 1))) { // make sure enough variables have been added
-            Relation *new_relation = manager->getRelation(var_indices, cur_index, true, state_indices);
-            for (int i = 0; i < start->getRelationCount(); i++)
-                if (start->getRelation(i) == new_relation)
-                    return;
-            Model *model = new Model(start->getRelationCount() + 1);
-            model->copyRelations(*start);
-            model->addRelation(new_relation, true, manager->getModelCache()); // may not need to normalize here, or if so, may need to check if it did anything
-            if (model->getRelationCount() > start->getRelationCount()) {
-                addToCache(model, models_found, model_list);
-            } else {
-                delete model;
-            }
-        }
+//----- Parallel enumeration for the state-based upward searches -----
+/*
+ * The state-based upward searches try each relation formed by choosing, for each
+ * variable, either to leave it out or to include one of its states. The tree of these
+ * choices is split into tasks at the first few variables, and the tasks are run on the
+ * search's threads (SearchBase::forEach). Each leaf builds a model on its own thread
+ * and looks it up in the model cache. Since a cached model can be reached from several
+ * leaves, a shared set records which models have been claimed, and only the thread
+ * which claims a model completes it. The models from all the tasks are then returned
+ * in the order a serial enumeration would have produced them, duplicates included, so
+ * that the caller builds the same list a serial search would.
+ */
+
+typedef std::function<void(int, int *, int *)> SbVisit;
+typedef std::function<Model *(int, int *, int *)> SbLeaf;
+
+//-- choose, for each variable from cur_var up to end_var, to leave it out or to add
+//-- one of its states, and call visit with each complete choice
+static void sbChoose(VariableList *var_list, int skip_var, int cur_var, int end_var, int cur_index, int *var_indices,
+        int *state_indices, const SbVisit &visit) {
+    if (cur_var >= end_var) {
+        visit(cur_index, var_indices, state_indices);
         return;
-    } else {
-        Variable *var = var_list->getVariable(cur_var);
-        // first call recursion without this variable, to skip it
-        recurseDirected(start, cur_var + 1, cur_index, var_indices, state_indices, models_found, model_list);
-        // then call it with each of the states
-        if (!is_directed || (is_directed && (cur_var != var_list->getDV()))) {
-            var_indices[cur_index] = cur_var;
-            for (int i = 0; i < var->cardinality; i++) {
-                state_indices[cur_index] = i;
-                recurseDirected(start, cur_var + 1, cur_index + 1, var_indices, state_indices, models_found,
-                        model_list);
-            }
+    }
+    // first call recursion without this variable, to skip it
+    sbChoose(var_list, skip_var, cur_var + 1, end_var, cur_index, var_indices, state_indices, visit);
+    // then call it with each of the states
+    if (cur_var != skip_var) {
+        var_indices[cur_index] = cur_var;
+        int cardinality = var_list->getVariable(cur_var)->cardinality;
+        for (int i = 0; i < cardinality; i++) {
+            state_indices[cur_index] = i;
+            sbChoose(var_list, skip_var, cur_var + 1, end_var, cur_index + 1, var_indices, state_indices, visit);
         }
     }
 }
 
-bool SearchSbFullUp::addToCache(Model *model, int &models_found, Model **model_list) {
-    ModelCache* cache = manager->getModelCache();
-    // put the model in the cache, or use the cached one if already there
-    if (!cache->addModel(model)) {
-        Model *cached_model = cache->findModel(model->getPrintName());
+//-- a subtree of the enumeration: the choices made for the variables before the
+//-- split, and the models its leaves produced
+struct SbTask {
+    int count;
+    std::vector<int> vars;
+    std::vector<int> states;
+    std::vector<Model*> found;
+};
+
+//-- enumerate all choices following the cur_index variables already in var_indices,
+//-- appending the model made by each leaf (if any) to models
+static void sbEnumerate(SearchBase *search, int skip_var, int cur_index, int *var_indices, int *state_indices,
+        const SbLeaf &leaf, std::vector<Model*> &models) {
+    ManagerBase *manager = search->getManager();
+    VariableList *var_list = manager->getVariableList();
+    int var_count = var_list->getVarCount();
+
+    //-- split after enough variables to give each thread several tasks
+    int split = 0;
+    long taskCount = 1;
+    while (search->getThreadCount() > 1 && split < var_count && taskCount < 8L * search->getThreadCount()) {
+        if (split != skip_var)
+            taskCount *= var_list->getVariable(split)->cardinality + 1;
+        split++;
+    }
+    std::vector<SbTask> tasks;
+    sbChoose(var_list, skip_var, 0, split, cur_index, var_indices, state_indices,
+            [&tasks](int count, int *vars, int *states) {
+                tasks.emplace_back();
+                tasks.back().count = count;
+                tasks.back().vars.assign(vars, vars + count);
+                tasks.back().states.assign(states, states + count);
+            });
+
+    std::mutex claimLock;
+    std::unordered_set<Model*> claimed;
+    search->forEach(tasks.size(), [&](long t) {
+        SbTask &task = tasks[t];
+        std::vector<int> vars(var_count), states(var_count);
+        std::copy(task.vars.begin(), task.vars.end(), vars.begin());
+        std::copy(task.states.begin(), task.states.end(), states.begin());
+        sbChoose(var_list, skip_var, split, var_count, task.count, vars.data(), states.data(),
+                [&](int count, int *leafVars, int *leafStates) {
+                    Model *model = leaf(count, leafVars, leafStates);
+                    if (model == NULL)
+                        return;
+                    bool first;
+                    {
+                        std::lock_guard<std::mutex> guard(claimLock);
+                        first = claimed.insert(model).second;
+                    }
+                    if (first) {
+                        model->completeSbModel();
+                        manager->computeDF(model);
+                    }
+                    task.found.push_back(model);
+                });
+    });
+    for (size_t t = 0; t < tasks.size(); t++)
+        models.insert(models.end(), tasks[t].found.begin(), tasks[t].found.end());
+}
+
+//-- put a model in the cache, or use the cached one if already there
+static Model *cacheModel(ManagerBase *manager, Model *model) {
+    Model *cached_model = manager->getModelCache()->findOrAddModel(model);
+    if (cached_model != model)
         delete model;
-        model = cached_model;
+    return cached_model;
+}
+
+//-- build the model with the given relation added to start; NULL if it adds nothing
+Model *SearchSbFullUp::makeParent(Model *start, int count, int *var_indices, int *state_indices) {
+    bool is_directed = manager->getVariableList()->isDirected();
+    if ((is_directed && (count < 2)) || (!is_directed && (count < 1))) // make sure enough variables have been added
+        return NULL;
+    Relation *new_relation = manager->getRelation(var_indices, count, true, state_indices);
+    for (int i = 0; i < start->getRelationCount(); i++)
+        if (start->getRelation(i) == new_relation)
+            return NULL;
+    Model *model = new Model(start->getRelationCount() + 1);
+    model->copyRelations(*start);
+    model->addRelation(new_relation, true); // may not need to normalize here, or if so, may need to check if it did anything
+    if (model->getRelationCount() <= start->getRelationCount()) {
+        delete model;
+        return NULL;
     }
-    model->completeSbModel();
+    return cacheModel(manager, model);
+}
+
+bool SearchSbFullUp::addToList(Model *model, int &models_found, Model **model_list) {
     if (manager->computeDF(manager->getTopRefModel()) - manager->computeDF(model) <= 1e-36) {
         model = manager->getTopRefModel();
     }
@@ -446,6 +484,10 @@ Model** SearchSbFullUp::search(Model* start) {
     int rel_count = start->getRelationCount();
     int max_models = 0;
     int models_found = 0;
+    std::vector<Model*> parents;
+    SbLeaf leaf = [this, start](int count, int *vars, int *states) {
+        return makeParent(start, count, vars, states);
+    };
     if (var_list->isDirected()) {
         if (rel_count > 1) {
             // We attempt to add all possible states, skipping those that are already included.
@@ -469,16 +511,16 @@ Model** SearchSbFullUp::search(Model* start) {
             }
             models = new Model *[max_models + 1];
             memset(models, 0, sizeof(Model *) * (max_models + 1));
-            int cur_var = 0, cur_index = 0, model_count = 0;
+            int cur_index = 0;
             var_indices[cur_index] = var_list->getDV();
             if (DV->cardinality > 2) {
                 for (int i = 0; i < DV->cardinality; i++) {
                     state_indices[cur_index] = i;
-                    recurseDirected(start, cur_var, cur_index + 1, var_indices, state_indices, models_found, models);
+                    sbEnumerate(this, var_list->getDV(), cur_index + 1, var_indices, state_indices, leaf, parents);
                 }
             } else {
                 state_indices[cur_index] = DONT_CARE;
-                recurseDirected(start, cur_var, cur_index + 1, var_indices, state_indices, models_found, models);
+                sbEnumerate(this, var_list->getDV(), cur_index + 1, var_indices, state_indices, leaf, parents);
             }
             delete[] var_indices;
             delete[] state_indices;
@@ -503,11 +545,12 @@ Model** SearchSbFullUp::search(Model* start) {
             max_models *= var_list->getVariable(i)->cardinality + 1;
         models = new Model *[max_models + 1];
         memset(models, 0, sizeof(Model *) * (max_models + 1));
-        int cur_var = 0, cur_index = 0, model_count = 0;
-        recurseDirected(start, cur_var, cur_index, var_indices, state_indices, models_found, models);
+        sbEnumerate(this, -1, 0, var_indices, state_indices, leaf, parents);
         delete[] var_indices;
         delete[] state_indices;
     }
+    for (size_t i = 0; i < parents.size(); i++)
+        addToList(parents[i], models_found, models);
     return models;
 }
 
@@ -575,7 +618,7 @@ Model **SearchLooplessDown::search(Model *start) {
             // put in cache, or use the cached one if already there
             ModelCache *cache = manager->getModelCache();
             if (!cache->addModel(model)) {
-                Model *cachedModel = cache->findModel(model->getPrintName());
+                Model *cachedModel = cache->findModel(model);
                 delete model;
                 model = cachedModel;
             }
@@ -624,7 +667,7 @@ Model **SearchLooplessDown::search(Model *start) {
                     //-- put in cache, or use the cached one if already there
                     ModelCache *cache = manager->getModelCache();
                     if (!cache->addModel(model)) {
-                        Model *cachedModel = cache->findModel(model->getPrintName());
+                        Model *cachedModel = cache->findModel(model);
                         delete model;
                         model = cachedModel;
                     }
@@ -637,43 +680,23 @@ Model **SearchLooplessDown::search(Model *start) {
     }
 }
 
-void SearchSbLooplessUp::recurseDirected(int cur_var, int cur_index, int *var_indices, int *state_indices,
-        int &models_found, Model **model_list) {
-    VariableList *var_list = manager->getVariableList();
-    if (cur_var >= var_list->getVarCount()) {
-        if (cur_index >= 2) { // make sure enough variables have been added
-            Model *model = new Model(3);
-            model->addRelation(manager->getIndRelation(), false);
-            model->addRelation(manager->getDepRelation(), false);
-            Relation *new_relation = manager->getRelation(var_indices, cur_index, true, state_indices);
-            model->addRelation(new_relation, true, manager->getModelCache());
-            addToCache(model, models_found, model_list);
-        }
-        return;
-    } else {
-        Variable *var = var_list->getVariable(cur_var);
-        // first call recursion without this variable, to skip it
-        recurseDirected(cur_var + 1, cur_index, var_indices, state_indices, models_found, model_list);
-        // then call it with each of the states
-        if (cur_var != var_list->getDV()) {
-            var_indices[cur_index] = cur_var;
-            for (int i = 0; i < var->cardinality; i++) {
-                state_indices[cur_index] = i;
-                recurseDirected(cur_var + 1, cur_index + 1, var_indices, state_indices, models_found, model_list);
-            }
-        }
-    }
+//-- build the model with the independent relation, the dependent relation, and the given one
+Model *SearchSbLooplessUp::makeParent(int count, int *var_indices, int *state_indices) {
+    if (count < 2) // make sure enough variables have been added
+        return NULL;
+    Model *model = new Model(3);
+    model->addRelation(manager->getIndRelation(), false);
+    model->addRelation(manager->getDepRelation(), false);
+    Relation *new_relation = manager->getRelation(var_indices, count, true, state_indices);
+    model->addRelation(new_relation, true);
+    return cacheModel(manager, model);
 }
 
 bool SearchSbLooplessUp::addToCache(Model *model, int &models_found, Model **model_list) {
-    ModelCache* cache = manager->getModelCache();
-    Model* cached_model = NULL;
-    // put the model in the cache, or use the cached one if already there
-    if (!cache->addModel(model)) {
-        Model *cached_model = cache->findModel(model->getPrintName());
-        delete model;
-        model = cached_model;
-    }
+    return addToList(cacheModel(manager, model), models_found, model_list);
+}
+
+bool SearchSbLooplessUp::addToList(Model *model, int &models_found, Model **model_list) {
     // check if this model is in the return list, so we don't add a duplicate
     bool found = false;
     for (int j = 0; j < models_found; j++) {
@@ -736,17 +759,23 @@ Model **SearchSbLooplessUp::search(Model *start) {
             }
             model_list = new Model *[max_models + 1];
             memset(model_list, 0, sizeof(Model *) * (max_models + 1));
-            int cur_var = 0, cur_index = 0, model_count = 0;
+            int cur_index = 0;
+            std::vector<Model*> parents;
+            SbLeaf leaf = [this](int count, int *vars, int *states) {
+                return makeParent(count, vars, states);
+            };
             var_indices[cur_index] = var_list->getDV();
             if (DV->cardinality > 2) {
                 for (int i = 0; i < DV->cardinality; i++) {
                     state_indices[cur_index] = i;
-                    recurseDirected(cur_var, cur_index + 1, var_indices, state_indices, models_found, model_list);
+                    sbEnumerate(this, var_list->getDV(), cur_index + 1, var_indices, state_indices, leaf, parents);
                 }
             } else {
                 state_indices[cur_index] = DONT_CARE;
-                recurseDirected(cur_var, cur_index + 1, var_indices, state_indices, models_found, model_list);
+                sbEnumerate(this, var_list->getDV(), cur_index + 1, var_indices, state_indices, leaf, parents);
             }
+            for (size_t i = 0; i < parents.size(); i++)
+                addToList(parents[i], models_found, model_list);
             delete[] var_indices;
             delete[] state_indices;
         } else if ((rel_count == 3) || (rel_count == 2 && DV->cardinality == 2 && start != manager->getBottomRefModel())) {
@@ -801,7 +830,7 @@ Model **SearchSbLooplessUp::search(Model *start) {
                     model = new Model(3);
                     model->addRelation(manager->getIndRelation(), false);
                     model->addRelation(manager->getDepRelation(), false);
-                    model->addRelation(new_relation, false, manager->getModelCache());
+                    model->addRelation(new_relation, false);
                     addToCache(model, models_found, model_list);
                     state_indices[i] = old_value;
                 }
@@ -823,7 +852,7 @@ Model **SearchSbLooplessUp::search(Model *start) {
                 model = new Model(3);
                 model->addRelation(manager->getIndRelation(), false);
                 model->addRelation(manager->getDepRelation(), false);
-                model->addRelation(new_relation, false, manager->getModelCache());
+                model->addRelation(new_relation, false);
                 addToCache(model, models_found, model_list);
             }
             // If the relation has all of the variables possible, and no new relations are found, then
@@ -914,7 +943,7 @@ Model **SearchLooplessUp::search(Model *start) {
                                 // put the model in the cache, or use the cached one if already there
                                 ModelCache *cache = manager->getModelCache();
                                 if (!cache->addModel(model)) {
-                                    cachedModel = cache->findModel(model->getPrintName());
+                                    cachedModel = cache->findModel(model);
                                     delete model;
                                     model = cachedModel;
                                 }
@@ -985,7 +1014,7 @@ Model **SearchLooplessUp::search(Model *start) {
                 //-- put in cache, or use the cached one if already there
                 ModelCache *cache = manager->getModelCache();
                 if (!cache->addModel(model)) {
-                    Model *cachedModel = cache->findModel(model->getPrintName());
+                    Model *cachedModel = cache->findModel(model);
                     delete model;
                     model = cachedModel;
                 }
@@ -1080,7 +1109,7 @@ Model **SearchDisjointUp::search(Model *start) {
                 //-- put in cache, or use the cached one if already there
                 ModelCache *cache = manager->getModelCache();
                 if (!cache->addModel(model)) {
-                    Model *cachedModel = cache->findModel(model->getPrintName());
+                    Model *cachedModel = cache->findModel(model);
                     delete model;
                     model = cachedModel;
                 }
@@ -1116,7 +1145,7 @@ Model **SearchDisjointUp::search(Model *start) {
             //-- put in cache, or use the cached one if already there
             ModelCache *cache = manager->getModelCache();
             if (!cache->addModel(model)) {
-                Model *cachedModel = cache->findModel(model->getPrintName());
+                Model *cachedModel = cache->findModel(model);
                 delete model;
                 model = cachedModel;
             }
@@ -1199,7 +1228,7 @@ bool SearchChain::makeChainModels() {
             oldBrk = (char*) sbrk(0);
         double used = ((char*) sbrk(0)) - oldBrk;
         if (!cache->addModel(model)) {
-            Model *cachedModel = cache->findModel(model->getPrintName());
+            Model *cachedModel = cache->findModel(model);
             delete model;
             model = cachedModel;
         }
@@ -1327,7 +1356,7 @@ Model **SearchDisjointDown::search(Model *start) {
          // put in cache, or use the cached one if already there
          ModelCache *cache = manager->getModelCache();
          if (!cache->addModel(model)) {
-         Model *cachedModel = cache->findModel(model->getPrintName());
+         Model *cachedModel = cache->findModel(model);
          delete model;
          model = cachedModel;
          }
@@ -1367,7 +1396,7 @@ Model **SearchDisjointDown::search(Model *start) {
                     // add the model if it is not in the cache
                     ModelCache *cache = manager->getModelCache();
                     if (!cache->addModel(m)) {
-                        Model *cachedModel = cache->findModel(m->getPrintName());
+                        Model *cachedModel = cache->findModel(m);
                         delete m;
                         m = cachedModel;
                     }
@@ -1411,7 +1440,7 @@ Model **SearchDisjointDown::search(Model *start) {
                             ModelCache *cache = manager->getModelCache();
                             if (!cache->addModel(m1)) {
 
-                                Model *cachedModel = cache->findModel(m1->getPrintName());
+                                Model *cachedModel = cache->findModel(m1);
                                 delete m1;
                                 m1 = cachedModel;
                             }
@@ -10,6 +10,7 @@
 #include <math.h>
 #include "SearchBase.h"
 #include "Search.h"
+#include "ThreadPool.h"
 
 struct SearchType {
     const char *name;
@@ -29,13 +30,44 @@ SearchType searchTypes[] = {
 };
 
 
-SearchBase::SearchBase(): manager(0), directed(false)
+SearchBase::SearchBase(): manager(0), directed(false), threadCount(1), pool(0)
 {
 }
 
 
 SearchBase::~SearchBase()
 {
+    delete pool;
+}
+
+
+void SearchBase::setThreadCount(int count)
+{
+    threadCount = count < 1 ? 1 : count;
+    if (pool && pool->getThreadCount() != threadCount) {
+        delete pool;
+        pool = NULL;
+    }
+}
+
+
+void SearchBase::forEach(long count, const std::function<void(long)> &task)
+{
+    //-- the tasks share the manager, so they only run in parallel if it can fit
+    //-- several models at once
+    if (threadCount <= 1 || count <= 1 || !manager->isThreadSafe()) {
+        for (long i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+    if (pool == NULL)
+        pool = new ThreadPool(threadCount);
+    pool->run(count, [this, &task](long i) {
+        manager->bindWorkspace();
+        task(i);
+        manager->unbindWorkspace();
+    });
 }
 
 
@@ -63,6 +95,10 @@ SearchBase* SearchFactory::getSearchMethod(ManagerBase *mgr, const char *name, b
         search->setDirected(mgr->getVariableList()->isDirected());
         search->setMakeProjection(proj);
         search->setManager(mgr);
+        double threads;
+        if (!mgr->getOptionFloat("search-threads", NULL, &threads))
+            threads = ThreadPool::defaultThreadCount();
+        search->setThreadCount((int) threads);
     }
     return search;
 }
@@ -0,0 +1,306 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "SearchCheckpoint.h"
+#include "AttributeList.h"
+#include "ManagerBase.h"
+#include "Model.h"
+#include "ModelCache.h"
+#include "Options.h"
+#include "Relation.h"
+#include "Report.h"
+#include "StatsCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * SearchCheckpoint.cpp - file format (one item per line):
+ *     OCCAM-CHECKPOINT 1
+ *     data <fingerprint>          (StatsCache::fingerprint of the variables and data)
+ *     level <level>
+ *     options                     (followed by Options::write output, then "end")
+ *     models <count>
+ *     model <ID> <progenitor> <relation count> <attribute count>
+ *         then one line per relation: "rel <n> var..." or "srel <n> var:state...",
+ *         and one per attribute: "attr <name> <value>"
+ *     report <count> <model>...
+ *     kept <count> <model>...
+ *     end
+ * Models are referred to by their position in the models list; a progenitor of -1
+ * means none. Values are written with enough digits to be read back exactly.
+ */
+
+static const char *CHECKPOINT_MAGIC = "OCCAM-CHECKPOINT 1";
+
+//-- read a line, without its newline. Returns false at end of file.
+static bool readLine(FILE *fd, char **line, size_t *cap, int *lineno) {
+    ssize_t len = getline(line, cap, fd);
+    if (len < 0)
+        return false;
+    if (len > 0 && (*line)[len - 1] == '\n')
+        (*line)[len - 1] = '\0';
+    (*lineno)++;
+    return true;
+}
+
+//-- the options which may differ between a run and its resumption
+static bool isRunOption(const char *line) {
+    return strncmp(line, "search-checkpoint,", 18) == 0 || strncmp(line, "search-resume,", 14) == 0
+            || strncmp(line, "search-threads,", 15) == 0;
+}
+
+//-- the current options, as Options::write prints them, one per line
+static std::vector<std::string> currentOptions(ManagerBase *mgr) {
+    std::vector<std::string> lines;
+    char *text = NULL;
+    size_t size = 0;
+    FILE *fd = open_memstream(&text, &size);
+    if (fd == NULL)
+        return lines;
+    mgr->getOptions()->write(fd);
+    fclose(fd);
+    for (char *cp = strtok(text, "\n"); cp; cp = strtok(NULL, "\n")) {
+        if (!isRunOption(cp))
+            lines.push_back(cp);
+    }
+    free(text);
+    return lines;
+}
+
+bool SearchCheckpoint::write(const char *filename, ManagerBase *mgr, int level, Model **kept, long keptCount,
+        Report *report) {
+    //-- number the report models, then the kept ones, then any progenitors not yet numbered
+    std::vector<Model*> models;
+    std::unordered_map<Model*, long> index;
+    auto number = [&](Model *model) {
+        if (model && index.find(model) == index.end()) {
+            index[model] = models.size();
+            models.push_back(model);
+        }
+    };
+    long reportCount = report ? report->modelCount : 0;
+    for (long i = 0; i < reportCount; i++)
+        number(report->models[i]);
+    for (long i = 0; i < keptCount; i++)
+        number(kept[i]);
+    for (size_t i = 0; i < models.size(); i++)
+        number(models[i]->getProgenitor());
+
+    std::string temp = std::string(filename) + ".tmp";
+    FILE *fd = fopen(temp.c_str(), "w");
+    if (fd == NULL) {
+        printf("Error: couldn't write checkpoint %s\n", temp.c_str());
+        return false;
+    }
+    fprintf(fd, "%s\n", CHECKPOINT_MAGIC);
+    fprintf(fd, "data %016llx\n", StatsCache::fingerprint(mgr->getVariableList(), mgr->getInputData()));
+    fprintf(fd, "level %d\n", level);
+    fprintf(fd, "options\n");
+    mgr->getOptions()->write(fd);
+    fprintf(fd, "end\n");
+    fprintf(fd, "models %ld\n", (long) models.size());
+    for (size_t m = 0; m < models.size(); m++) {
+        Model *model = models[m];
+        AttributeList *attrs = model->getAttributeList();
+        Model *progen = model->getProgenitor();
+        fprintf(fd, "model %d %ld %d %d\n", model->getID(), progen ? index[progen] : -1L, model->getRelationCount(),
+                attrs->getAttributeCount());
+        for (int r = 0; r < model->getRelationCount(); r++) {
+            Relation *rel = model->getRelation(r);
+            int *vars = rel->getVariables();
+            int *states = rel->getStateIndices();
+            fprintf(fd, "%s %d", states ? "srel" : "rel", rel->getVariableCount());
+            for (int v = 0; v < rel->getVariableCount(); v++) {
+                if (states)
+                    fprintf(fd, " %d:%d", vars[v], states[v]);
+                else
+                    fprintf(fd, " %d", vars[v]);
+            }
+            fprintf(fd, "\n");
+        }
+        for (int a = 0; a < attrs->getAttributeCount(); a++) {
+            fprintf(fd, "attr %s %.17g\n", attrs->getAttributeNameByIndex(a), attrs->getAttributeByIndex(a));
+        }
+    }
+    fprintf(fd, "report %ld", reportCount);
+    for (long i = 0; i < reportCount; i++)
+        fprintf(fd, " %ld", index[report->models[i]]);
+    fprintf(fd, "\nkept %ld", keptCount);
+    for (long i = 0; i < keptCount; i++)
+        fprintf(fd, " %ld", index[kept[i]]);
+    fprintf(fd, "\nend\n");
+    bool failed = ferror(fd) != 0;
+    if (fclose(fd) != 0 || failed || rename(temp.c_str(), filename) != 0) {
+        printf("Error: couldn't write checkpoint %s\n", filename);
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+//-- read a "report" or "kept" list of model numbers
+static bool readModelList(char *line, const char *tag, std::vector<Model*> &models, std::vector<Model*> &list) {
+    size_t len = strlen(tag);
+    if (strncmp(line, tag, len) != 0 || line[len] != ' ')
+        return false;
+    char *cp = line + len;
+    long count = strtol(cp, &cp, 10);
+    for (long i = 0; i < count; i++) {
+        char *end;
+        long m = strtol(cp, &end, 10);
+        if (end == cp || m < 0 || m >= (long) models.size())
+            return false;
+        list.push_back(models[m]);
+        cp = end;
+    }
+    return true;
+}
+
+Model **SearchCheckpoint::read(const char *filename, ManagerBase *mgr, Report *report, int *level, int *maxID) {
+    FILE *fd = fopen(filename, "r");
+    if (fd == NULL) {
+        printf("Error: couldn't open checkpoint %s\n", filename);
+        return NULL;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    int lineno = 0;
+    const char *error = NULL;
+    unsigned long long print = 0;
+    long modelCount = 0;
+    std::vector<Model*> models;
+    std::vector<long> progenitors;
+    std::vector<Model*> reported, kept;
+    int varTotal = mgr->getVariableList()->getVarCount();
+    std::vector<int> vars(varTotal), states(varTotal);
+
+    if (!readLine(fd, &line, &cap, &lineno) || strcmp(line, CHECKPOINT_MAGIC) != 0) {
+        error = "not a search checkpoint";
+    } else if (!readLine(fd, &line, &cap, &lineno) || sscanf(line, "data %llx", &print) != 1) {
+        error = "expected data fingerprint";
+    } else if (print != StatsCache::fingerprint(mgr->getVariableList(), mgr->getInputData())) {
+        error = "checkpoint was made for different data";
+    } else if (!readLine(fd, &line, &cap, &lineno) || sscanf(line, "level %d", level) != 1) {
+        error = "expected level";
+    } else if (!readLine(fd, &line, &cap, &lineno) || strcmp(line, "options") != 0) {
+        error = "expected options";
+    }
+
+    //-- options which have changed since the checkpoint are reported, but are not an error
+    if (error == NULL) {
+        std::vector<std::string> saved, current = currentOptions(mgr);
+        while (readLine(fd, &line, &cap, &lineno) && strcmp(line, "end") != 0) {
+            if (!isRunOption(line))
+                saved.push_back(line);
+        }
+        if (saved != current) {
+            printf("Warning: options differ from those of checkpoint %s\n", filename);
+        }
+        if (!readLine(fd, &line, &cap, &lineno) || sscanf(line, "models %ld", &modelCount) != 1)
+            error = "expected model count";
+    }
+
+    for (long m = 0; error == NULL && m < modelCount; m++) {
+        int id, relCount, attrCount;
+        long progen;
+        if (!readLine(fd, &line, &cap, &lineno)
+                || sscanf(line, "model %d %ld %d %d", &id, &progen, &relCount, &attrCount) != 4
+                || progen < -1 || progen >= modelCount) {
+            error = "expected model";
+            break;
+        }
+        Model *model = new Model(relCount > 0 ? relCount : 1);
+        for (int r = 0; error == NULL && r < relCount; r++) {
+            bool stateBased = false;
+            if (readLine(fd, &line, &cap, &lineno))
+                stateBased = strncmp(line, "srel ", 5) == 0;
+            else
+                line[0] = '\0';
+            if (!stateBased && strncmp(line, "rel ", 4) != 0) {
+                error = "expected relation";
+                break;
+            }
+            char *cp = line + (stateBased ? 5 : 4);
+            int varCount = strtol(cp, &cp, 10);
+            if (varCount < 0 || varCount > varTotal) {
+                error = "bad relation";
+                break;
+            }
+            for (int v = 0; v < varCount; v++) {
+                char *end;
+                vars[v] = strtol(cp, &end, 10);
+                if (end == cp || vars[v] < 0 || vars[v] >= varTotal || (stateBased && *end != ':')) {
+                    error = "bad relation";
+                    break;
+                }
+                cp = end;
+                if (stateBased)
+                    states[v] = strtol(cp + 1, &cp, 10);
+            }
+            if (error == NULL)
+                model->addRelation(mgr->getRelation(vars.data(), varCount, false, stateBased ? states.data() : NULL),
+                        false);
+        }
+        if (error != NULL) {
+            delete model;
+            break;
+        }
+        Model *cached = mgr->getModelCache()->findOrAddModel(model);
+        if (cached != model) {
+            delete model;
+            model = cached;
+        }
+        //-- the attributes are set once the relations are in, since adding a relation clears them
+        for (int a = 0; a < attrCount; a++) {
+            char name[200];
+            int pos;
+            if (!readLine(fd, &line, &cap, &lineno) || sscanf(line, "attr %199s %n", name, &pos) != 1) {
+                error = "expected attribute";
+                break;
+            }
+            model->setAttribute(name, strtod(line + pos, NULL));
+        }
+        model->setID(id);
+        models.push_back(model);
+        progenitors.push_back(progen);
+    }
+
+    if (error == NULL && (!readLine(fd, &line, &cap, &lineno) || !readModelList(line, "report", models, reported)))
+        error = "expected report models";
+    if (error == NULL && (!readLine(fd, &line, &cap, &lineno) || !readModelList(line, "kept", models, kept)))
+        error = "expected kept models";
+    if (error == NULL && (!readLine(fd, &line, &cap, &lineno) || strcmp(line, "end") != 0))
+        error = "checkpoint is incomplete";
+    free(line);
+    fclose(fd);
+    if (error != NULL) {
+        printf("Error in checkpoint %s, line %d: %s\n", filename, lineno, error);
+        return NULL;
+    }
+
+    int topID = 0;
+    for (size_t m = 0; m < models.size(); m++) {
+        models[m]->setProgenitor(progenitors[m] >= 0 ? models[progenitors[m]] : NULL);
+        if (models[m]->getID() > topID)
+            topID = models[m]->getID();
+    }
+    if (maxID)
+        *maxID = topID;
+    if (report) {
+        for (size_t i = 0; i < reported.size(); i++)
+            report->addModel(reported[i]);
+    }
+    Model **result = new Model*[kept.size() + 1];
+    for (size_t i = 0; i < kept.size(); i++)
+        result[i] = kept[i];
+    result[kept.size()] = NULL;
+    return result;
+}
@@ -0,0 +1,357 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "SearchEngine.h"
+#include "AttributeList.h"
+#include "Constants.h"
+#include "ManagerBase.h"
+#include "Model.h"
+#include "SearchBase.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <math.h>
+#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * SearchEngine.cpp - the beam search. Candidates are ranked on a heap, keyed by the
+ * sort attribute (negated for a descending sort) and then by name, so the order
+ * kept does not depend on the order the models were generated in.
+ */
+
+struct BeamCandidate {
+    double key;
+    const char *name;
+    Model *model;
+};
+
+//-- heap order: the smallest key (then name) is on top
+static bool beamAfter(const BeamCandidate &a, const BeamCandidate &b) {
+    if (a.key != b.key)
+        return a.key > b.key;
+    return strcmp(a.name, b.name) > 0;
+}
+
+SearchEngine::SearchEngine(ManagerBase *mgr, SearchBase *search) :
+        manager(mgr), searcher(search), pool(NULL), sortAttr(NULL), sortAttrId(-1),
+        sortDirection(Direction::Ascending), width(3), levels(7), threadCount(1), incrementalAlpha(false),
+        clearCache(false), pruning(false), warmedUp(false), memoryWarned(false), seenModels(NULL),
+        levelGenerated(0), levelKept(0), totalGenerated(0), totalKept(0), levelPruned(0), totalPruned(0) {
+    setSortAttr(ATTRIBUTE_DDF);
+    double threads;
+    if (!manager->getOptionFloat("search-threads", NULL, &threads))
+        threads = ThreadPool::defaultThreadCount();
+    setThreadCount((int) threads);
+    const char *option;
+    setPruning(manager->getOptionString("search-prune", NULL, &option));
+    evaluator = [this](Model *model) {
+        manager->computeSortStatistic(model, sortAttr);
+    };
+}
+
+SearchEngine::~SearchEngine() {
+    delete pool;
+    delete[] sortAttr;
+}
+
+void SearchEngine::setSortAttr(const char *name) {
+    delete[] sortAttr;
+    sortAttr = new char[strlen(name) + 1];
+    strcpy(sortAttr, name);
+    sortAttrId = AttributeList::getAttributeId(sortAttr);
+}
+
+void SearchEngine::setThreadCount(int count) {
+    threadCount = count < 1 ? 1 : count;
+    if (pool && pool->getThreadCount() != threadCount) {
+        delete pool;
+        pool = NULL;
+    }
+}
+
+int SearchEngine::getThreadCount() {
+    return manager->isThreadSafe() ? threadCount : 1;
+}
+
+void SearchEngine::forEach(long count, const std::function<void(long)> &task) {
+    if (getThreadCount() <= 1 || count <= 1) {
+        for (long i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+    //-- the first task is run alone, so that whatever the manager computes
+    //-- on first use (reference model statistics, for instance) exists before
+    //-- several threads want it at once
+    long first = 0;
+    if (!warmedUp) {
+        task(0);
+        first = 1;
+        warmedUp = true;
+    }
+    if (pool == NULL)
+        pool = new ThreadPool(threadCount);
+    pool->run(count - first, [this, &task, first](long i) {
+        manager->bindWorkspace();
+        task(first + i);
+        manager->unbindWorkspace();
+    });
+}
+
+void SearchEngine::evaluate(Model **models, long count) {
+    forEach(count, [this, models](long i) {
+        evaluator(models[i]);
+    });
+}
+
+Model **SearchEngine::searchLevel(Model **models, long count, int level, bool clear) {
+    std::vector<BeamCandidate> heap;
+    std::vector<Model*> fresh, seen, pruned;
+    //-- the best "width" keys so far, largest on top; once full, its top is the cut-off
+    std::priority_queue<double> best;
+    bool prune = pruning && sortDirection == Direction::Descending && !incrementalAlpha;
+    levelGenerated = 0;
+    levelPruned = 0;
+    auto rank = [&](Model *model) {
+        BeamCandidate candidate;
+        candidate.key = model->getAttributeById(sortAttrId);
+        if (sortDirection == Direction::Descending)
+            candidate.key = -candidate.key;
+        candidate.name = model->getPrintName();
+        candidate.model = model;
+        heap.push_back(candidate);
+        std::push_heap(heap.begin(), heap.end(), beamAfter);
+        if ((long) best.size() < width) {
+            best.push(candidate.key);
+        } else if (candidate.key < best.top()) {
+            best.pop();
+            best.push(candidate.key);
+        }
+    };
+    for (long m = 0; m < count; m++) {
+        Model *progen = models[m];
+        Model **generated = searcher->search(progen);
+        if (generated == NULL)
+            continue;
+        //-- flag the new models first, so a model generated twice is evaluated once
+        fresh.clear();
+        seen.clear();
+        for (Model **gen = generated; *gen; gen++) {
+            Model *model = *gen;
+            bool first = model->getAttribute(ATTRIBUTE_PROCESSED) <= 0.0;
+            if (first) {
+                model->setAttribute(ATTRIBUTE_PROCESSED, 1.0);
+                model->setAttribute(ATTRIBUTE_LEVEL, level);
+                model->setProgenitor(progen);
+            }
+            if (seenModels ? seenModels->insert(std::make_pair(model, progen)).second : first) {
+                fresh.push_back(model);
+            } else {
+                seen.push_back(model);
+            }
+        }
+        delete[] generated;
+        levelGenerated += fresh.size();
+        if (!prune) {
+            evaluate(fresh.data(), fresh.size());
+            for (size_t i = 0; i < fresh.size(); i++) {
+                rank(fresh[i]);
+            }
+        } else {
+            //-- evaluate the best bounds first, a batch per thread, so the cut-off
+            //-- rises as early as possible; the bound of a model without one is infinite
+            std::vector<double> bounds(fresh.size());
+            forEach(fresh.size(), [&](long i) {
+                if (!manager->boundSortStatistic(fresh[i], sortAttr, &bounds[i]))
+                    bounds[i] = HUGE_VAL;
+            });
+            std::vector<long> order(fresh.size());
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](long a, long b) {
+                return bounds[a] > bounds[b];
+            });
+            long batch = getThreadCount();
+            std::vector<Model*> next;
+            for (size_t pos = 0; pos < order.size();) {
+                //-- a model whose bound is below the cut-off can't be kept, and nor
+                //-- can any after it; a tie may still be kept, by name
+                if ((long) best.size() >= width && -bounds[order[pos]] > best.top()) {
+                    for (; pos < order.size(); pos++)
+                        pruned.push_back(fresh[order[pos]]);
+                    break;
+                }
+                next.clear();
+                for (; pos < order.size() && (long) next.size() < batch; pos++)
+                    next.push_back(fresh[order[pos]]);
+                evaluate(next.data(), next.size());
+                for (size_t i = 0; i < next.size(); i++) {
+                    rank(next[i]);
+                }
+            }
+        }
+        //-- a model reached from another progenitor may have a better incremental alpha by this one
+        if (incrementalAlpha) {
+            for (size_t i = 0; i < seen.size(); i++) {
+                manager->compareProgenitors(seen[i], progen);
+            }
+        }
+        //-- no model is being fitted between progenitors, so tables can be evicted here
+        if (!manager->reclaimMemory() && !memoryWarned) {
+            printf("Warning: the data, relations and models alone take more than memory-limit\n");
+            memoryWarned = true;
+        }
+    }
+
+    //-- duplicates are found by structure hash, so the cost does not grow with the width.
+    //-- State-based models with different relations may still be equivalent, so those
+    //-- are also compared with each kept model.
+    std::vector<Model*> kept;
+    std::unordered_multimap<unsigned long long, Model*> keptByHash;
+    while (!heap.empty() && (long) kept.size() < width) {
+        std::pop_heap(heap.begin(), heap.end(), beamAfter);
+        Model *candidate = heap.back().model;
+        heap.pop_back();
+        bool duplicate = false;
+        unsigned long long key = candidate->getStructureHash();
+        auto range = keptByHash.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == candidate || it->second->hasSameStructure(candidate)) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate && candidate->isStateBased()) {
+            for (size_t i = 0; i < kept.size(); i++) {
+                if (kept[i]->isEquivalentTo(candidate)) {
+                    duplicate = true;
+                    break;
+                }
+            }
+        }
+        if (duplicate) {
+            if (clear)
+                manager->deleteModelFromCache(candidate);
+        } else {
+            kept.push_back(candidate);
+            keptByHash.insert(std::make_pair(key, candidate));
+        }
+    }
+    if (clear) {
+        for (size_t i = 0; i < heap.size(); i++) {
+            manager->deleteModelFromCache(heap[i].model);
+        }
+        for (size_t i = 0; i < pruned.size(); i++) {
+            manager->deleteModelFromCache(pruned[i]);
+        }
+    }
+
+    levelKept = kept.size();
+    levelPruned = pruned.size();
+    totalGenerated += levelGenerated;
+    totalKept += levelKept;
+    totalPruned += levelPruned;
+    Model **result = new Model*[kept.size() + 1];
+    std::copy(kept.begin(), kept.end(), result);
+    result[kept.size()] = NULL;
+    return result;
+}
+
+Model **SearchEngine::search(Model *start) {
+    std::vector<Model*> all;
+    Model **current = new Model*[2];
+    current[0] = start;
+    current[1] = NULL;
+    long count = 1;
+    for (int level = 1; level <= levels && count > 0; level++) {
+        Model **next = searchLevel(current, count, level, clearCache && level != levels);
+        delete[] current;
+        current = next;
+        for (count = 0; current[count]; count++)
+            all.push_back(current[count]);
+    }
+    delete[] current;
+    Model **result = new Model*[all.size() + 1];
+    std::copy(all.begin(), all.end(), result);
+    result[all.size()] = NULL;
+    return result;
+}
+
+MultiBeamSearch::MultiBeamSearch(ManagerBase *mgr, SearchBase *search) :
+        manager(mgr), searcher(search) {
+}
+
+MultiBeamSearch::~MultiBeamSearch() {
+    for (size_t b = 0; b < beams.size(); b++)
+        delete beams[b].engine;
+}
+
+SearchEngine *MultiBeamSearch::addBeam(const char *attr, Direction dir, int width) {
+    beams.push_back(Beam());
+    Beam &beam = beams.back();
+    beam.engine = new SearchEngine(manager, searcher);
+    beam.engine->setSortAttr(attr);
+    beam.engine->setSortDirection(dir);
+    beam.engine->setWidth(width);
+    return beam.engine;
+}
+
+bool MultiBeamSearch::addBeams(const char *list, int width) {
+    char *text = new char[strlen(list) + 1];
+    strcpy(text, list);
+    bool ok = true;
+    char *save;
+    for (char *item = strtok_r(text, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char attr[100], dir[20] = "descending";
+        if (sscanf(item, " %99[^: ] : %19s", attr, dir) < 1
+                || (strcmp(dir, "descending") != 0 && strcmp(dir, "ascending") != 0)) {
+            printf("Error: can't read search beam \"%s\"\n", item);
+            ok = false;
+            break;
+        }
+        addBeam(attr, strcmp(dir, "ascending") == 0 ? Direction::Ascending : Direction::Descending, width);
+    }
+    delete[] text;
+    return ok;
+}
+
+//-- the engines are given their seen sets here, once the beams won't move
+void MultiBeamSearch::start(Model *model) {
+    for (size_t b = 0; b < beams.size(); b++) {
+        beams[b].kept.assign(1, model);
+        beams[b].seen[model] = NULL;
+        beams[b].engine->setSeenModels(&beams[b].seen);
+    }
+}
+
+bool MultiBeamSearch::searchLevel(int level) {
+    bool any = false;
+    for (size_t b = 0; b < beams.size(); b++) {
+        Beam &beam = beams[b];
+        if (beam.kept.empty())
+            continue;
+        Model **next = beam.engine->searchLevel(beam.kept.data(), beam.kept.size(), level, false);
+        beam.kept.clear();
+        for (Model **model = next; *model; model++) {
+            beam.kept.push_back(*model);
+            beam.all.push_back(*model);
+        }
+        delete[] next;
+        if (!beam.kept.empty())
+            any = true;
+    }
+    return any;
+}
+
+Model *MultiBeamSearch::getProgenitor(int beam, Model *model) {
+    auto it = beams[beam].seen.find(model);
+    return it == beams[beam].seen.end() ? NULL : it->second;
+}
@@ -6,7 +6,9 @@
  */
 
 #include "StateConstraint.h"
+#include "Key.h"
 #include "_Core.h"
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +20,10 @@
  * This is used in state-based modeling, to specify in a relation which
  * of the cells have fixed values.
  *
+ * Lookups by key go through a sorted index over the constraints, so that
+ * projecting a table against a relation costs a binary search per tuple
+ * rather than a scan of every constraint. The index is built under a lock
+ * by the first lookup, since relations are shared by the search threads.
  */
 
 #define keyAddr(index) (constraints + (keysize * index))
@@ -29,6 +35,7 @@ StateConstraint::StateConstraint(int keysz, long size)
     if (maxConstraintCount == 0) maxConstraintCount = 1;
     constraintCount = 0;
     constraints = new KeySegment[keysize * maxConstraintCount];
+    sortedIndex = NULL;
 }
 
 
@@ -36,6 +43,7 @@ StateConstraint::~StateConstraint()
 {
     // delete storage
     delete[] constraints;
+    delete[] sortedIndex.load();
 }
 
 
@@ -50,6 +58,9 @@ void StateConstraint::addConstraint(KeySegment *key)
     KeySegment *addr = keyAddr(constraintCount);	// get the address of the next key
     memcpy(addr, key, keysize*sizeof(KeySegment)); // and copy the new one
     constraintCount++;
+    // the sorted index no longer covers every constraint. Constraints are only
+    // added while a relation is made, before any other thread can see it.
+    delete[] sortedIndex.exchange(NULL);
 }
 
 
@@ -74,3 +85,41 @@ int StateConstraint::getKeySize()
 }
 
 
+// sort the constraint indices by key, so they can be binary searched. Another
+// thread may have built the index while this one waited for the lock.
+long *StateConstraint::buildIndex()
+{
+    std::lock_guard<std::mutex> guard(indexLock);
+    long *index = sortedIndex.load(std::memory_order_acquire);
+    if (index != NULL) return index;
+    index = new long[constraintCount];
+    for (long i = 0; i < constraintCount; i++) {
+        index[i] = i;
+    }
+    KeySegment *base = constraints;
+    int ksize = keysize;
+    std::sort(index, index + constraintCount, [base, ksize](long a, long b) {
+        return Key::compareKeys(base + ksize * a, base + ksize * b, ksize) < 0;
+    });
+    sortedIndex.store(index, std::memory_order_release);
+    return index;
+}
+
+
+// find the constraint matching the key; -1 if there is none
+long StateConstraint::indexOf(KeySegment *key)
+{
+    if (constraintCount == 0) return -1;
+    long *index = sortedIndex.load(std::memory_order_acquire);
+    if (index == NULL) index = buildIndex();
+    long top = 0;
+    long bottom = constraintCount - 1;
+    while (top <= bottom) {
+        long mid = (top + bottom) / 2;
+        int compare = Key::compareKeys(keyAddr(index[mid]), key, keysize);
+        if (compare == 0) return index[mid];
+        if (compare > 0) bottom = mid - 1;
+        else top = mid + 1;
+    }
+    return -1;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "StatsCache.h"
+#include "Relation.h"
+#include "Table.h"
+#include "VariableList.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * StatsCache.cpp - file format:
+ *     header:  "OCSTATS1", fingerprint (8 bytes), keysize (4 bytes)
+ *     records: mask (keysize KeySegments), h, df (doubles), tuple count (8 bytes,
+ *              -1 for none), then the tuples, each keysize KeySegments and a double.
+ * The file is only read and appended to by machines of the same architecture, as
+ * the fingerprint covers the raw key and value bytes. A short last record (from a
+ * run that was killed while writing) is ignored.
+ * Several runs may share a file. Each holds an exclusive flock() while it writes
+ * the header or appends a record, so records are never interleaved, and a table is
+ * only read after the header of its record has been checked.
+ */
+
+static const char CACHE_MAGIC[8] = { 'O', 'C', 'S', 'T', 'A', 'T', 'S', '1' };
+
+//-- holds an advisory lock on the cache file while in scope. If the file system
+//-- doesn't support locking, the cache is used unlocked.
+class CacheLock {
+    public:
+        CacheLock(FILE *file) :
+                fd(fileno(file)) {
+            while (flock(fd, LOCK_EX) != 0 && errno == EINTR)
+                ;
+        }
+        ~CacheLock() {
+            flock(fd, LOCK_UN);
+        }
+    private:
+        int fd;
+};
+
+//-- write all of buf, which write() may do in pieces
+static bool writeAll(int fd, const char *buf, size_t count)
+{
+    while (count > 0) {
+        ssize_t n = write(fd, buf, count);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        count -= n;
+    }
+    return true;
+}
+
+//-- FNV-1a, 64 bit
+static unsigned long long hashBytes(unsigned long long hash, const void *bytes, size_t count)
+{
+    const unsigned char *cp = (const unsigned char *) bytes;
+    for (size_t i = 0; i < count; i++) {
+        hash ^= cp[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+unsigned long long StatsCache::fingerprint(VariableList *vars, Table *data)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int varCount = vars->getVarCount();
+    hash = hashBytes(hash, &varCount, sizeof(varCount));
+    for (int i = 0; i < varCount; i++) {
+        Variable *var = vars->getVariable(i);
+        hash = hashBytes(hash, &var->cardinality, sizeof(var->cardinality));
+        hash = hashBytes(hash, &var->dv, sizeof(var->dv));
+        hash = hashBytes(hash, var->abbrev, strlen(var->abbrev));
+    }
+    int keysize = data->getKeySize();
+    long long count = data->getTupleCount();
+    hash = hashBytes(hash, &keysize, sizeof(keysize));
+    hash = hashBytes(hash, &count, sizeof(count));
+    for (long long i = 0; i < count; i++) {
+        double value = data->getValue(i);
+        hash = hashBytes(hash, data->getKey(i), keysize * sizeof(KeySegment));
+        hash = hashBytes(hash, &value, sizeof(value));
+    }
+    return hash;
+}
+
+
+StatsCache::StatsCache(const char *dir, VariableList *vars, Table *data, bool tables)
+{
+    file = NULL;
+    keysize = vars->getKeySize();
+    saveTables = tables;
+    hits = misses = 0;
+
+    unsigned long long print = fingerprint(vars, data);
+    mkdir(dir, 0777); // ok if it already exists
+    char path[strlen(dir) + 40];
+    sprintf(path, "%s/%016llx.occstats", dir, print);
+
+    file = fopen(path, "a+b");
+    if (file == NULL) {
+        printf("Warning: couldn't open statistics cache %s\n", path);
+        return;
+    }
+    bool usable = true;
+    {
+        CacheLock lock(file);
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0) {
+            fwrite(CACHE_MAGIC, sizeof(CACHE_MAGIC), 1, file);
+            fwrite(&print, sizeof(print), 1, file);
+            fwrite(&keysize, sizeof(keysize), 1, file);
+            fflush(file);
+        } else {
+            usable = load(print);
+        }
+    }
+    if (!usable) {
+        printf("Warning: statistics cache file is not usable; caching disabled\n");
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+StatsCache::~StatsCache()
+{
+    if (file) fclose(file);
+}
+
+
+bool StatsCache::load(unsigned long long expected)
+{
+    char magic[sizeof(CACHE_MAGIC)];
+    unsigned long long print;
+    int fileKeysize;
+    rewind(file);
+    if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0
+            || fread(&print, sizeof(print), 1, file) != 1 || print != expected
+            || fread(&fileKeysize, sizeof(fileKeysize), 1, file) != 1 || fileKeysize != keysize) {
+        return false;
+    }
+    std::vector<KeySegment> mask(keysize);
+    long tupleBytes = keysize * sizeof(KeySegment) + sizeof(double);
+    while (true) {
+        Entry entry;
+        if (fread(mask.data(), sizeof(KeySegment), keysize, file) != (size_t) keysize
+                || fread(&entry.h, sizeof(double), 1, file) != 1
+                || fread(&entry.df, sizeof(double), 1, file) != 1
+                || fread(&entry.tupleCount, sizeof(long long), 1, file) != 1)
+            break;
+        entry.tableOffset = ftell(file);
+        if (entry.tupleCount > 0) {
+            //-- make sure the whole table is there before accepting the record
+            if (fseek(file, entry.tupleCount * tupleBytes - 1, SEEK_CUR) != 0 || fgetc(file) == EOF)
+                break;
+        }
+        entries[std::string((const char *) mask.data(), keysize * sizeof(KeySegment))] = entry;
+    }
+    clearerr(file);
+    return true;
+}
+
+
+bool StatsCache::cacheable(Relation *rel)
+{
+    return file != NULL && !rel->isStateBased();
+}
+
+
+std::string StatsCache::maskKey(Relation *rel)
+{
+    return std::string((const char *) rel->getMask(), keysize * sizeof(KeySegment));
+}
+
+
+bool StatsCache::findStatistics(Relation *rel, double *h, double *df)
+{
+    if (!cacheable(rel)) return false;
+    std::map<std::string, Entry>::iterator it = entries.find(maskKey(rel));
+    if (it == entries.end()) {
+        misses++;
+        return false;
+    }
+    hits++;
+    *h = it->second.h;
+    *df = it->second.df;
+    return true;
+}
+
+
+Table *StatsCache::findTable(Relation *rel)
+{
+    if (!cacheable(rel)) return NULL;
+    std::map<std::string, Entry>::iterator it = entries.find(maskKey(rel));
+    if (it == entries.end() || it->second.tupleCount < 0) return NULL;
+    long long count = it->second.tupleCount;
+
+    //-- make sure the record there is the one indexed, before trusting its table
+    std::vector<KeySegment> mask(keysize);
+    double h, df;
+    long long fileCount;
+    if (fseek(file, it->second.tableOffset - headerBytes(), SEEK_SET) != 0
+            || fread(mask.data(), sizeof(KeySegment), keysize, file) != (size_t) keysize
+            || fread(&h, sizeof(double), 1, file) != 1 || fread(&df, sizeof(double), 1, file) != 1
+            || fread(&fileCount, sizeof(long long), 1, file) != 1
+            || memcmp(mask.data(), it->first.data(), it->first.size()) != 0
+            || h != it->second.h || df != it->second.df || fileCount != count) {
+        printf("Warning: statistics cache record for %s is damaged; ignoring it\n", rel->getPrintName());
+        it->second.tupleCount = -1;
+        return NULL;
+    }
+    Table *table = new Table(keysize, count > 0 ? count : 1);
+    KeySegment key[keysize];
+    double value;
+    for (long long i = 0; i < count; i++) {
+        if (fread(key, sizeof(KeySegment), keysize, file) != (size_t) keysize
+                || fread(&value, sizeof(double), 1, file) != 1) {
+            delete table;
+            return NULL;
+        }
+        table->addTuple(key, value);
+    }
+    return table;
+}
+
+
+void StatsCache::addStatistics(Relation *rel, double h, double df)
+{
+    if (!cacheable(rel)) return;
+    std::string key = maskKey(rel);
+    if (entries.find(key) != entries.end()) return;
+
+    Table *table = saveTables ? rel->getTable() : NULL;
+    Entry entry;
+    entry.h = h;
+    entry.df = df;
+    entry.tupleCount = table ? table->getTupleCount() : -1;
+
+    long tupleBytes = keysize * sizeof(KeySegment) + sizeof(double);
+    long headBytes = headerBytes();
+    long long count = table ? entry.tupleCount : 0;
+    std::vector<char> record(headBytes + count * tupleBytes);
+    char *cp = record.data();
+    memcpy(cp, key.data(), key.size());
+    cp += key.size();
+    memcpy(cp, &entry.h, sizeof(double));
+    cp += sizeof(double);
+    memcpy(cp, &entry.df, sizeof(double));
+    cp += sizeof(double);
+    memcpy(cp, &entry.tupleCount, sizeof(long long));
+    cp += sizeof(long long);
+    for (long long i = 0; i < count; i++) {
+        double value = table->getValue(i);
+        memcpy(cp, table->getKey(i), keysize * sizeof(KeySegment));
+        cp += keysize * sizeof(KeySegment);
+        memcpy(cp, &value, sizeof(double));
+        cp += sizeof(double);
+    }
+    //-- the file is opened for appending, so each write goes to its end. Other runs
+    //-- hold the lock while they append, so the record is in one piece, and it
+    //-- ends at the file position after the last write.
+    off_t end;
+    {
+        CacheLock lock(file);
+        fflush(file);
+        if (!writeAll(fileno(file), record.data(), record.size()))
+            return;
+        end = lseek(fileno(file), 0, SEEK_CUR);
+    }
+    if (end < 0)
+        return;
+    entry.tableOffset = end - record.size() + headBytes;
+    entries[key] = entry;
+}
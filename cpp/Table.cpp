@@ -5,14 +5,17 @@
  * distribution of this software for license terms.
  */
 
+#include "ColumnFile.h"
 #include "Key.h"
 #include "Table.h"
+#include "VariableList.h"
 #include "_Core.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 const long long GROWTH_FACTOR = 2;
 
@@ -50,12 +53,33 @@ Table::Table(int keysz, long long maxTuples, TableType typ)
     tupleCount = 0;
     data = new char[TupleBytes * maxTuples];
     memset(data, 0, TupleBytes * maxTuples * sizeof(char));
+    accounted = 0;
+    category = MemoryCategory::Tables;
+    accountStorage();
 }
 
 
 Table::~Table()
 {
     if (data) delete [] (char*)data;
+    MemoryAccount::release(category, accounted);
+}
+
+
+void Table::setMemoryCategory(MemoryCategory cat)
+{
+    if (cat == category) return;
+    MemoryAccount::release(category, accounted);
+    MemoryAccount::add(cat, accounted);
+    category = cat;
+}
+
+
+void Table::accountStorage()
+{
+    long long bytes = TupleBytes * maxTupleCount;
+    MemoryAccount::add(category, bytes - accounted);
+    accounted = bytes;
 }
 
 
@@ -70,6 +94,7 @@ void Table::copy(const Table* from)
     while (from->tupleCount > maxTupleCount) {
         data = growStorage(data, maxTupleCount*TupleBytes, GROWTH_FACTOR);
         maxTupleCount *= GROWTH_FACTOR;
+        accountStorage();
     }
     memcpy(data, from->data, TupleBytes * maxTupleCount);
     tupleCount = from->tupleCount;
@@ -85,6 +110,7 @@ void Table::addTuple(KeySegment *key, double value)
     while (tupleCount >= maxTupleCount) {
         data = growStorage(data, maxTupleCount*TupleBytes, GROWTH_FACTOR);
         maxTupleCount *= GROWTH_FACTOR;
+        accountStorage();
     }
     KeySegment *keyptr = KeyPtr(data, keysize, tupleCount);
     memcpy(keyptr, key, sizeof(KeySegment) * keysize);			// copy key
@@ -103,6 +129,7 @@ void Table::insertTuple(KeySegment *key, double value, long long index)
     while (tupleCount >= maxTupleCount) {
         data = growStorage(data, maxTupleCount*TupleBytes, GROWTH_FACTOR);
         maxTupleCount *= GROWTH_FACTOR;
+        accountStorage();
     }
     if (index < tupleCount) {
         void* dest = KeyPtr(data, keysize, index + 1);
@@ -182,6 +209,20 @@ void Table::copyKey(long long index, KeySegment *key)
 }
 
 
+/**
+ * copyValues - copy a run of values into the caller's storage
+ */
+long long Table::copyValues(long long index, long long count, double *values)
+{
+    if (index < 0) return 0;
+    if (index + count > tupleCount) count = tupleCount - index;
+    for (long long i = 0; i < count; i++) {
+        values[i] = (double) *(ValuePtr(data, keysize, index + i));
+    }
+    return count > 0 ? count : 0;
+}
+
+
 /**
  * indexOf - search the table for the given key, and return the index. Returns -1 if not
  * found. This function assumes the keys are sorted, and does a binary search.
@@ -224,20 +265,19 @@ long long Table::indexOf(KeySegment *key, bool matchOnly)
 
 /**
  * sort() - sort the tuples by key value (to allow binary search).  This uses
- * the Unix QuickSort function qsort. We need a little adaptor function for the
- * comparator, because compareKeys isn't quite right
+ * qsort_r, which passes the key size through to the comparator, so tables can
+ * be sorted on several threads at once. We need a little adaptor function for
+ * the comparator, because compareKeys isn't quite right
  */
-static int sortKeySize;	// must be set before calling sortCompare
-static int sortCompare(const void *k1, const void *k2)
+static int sortCompare(const void *k1, const void *k2, void *keysize)
 {
-    return Key::compareKeys((KeySegment *)k1, (KeySegment *)k2, sortKeySize);
+    return Key::compareKeys((KeySegment *)k1, (KeySegment *)k2, *(int *)keysize);
 }
 
 
 void Table::sort()
 {
-    sortKeySize = keysize;
-    qsort(data, tupleCount, TupleBytes, sortCompare);
+    qsort_r(data, tupleCount, TupleBytes, sortCompare, &keysize);
 }
 
 
@@ -314,3 +354,46 @@ void Table::dump(bool detail)
     printf("p total (should be 1.00): %lg<br>", sum);
 }
 
+
+
+bool Table::writeColumns(const char *filename, VariableList *vars)
+{
+    ColumnFileWriter writer;
+    if (!writer.open(filename, ColumnFileTable))
+        return false;
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rows = tupleCount;
+    header.columns = vars->getVarCount();
+    header.keySize = keysize;
+    header.keySegmentBytes = sizeof(KeySegment);
+
+    //-- the tuples are stored key and value together; split them into two sections
+    std::vector<KeySegment> keys((size_t) tupleCount * keysize);
+    std::vector<double> values(tupleCount);
+    for (long long i = 0; i < tupleCount; i++) {
+        memcpy(&keys[(size_t) i * keysize], KeyPtr(data, keysize, i), keysize * sizeof(KeySegment));
+        values[i] = *ValuePtr(data, keysize, i);
+    }
+    header.rowIdsOffset = writer.write(keys.data(), keys.size() * sizeof(KeySegment));
+    header.valuesOffset = writer.write(values.data(), values.size() * sizeof(double));
+
+    std::vector<ColumnFileVariable> columns(header.columns);
+    for (int v = 0; v < vars->getVarCount(); v++) {
+        Variable *var = vars->getVariable(v);
+        std::vector<uint64_t> states(var->cardinality);
+        for (int s = 0; s < var->cardinality; s++)
+            states[s] = writer.addString(vars->getVarValue(v, s));
+        ColumnFileVariable &column = columns[v];
+        column.name = writer.addString(var->name);
+        column.abbrev = writer.addString(var->abbrev);
+        column.mask = var->mask;
+        column.cardinality = var->cardinality;
+        column.segment = var->segment;
+        column.shift = var->shift;
+        column.dv = var->dv ? 1 : 0;
+        column.stateNames = writer.write(states.data(), states.size() * sizeof(uint64_t));
+    }
+    header.columnsOffset = writer.write(columns.data(), columns.size() * sizeof(ColumnFileVariable));
+    return writer.finish(header);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#include "ThreadPool.h"
+#include <stddef.h>
+
+/**
+ * ThreadPool.cpp - workers sleep between batches. Tasks are handed out one index
+ * at a time under the lock; the tasks run here (fitting a model, for instance)
+ * are long enough that the locking is not significant.
+ */
+
+//-- batches being run on this thread; more than one if a task runs a batch of its own
+static thread_local int batchDepth = 0;
+
+//-- run one task of a batch, marking this thread as inside the batch meanwhile
+static void runInBatch(const std::function<void(long)> &fn, long i) {
+    batchDepth++;
+    fn(i);
+    batchDepth--;
+}
+
+ThreadPool::ThreadPool(int threadCount) :
+        task(NULL), taskCount(0), nextTask(0), generation(0), busy(0), stopping(false) {
+    for (int i = 1; i < threadCount; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+bool ThreadPool::inBatch() {
+    return batchDepth > 0;
+}
+
+int ThreadPool::defaultThreadCount() {
+    int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void ThreadPool::run(long count, const std::function<void(long)> &fn) {
+    if (workers.empty() || count <= 1) {
+        for (long i = 0; i < count; i++) {
+            runInBatch(fn, i);
+        }
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        task = &fn;
+        taskCount = count;
+        nextTask = 0;
+        busy = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    runTasks();
+    std::unique_lock<std::mutex> guard(lock);
+    while (busy > 0) {
+        done.wait(guard);
+    }
+    task = NULL;
+}
+
+//-- take indices from the current batch until it is exhausted
+void ThreadPool::runTasks() {
+    for (;;) {
+        long i;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (nextTask >= taskCount)
+                return;
+            i = nextTask++;
+        }
+        runInBatch(*task, i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!stopping && generation == seen) {
+                wake.wait(guard);
+            }
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        runTasks();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            busy--;
+        }
+        done.notify_one();
+    }
+}
@@ -13,6 +13,8 @@
 #include "Report.h"
 #include "SearchBase.h"
 #include "VBMManager.h"
+#include "Table.h"
+#include "ThreadPool.h"
 
 #include <assert.h>
 #include <math.h>
@@ -20,6 +22,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+//-- BP transmission splits its pass over the input across threads above this size
+static const long long BP_PARALLEL_MIN_TUPLES = 1 << 15;
+
 VBMManager::VBMManager(VariableList *vars, Table *input) :
         ManagerBase(vars, input) {
     topRef = bottomRef = refModel = NULL;
@@ -122,8 +131,7 @@ Model *VBMManager::makeChildModel(Model *model, int remove, bool *fromCache, boo
     }
     //-- return one from cache if possible
     if (!modelCache->addModel(newModel)) {
-        const char *name = newModel->getPrintName();
-        Model *cacheModel = modelCache->findModel(name);
+        Model *cacheModel = modelCache->findModel(newModel);
         delete newModel;
         newModel = cacheModel;
         if (fromCache)
@@ -399,6 +407,99 @@ void VBMManager::setSearch(const char *name) {
     search = SearchFactory::getSearchMethod(this, name, makeProjection());
 }
 
+double VBMManager::computeHLowerBound(Model *model) {
+    if (!hasLoops(model))
+        return computeH(model);
+    //-- for any variable x, the model {V-x, N(x)}, where N(x) is x and every variable
+    //-- sharing a relation with it, contains this one and is loopless. Containing
+    //-- more constraints, its H is no greater.
+    int varCount = varList->getVarCount();
+    int relCount = model->getRelationCount();
+    double topH = computeH(topRef);
+    double bound = topH;
+    std::vector<int> rest(varCount), near(varCount), sep(varCount);
+    std::vector<bool> inNear(varCount);
+    for (int x = 0; x < varCount; x++) {
+        std::fill(inNear.begin(), inNear.end(), false);
+        inNear[x] = true;
+        for (int r = 0; r < relCount; r++) {
+            Relation *rel = model->getRelation(r);
+            if (rel->findVariable(x) < 0)
+                continue;
+            for (int v = 0; v < rel->getVariableCount(); v++)
+                inNear[rel->getVariable(v)] = true;
+        }
+        int restCount = 0, nearCount = 0, sepCount = 0;
+        for (int v = 0; v < varCount; v++) {
+            if (v != x)
+                rest[restCount++] = v;
+            if (inNear[v])
+                near[nearCount++] = v;
+            if (inNear[v] && v != x)
+                sep[sepCount++] = v;
+        }
+        if (nearCount == varCount)
+            continue; // the cover is the top model
+        double h = computeH(getRelation(rest.data(), restCount)) + computeH(getRelation(near.data(), nearCount));
+        if (sepCount > 0)
+            h -= computeH(getRelation(sep.data(), sepCount));
+        if (h > bound)
+            bound = h;
+    }
+    return bound;
+}
+
+//-- IPF stops once no cell of a fitted relation is off from the data by more than
+//-- delta (ipf-maxdev, as a probability, as makeFitTableIPF scales it). Taken over the
+//-- cells of the input data, the fit then differs from the exact one by a total
+//-- variation of at most t = delta * cells / 2, and so, by the Fannes-Audenaert
+//-- inequality, its H by at most t log2(cells - 1) + h(t).
+double VBMManager::computeIPFAllowance() {
+    double delta = 0.25;
+    getOptionFloat("ipf-maxdev", NULL, &delta);
+    delta /= sampleSize > 0 ? sampleSize : 1000;
+    double cells = (double) inputData->getTupleCount();
+    if (cells < 2)
+        cells = 2;
+    double t = fmin(0.5, delta * cells / 2);
+    if (t <= 0)
+        return 0;
+    return t * log2(cells - 1) - t * log2(t) - (1 - t) * log2(1 - t);
+}
+
+bool VBMManager::boundSortStatistic(Model *model, const char *attr, double *upper) {
+    bool info = strcmp(attr, ATTRIBUTE_EXPLAINED_I) == 0;
+    bool aic = strcmp(attr, ATTRIBUTE_AIC) == 0;
+    bool bic = strcmp(attr, ATTRIBUTE_BIC) == 0;
+    if (!info && !aic && !bic)
+        return false;
+    if (!info && refModel != bottomRef && refModel != topRef)
+        return false;
+    //-- a loopless model's H is computed exactly, and no more cheaply than its bound
+    if (!hasLoops(model))
+        return false;
+    //-- each of these decreases as H (and so T) increases. The bound is exact for the
+    //-- maximum entropy fit; IPF only comes within computeIPFAllowance of it.
+    double lowT = computeHLowerBound(model) - computeIPFAllowance() - inputH;
+    if (info) {
+        double topH = topRef->getAttribute(ATTRIBUTE_H);
+        double botH = bottomRef->getAttribute(ATTRIBUTE_H);
+        if (topH < 0 || botH < 0)
+            return false;
+        *upper = fmin(1.0, (botH - topH - lowT) / (botH - topH));
+        return true;
+    }
+    double ddfCost = (aic ? 2.0 : log(sampleSize)) * computeDDF(model);
+    double refT = computeTransmission(refModel);
+    if (refModel == bottomRef) {
+        *upper = 2.0 * M_LN2 * sampleSize * (refT - lowT) - ddfCost;
+    } else {
+        //-- relative to the top, the signs of aic and bic are flipped
+        *upper = ddfCost - fmax(0.0, 2.0 * M_LN2 * sampleSize * (lowT - refT));
+    }
+    return true;
+}
+
 void VBMManager::computeDFStatistics(Model *model) {
     computeDF(model);
     computeDDF(model);
@@ -448,7 +549,7 @@ void VBMManager::computeL2Statistics(Model *model) {
 
         double refL2Prob = model->getAttribute(ATTRIBUTE_ALPHA);
         if (refL2Prob < 0) {
-            refL2Prob = csa(refL2, refDDF);
+            refL2Prob = ocChiSquaredAlpha(refL2, refDDF);
             model->setAttribute(ATTRIBUTE_ALPHA, refL2Prob);
         }
 
@@ -461,12 +562,12 @@ void VBMManager::computeL2Statistics(Model *model) {
             if (!getOptionFloat("palpha", NULL, &alpha))
                 alpha = 0.0;
             if (alpha > 0)
-                critX2 = ppchi(alpha, refDDF, &errcode);
+                critX2 = ocChiSquaredCritical(alpha, refDDF, &errcode);
             else
                 critX2 = refL2;
             if (errcode)
                 printf("ppchi: errcode=%d\n", errcode);
-            refL2Power = 1.0 - chin2(critX2, refDDF, refL2, &errcode);
+            refL2Power = ocChiSquaredPower(critX2, refDDF, refL2, &errcode);
             model->setAttribute(ATTRIBUTE_BETA, refL2Power);
         }
 
@@ -490,22 +591,63 @@ void VBMManager::computeL2Statistics(Model *model) {
     }
 }
 
+void VBMManager::computeL2Statistics(Model **models, long count) {
+    double alpha;
+    if (!getOptionFloat("palpha", NULL, &alpha))
+        alpha = 0.0;
+    //-- gather the models still missing alpha or power
+    long pending = 0;
+    long *which = new long[count];
+    double *refL2 = new double[count];
+    double *refDDF = new double[count];
+    for (long i = 0; i < count; i++) {
+        Model *model = models[i];
+        if (model->getAttribute(ATTRIBUTE_ALPHA) >= 0 && model->getAttribute(ATTRIBUTE_BETA) >= 0)
+            continue;
+        computeInformationStatistics(model);
+        which[pending] = i;
+        refL2[pending] = computeLR(model);
+        refDDF[pending] = computeDDF(model);
+        pending++;
+    }
+    double *alphas = new double[pending];
+    double *powers = new double[pending];
+    ocChiSquaredAlphaPower(pending, refL2, refDDF, alpha, alphas, powers);
+    for (long j = 0; j < pending; j++) {
+        Model *model = models[which[j]];
+        if (model->getAttribute(ATTRIBUTE_ALPHA) < 0)
+            model->setAttribute(ATTRIBUTE_ALPHA, alphas[j]);
+        if (model->getAttribute(ATTRIBUTE_BETA) < 0)
+            model->setAttribute(ATTRIBUTE_BETA, powers[j]);
+    }
+    delete[] which;
+    delete[] refL2;
+    delete[] refDDF;
+    delete[] alphas;
+    delete[] powers;
+    //-- the rest (AIC, BIC) is per model; alpha and power are now already set
+    for (long i = 0; i < count; i++) {
+        computeL2Statistics(models[i]);
+    }
+}
+
 void VBMManager::computePearsonStatistics(Model *model) {
     //-- these statistics require a full contingency table, so make
     //-- sure one has been created.
     if (model == NULL || bottomRef == NULL)
         return;
     makeFitTable(model);
-    Table *modelFitTable = new Table(keysize, fitTable1->getTupleCount());
-    modelFitTable->copy(fitTable1);
+    FitWorkspace *ws = getWorkspace();
+    Table *modelFitTable = new Table(keysize, ws->fitTable1->getTupleCount());
+    modelFitTable->copy(ws->fitTable1);
     makeFitTable(bottomRef);
     double modelP2 = ocPearsonChiSquared(inputData, modelFitTable, (long) round(sampleSize));
-    double refP2 = ocPearsonChiSquared(inputData, fitTable1, (long) round(sampleSize));
+    double refP2 = ocPearsonChiSquared(inputData, ws->fitTable1, (long) round(sampleSize));
 
     int errcode;
     double refDDF = computeDDF(model);
     double refModelP2 = refP2 - modelP2;
-    double refP2Prob = csa(refModelP2, refDDF);
+    double refP2Prob = ocChiSquaredAlpha(refModelP2, refDDF);
 
     double critX2, refP2Power;
 
@@ -514,12 +656,12 @@ void VBMManager::computePearsonStatistics(Model *model) {
     if (!getOptionFloat("palpha", NULL, &alpha))
         alpha = 0.0;
     if (alpha > 0)
-        critX2 = ppchi(alpha, refDDF, &errcode);
+        critX2 = ocChiSquaredCritical(alpha, refDDF, &errcode);
     else
         critX2 = modelP2;
     if (errcode)
         printf("ppchi: errcode=%d\n", errcode);
-    refP2Power = 1.0 - chin2(critX2, refDDF, modelP2, &errcode);
+    refP2Power = ocChiSquaredPower(critX2, refDDF, modelP2, &errcode);
 
     //if (errcode) printf("chin2: errcode=%d\n", errcode);
     //?? do something with these returned errors
@@ -564,96 +706,26 @@ double VBMManager::computeBPT(Model *model) {
     // The count of origin terms which much still be deducted for normalization
     // is maintained, and the q values corrected at the end.
 
-    class BPIntersectProcessor: public ocIntersectProcessor {
-        public:
-            BPIntersectProcessor(Table *inData, double fullDim) {
-                inputData = inData;
-                keysize = inputData->getKeySize();
-                qData = new Table(keysize, inputData->getTupleCount());
-                fullDimension = fullDim;
-                originTerms = 0;
-                relCount = 0;
-            }
-
-            void reset(int rels) {
-                qData->reset(keysize);
-
-                //-- seed the computed table with the tuples from the input data,
-                //-- but with zero values. These are the only tuples we care about.
-                for (int i = 0; i < inputData->getTupleCount(); i++) {
-                    KeySegment *key = inputData->getKey(i);
-                    qData->addTuple(key, 0);
-                }
-
-                //-- keep track of the total probability so we can deduct
-                //-- the appropriate number of origin terms.
-                originTerms = 0;
-
-                relCount = rels;
-            }
-
-            virtual ~BPIntersectProcessor() {
-                delete qData;
-            }
+    //
+    // The intersection terms are collected first, each with its index column into
+    // the input data, and then every q is computed in one pass over the input tuples.
+    // Tuples are independent, so large inputs are split across threads; each q still
+    // adds its terms in the order they were generated.
 
+    class BPTermProcessor: public ocIntersectProcessor {
+        public:
+            struct Term {
+                Relation *rel;
+                bool sign;
+                int count;
+            };
             virtual void process(bool sign, Relation *rel, int count) {
-                for (int counter = 0; counter < count; counter++) {
-                    KeySegment key[keysize];
-                    double qi, q;
-                    //-- get the orthogonal dimension of the relation (the number of states projected into one substate)
-                    double relDimension = fullDimension / (ocDegreesOfFreedom(rel) + 1);
-                    //-- add the scaled contribution to each q
-                    for (int i = 0; i < qData->getTupleCount(); i++) {
-                        qData->copyKey(i, key);
-                        q = qData->getValue(i);
-                        KeySegment *mask = rel->getMask();
-                        for (int k = 0; k < keysize; k++)
-                            key[k] |= mask[k];
-                        int j = rel->getTable()->indexOf(key);
-                        if (j >= 0) {
-                            qi = (sign ? 1 : -1) * (rel->getTable()->getValue(j) / relDimension);
-                            qData->setValue(i, qi + q);
-                        }
-                    }
-                    originTerms += (sign ? 1 : -1);
-                }
+                Term term = { rel, sign, count };
+                terms.push_back(term);
             }
-
-            double getTransmission() {
-                correctOriginTerms();
-
-                double t, p, q;
-                t = 0;
-                for (long i = 0; i < inputData->getTupleCount(); i++) {
-                    long j = qData->indexOf(inputData->getKey(i));
-                    p = inputData->getValue(i);
-                    q = qData->getValue(j);
-                    if (p > 0 && q > 0)
-                        t += p * log(p / q);
-                }
-                t /= log(2.0);
-                return t;
-            }
-
-            void correctOriginTerms() {
-                double q;
-                double originTerm = ((double) (originTerms - 1)) / fullDimension;
-                for (long i = 0; i < qData->getTupleCount(); i++) {
-                    q = qData->getValue(i);
-                    q -= originTerm;
-                    qData->setValue(i, q);
-                }
-            }
-
-            Table *qData, *inputData;
-            double fullDimension;
-            int keysize;
-            int relCount;
-            int originTerms;
+            std::vector<Term> terms;
     };
 
-    static BPIntersectProcessor *processor = NULL;
-
     //-- see if we did this already.
     double modelT = model->getAttribute(ATTRIBUTE_BP_T);
     if (modelT >= 0)
@@ -661,29 +733,81 @@ double VBMManager::computeBPT(Model *model) {
 
     double fullDimension = ocDegreesOfFreedom(topRef->getRelation(0)) + 1;
 
-    //-- because we clear the cache periodically, we have to force
-    //-- creation of all projections here
-    int relCount = model->getRelationCount();
-    int r;
-    class Relation *rel;
-    for (r = 0; r < relCount; r++) {
-        rel = model->getRelation(r);
-        ManagerBase::makeProjection(rel);
+    BPTermProcessor processor;
+    FitWorkspace *ws = getWorkspace();
+    if (ws->intersectArray != NULL) {
+        delete[] ws->intersectArray;
+        ws->intersectCount = 0;
+        ws->intersectMax = model->getRelationCount();
+        ws->intersectArray = NULL;
+    }
+    doIntersectionProcessing(model, &processor);
+
+    //-- resolve each term to its index column and scale. Building the columns
+    //-- also forces creation of the projections, which the cache may have cleared.
+    int termCount = processor.terms.size();
+    long long **columns = new long long *[termCount];
+    Table **tables = new Table *[termCount];
+    double *scales = new double[termCount];
+    int originTerms = 0;
+    for (int t = 0; t < termCount; t++) {
+        BPTermProcessor::Term &term = processor.terms[t];
+        columns[t] = getInputIndexColumn(term.rel);
+        tables[t] = term.rel->getTable();
+        //-- the orthogonal dimension of the relation (the number of states projected into one substate)
+        scales[t] = fullDimension / (ocDegreesOfFreedom(term.rel) + 1);
+        originTerms += (term.sign ? 1 : -1) * term.count;
+    }
+    //-- subtracting for overlaps may leave q un-normalized; deduct the remaining origin terms
+    double originTerm = ((double) (originTerms - 1)) / fullDimension;
+
+    long long inSize = inputData->getTupleCount();
+    double *qValues = new double[inSize];
+    auto computeQ = [&](long long first, long long last) {
+        for (long long i = first; i < last; i++) {
+            double q = 0;
+            for (int t = 0; t < termCount; t++) {
+                long long j = columns[t][i];
+                if (j < 0)
+                    continue;
+                BPTermProcessor::Term &term = processor.terms[t];
+                double qi = (term.sign ? 1 : -1) * (tables[t]->getValue(j) / scales[t]);
+                for (int counter = 0; counter < term.count; counter++)
+                    q = qi + q;
+            }
+            qValues[i] = q - originTerm;
+        }
+    };
+    //-- split across the search's threads, unless this is already one of them
+    double threadCount = 1;
+    if (!ThreadPool::inBatch() && !getOptionFloat("search-threads", NULL, &threadCount))
+        threadCount = ThreadPool::defaultThreadCount();
+    if (inSize < BP_PARALLEL_MIN_TUPLES || threadCount < 2) {
+        computeQ(0, inSize);
+    } else {
+        std::vector<std::thread> threads;
+        long long chunk = (inSize + (long long) threadCount - 1) / (long long) threadCount;
+        for (long long first = 0; first < inSize; first += chunk) {
+            long long last = first + chunk < inSize ? first + chunk : inSize;
+            threads.push_back(std::thread(computeQ, first, last));
+        }
+        for (size_t k = 0; k < threads.size(); k++)
+            threads[k].join();
     }
 
-    if (processor == NULL)
-        processor = new BPIntersectProcessor(inputData, fullDimension);
-    processor->reset(relCount);
-    if (intersectArray != NULL) {
-        delete[] intersectArray;
-        intersectCount = 0;
-        intersectMax = model->getRelationCount();
-        ;
-        intersectArray = NULL;
+    double t = 0;
+    for (long long i = 0; i < inSize; i++) {
+        double p = inputData->getValue(i);
+        double q = qValues[i];
+        if (p > 0 && q > 0)
+            t += p * log(p / q);
     }
+    modelT = t / log(2.0);
 
-    doIntersectionProcessing(model, processor);
-    modelT = processor->getTransmission();
+    delete[] qValues;
+    delete[] columns;
+    delete[] tables;
+    delete[] scales;
     model->setAttribute(ATTRIBUTE_BP_T, modelT);
     return modelT;
 }
@@ -734,19 +858,19 @@ void VBMManager::computeBPStatistics(Model *model) {
     if (refModelL2 <= 0.0)
         refModelL2 = 0.0;
 
-    double refL2Prob = csa(refModelL2, refDDF);
+    double refL2Prob = ocChiSquaredAlpha(refModelL2, refDDF);
     double critX2 = 0, refL2Power = 0;
     errcode = 0;
     double alpha;
     if (!getOptionFloat("palpha", NULL, &alpha))
         alpha = 0.0;
     if (alpha > 0)
-        critX2 = ppchi(alpha, refDDF, &errcode);
+        critX2 = ocChiSquaredCritical(alpha, refDDF, &errcode);
     else
         critX2 = refModelL2;
     if (errcode)
         printf("ppchi: errcode=%d\n", errcode);
-    refL2Power = 1.0 - chin2(critX2, refDDF, refModelL2, &errcode);
+    refL2Power = ocChiSquaredPower(critX2, refDDF, refModelL2, &errcode);
 
     //?? do something with these returned errors
     model->setAttribute(ATTRIBUTE_DDF, refDDF);
@@ -790,7 +914,7 @@ void VBMManager::computePercentCorrect(Model *model) {
         printf("ERROR: Failed to fit variable-based model '%s'\n", model->getPrintName());
         exit(1);
     }
-    Table *modelTable = fitTable1;
+    Table *modelTable = getWorkspace()->fitTable1;
     Table *maxTable = new Table(modelTable->getKeySize(), modelTable->getTupleCount());
 
     int maxCount = varList->getVarCount();
@@ -805,11 +929,8 @@ void VBMManager::computePercentCorrect(Model *model) {
     ManagerBase::makeProjection(modelTable, predModelTable, predRelWithDV);
     ManagerBase::makeProjection(inputData, predInputTable, predRelWithDV);
 
-    Table *inputsOnly = new Table(keysize, modelTable->getTupleCount());
-    ManagerBase::makeProjection(inputData, inputsOnly, predRelNoDV);
     model->setAttribute(ATTRIBUTE_PCT_COVERAGE,
-            (double) inputsOnly->getTupleCount() / (double) predRelNoDV->getNC() * 100.0);
-    delete inputsOnly;
+            (double) countMaskedStates(predInputTable, predRelNoDV) / (double) predRelNoDV->getNC() * 100.0);
 
     // "missedValues" is passed as NULL, to signify that this is inputData.  In this case,
     // there is no need to check for missed values, so that step can be skipped.
@@ -8,14 +8,121 @@
 #include "VBMManager.h"
 #include "SBMManager.h"
 #include "SearchBase.h"
+#include "SearchCheckpoint.h"
+#include "SearchEngine.h"
 #include "Report.h"
+#include "ReportStream.h"
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #undef SB
 //#define SB
 
+//-- search with several beams at once (the "search-beams" option), and print a
+//-- report for each beam. Returns false if the beams couldn't be set up.
+template <class Manager>
+static bool searchBeams(Manager *mgr, const char *beamList, int width, int levels) {
+    MultiBeamSearch search(mgr, mgr->getSearch());
+    if (!search.addBeams(beamList, width) || search.getBeamCount() == 0)
+        return false;
+    Model* start = mgr->getBottomRefModel();
+    mgr->computeL2Statistics(start);
+    mgr->computeDependentStatistics(start);
+    mgr->computeIncrementalAlpha(start);
+    start->setAttribute("level", 0.0);
+    int nextID = 0;
+    start->setID(nextID++);
+    search.start(start);
+
+    //-- a model kept by several beams is numbered and finished once
+    std::unordered_map<Model*, int> ids;
+    ids[start] = start->getID();
+    std::vector<bool> active(search.getBeamCount());
+    for (int j = 0; j < levels; j++) {
+        for (int b = 0; b < search.getBeamCount(); b++)
+            active[b] = !search.getKept(b).empty();
+        bool more = search.searchLevel(j+1);
+        printf("level: %d", j+1);
+        for (int b = 0; b < search.getBeamCount(); b++) {
+            if (!active[b])
+                continue;
+            SearchEngine *beam = search.getBeam(b);
+            std::vector<Model*> kept;
+            for (Model *model : search.getKept(b)) {
+                if (ids.find(model) == ids.end())
+                    kept.push_back(model);
+            }
+            printf("\t%s: models: %ld kept: %ld", beam->getSortAttr(), beam->getLevelGenerated(),
+                    (long) search.getKept(b).size());
+            for (size_t i = 0; i < kept.size(); i++) {
+                kept[i]->setID(nextID++);
+                ids[kept[i]] = kept[i]->getID();
+                mgr->computeDFStatistics(kept[i]);
+            }
+            mgr->computeL2Statistics(kept.data(), kept.size());
+            for (size_t i = 0; i < kept.size(); i++)
+                mgr->computeIncrementalAlpha(kept[i]);
+        }
+        printf("\n"); fflush(stdout);
+        if (!more)
+            break;
+    }
+
+    //-- each report renumbers its models, and a model may be in several beams, so the
+    //-- search's IDs are put back before each report. The progenitor, and so the
+    //-- incremental alpha, is the one in the beam being reported; the models are in
+    //-- level order, so each progenitor is done before the models reached from it.
+    for (int b = 0; b < search.getBeamCount(); b++) {
+        SearchEngine *beam = search.getBeam(b);
+        Report report(mgr);
+        report.setSeparator(3);
+        std::vector<Model*> models(1, start);
+        models.insert(models.end(), search.getAllKept(b).begin(), search.getAllKept(b).end());
+        for (Model *model : models)
+            model->setID(ids[model]);
+        for (Model *model : models) {
+            model->setProgenitor(search.getProgenitor(b, model));
+            model->setAttribute(ATTRIBUTE_INCR_ALPHA, -1);
+            model->setAttribute(ATTRIBUTE_PROG_ID, -1);
+            model->setAttribute(ATTRIBUTE_INCR_ALPHA_REACHABLE, -1);
+            mgr->computeIncrementalAlpha(model);
+            report.addModel(model);
+        }
+        printf("\nBeam %d: %s, %s\n", b + 1, beam->getSortAttr(),
+                beam->getSortDirection() == Direction::Descending ? "descending" : "ascending");
+        report.setAttributes("level$I, h, ddf, lr, alpha, information, aic, bic, incr_alpha, prog_id");
+        report.sort(beam->getSortAttr(), beam->getSortDirection());
+        report.print(stdout);
+    }
+    return true;
+}
+
+//-- open the "report-stream" file, if one was given, and set sortedName to the
+//-- name for its final sorted copy: the same name, with ".sorted" before any extension
+static bool openReportStream(ManagerBase *mgr, ReportStream &stream, const char *attrs, std::string &sortedName) {
+    const char *name, *formatName;
+    if (!mgr->getOptionString("report-stream", NULL, &name))
+        return false;
+    const char *ext = strrchr(name, '.');
+    if (ext && strchr(ext, '/'))
+        ext = NULL;
+    ReportStream::Format format = ReportStream::CSV;
+    if (mgr->getOptionString("report-stream-format", NULL, &formatName)) {
+        if (!ReportStream::findFormat(formatName, &format)) {
+            printf("Error: unknown report stream format %s\n", formatName);
+            return false;
+        }
+    } else if (ext) {
+        ReportStream::findFormat(ext + 1, &format);
+    }
+    sortedName = ext ? std::string(name, ext - name) + ".sorted" + ext : std::string(name) + ".sorted";
+    return stream.open(name, format, attrs, "information", Direction::Descending, mgr->getSearchDirection());
+}
+
 int main(int argc, char* argv[]) {
     if (argc <= 1) {
         printf("usage: %s [options] datafile\n", argv[0]);
@@ -58,6 +165,9 @@ int main(int argc, char* argv[]) {
         report->addModel(fit);
         mgr->printFitReport(fit, stdout);
         mgr->makeFitTable(fit);
+        const char *fitColumns;
+        if (mgr->getOptionString("fit-columns", NULL, &fitColumns))
+            mgr->getFitTable()->writeColumns(fitColumns, mgr->getVariableList());
         report->printResiduals(stdout, fit, false, false);
         report->printConditional_DV(stdout, fit, false, "");
 
@@ -77,88 +187,104 @@ int main(int argc, char* argv[]) {
         mgr->setSearch("full-up");
 #endif
         mgr->setRefModel("bottom");
-        Model* start = mgr->getBottomRefModel();
-        mgr->computeL2Statistics(start);
-        mgr->computeDependentStatistics(start);
-        mgr->computeIncrementalAlpha(start);
-        start->setAttribute("level", 0.0);
-        report->addModel(start);
-        int nextID = 0;
-        mgr->setSortAttr("information");
         mgr->setSearchDirection(Direction::Ascending);
-        start->setID(nextID++);
-
-        Model **nextModels, **keptModels;
-        Model **model;
-        keptModels = new Model*[1];
-        keptModels[0] = start;
-        long count, levelCount, keptCount, nextCount, foundCount;
-        keptCount = 1;
-        Model** models;
-        bool found;
+        const char *checkpoint = NULL, *resume = NULL;
+        mgr->getOptionString("search-checkpoint", NULL, &checkpoint);
+        mgr->getOptionString("search-resume", NULL, &resume);
+
+        const char *beams = NULL;
+        if (mgr->getOptionString("search-beams", NULL, &beams)) {
+            if (checkpoint || resume)
+                printf("Warning: search-checkpoint and search-resume are not used with search-beams\n");
+            bool ok = searchBeams(mgr, beams, (int) width, (int) levels);
+            delete report;
+            delete mgr;
+            t1 = clock();
+            printf("Elapsed time: %f seconds\n", (float)(t1 - t0)/CLOCKS_PER_SEC);
+            return ok ? 0 : 1;
+        }
+
+        //-- start from the bottom, or from the level a checkpoint was saved after
+        Model **keptModels;
+        long keptCount;
+        int nextID = 0;
+        int firstLevel = 0;
+        if (resume) {
+            int maxID;
+            keptModels = SearchCheckpoint::read(resume, mgr, report, &firstLevel, &maxID);
+            if (keptModels == NULL)
+                return 1;
+            for (keptCount = 0; keptModels[keptCount]; keptCount++)
+                ;
+            nextID = maxID + 1;
+            printf("Resuming after level %d\n", firstLevel);
+        } else {
+            Model* start = mgr->getBottomRefModel();
+            mgr->computeL2Statistics(start);
+            mgr->computeDependentStatistics(start);
+            mgr->computeIncrementalAlpha(start);
+            start->setAttribute("level", 0.0);
+            report->addModel(start);
+            start->setID(nextID++);
+            keptModels = new Model*[2];
+            keptModels[0] = start;
+            keptModels[1] = NULL;
+            keptCount = 1;
+        }
+
+        //-- with a report stream, each level's models are written as soon as they are kept
+        const char *reportAttrs = "level$I, h, ddf, lr, alpha, information, aic, bic, incr_alpha, prog_id";
+        ReportStream stream;
+        std::string sortedName;
+        bool streaming = openReportStream(mgr, stream, reportAttrs, sortedName);
+        if (streaming)
+            stream.writeLevel(report->models, report->modelCount);
+
+        SearchEngine engine(mgr, mgr->getSearch());
+        engine.setWidth((int) width);
+        engine.setSortAttr("information");
+        engine.setSortDirection(Direction::Descending);
+
         t1 = clock();
         printf("Setup time: %f seconds\n", (float)(t1 - t0)/CLOCKS_PER_SEC);
-        for (int j=0; j < levels; j++) {
-            nextCount = 0;
-            nextModels = new Model*[keptCount * (int)width];
-            levelCount = 0;
+        for (int j=firstLevel; j < levels && keptCount > 0; j++) {
             printf("level: %d\t", j+1); fflush(stdout);
-            for (int k=0; k < keptCount; k++) {
-                models = mgr->getSearch()->search(keptModels[k]);
-                count = 0;
-                if (models) {
-                    for (model = models; *model; model++)
-                        count++;
-                    levelCount += count;
-                    for (int i=0; i < count; i++) {
-                        mgr->computeInformationStatistics(models[i]);
-                    }
-                    Report::sort(models, count, mgr->getSortAttr(), Direction::Descending);
-                    foundCount = 0;
-                    int i = 0;
-                    while ((foundCount < (width < count ? width : count)) && (i < count)) {
-                        found = false;
-                        for (int n=0; n < nextCount; n++) {
-                            if (nextModels[n] == models[i] || nextModels[n]->isEquivalentTo(models[i])) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (!found) {
-                            foundCount++;
-                            nextModels[nextCount++] = models[i];
-                            models[i]->setProgenitor(keptModels[k]);
-                        }
-                        i++;
-                    }
-                    for (; i < count; i++) {
-                        mgr->deleteModelFromCache(models[i]);
-                    }
-                    delete[] models;
-                }
-            }
+            Model **nextModels = engine.searchLevel(keptModels, keptCount, j+1, j+1 < levels);
             delete[] keptModels;
-            keptCount = width < nextCount ? width : nextCount;
-            keptModels = new Model*[keptCount];
-            printf("models: %d\tkept: %d\n", levelCount, keptCount); fflush(stdout);
-            Report::sort(nextModels, nextCount, mgr->getSortAttr(), Direction::Descending);
+            keptModels = nextModels;
+            for (keptCount = 0; keptModels[keptCount]; keptCount++)
+                ;
+            printf("models: %ld\tkept: %ld", engine.getLevelGenerated(), keptCount);
+            if (engine.getLevelPruned() > 0)
+                printf("\tpruned: %ld", engine.getLevelPruned());
+            printf("\n"); fflush(stdout);
             int i;
             for (i=0; i < keptCount; i++) {
-                nextModels[i]->setAttribute("level", (double)j+1);
-                nextModels[i]->setID(nextID++);
-                mgr->computeDFStatistics(nextModels[i]);
-                mgr->computeL2Statistics(nextModels[i]);
-                mgr->computeIncrementalAlpha(nextModels[i]);
-                report->addModel(nextModels[i]);
-                keptModels[i] = nextModels[i];
+                keptModels[i]->setID(nextID++);
+                mgr->computeDFStatistics(keptModels[i]);
             }
-            delete[] nextModels;
+            mgr->computeL2Statistics(keptModels, keptCount);
+            for (i=0; i < keptCount; i++) {
+                mgr->computeIncrementalAlpha(keptModels[i]);
+                report->addModel(keptModels[i]);
+            }
+            if (streaming)
+                stream.writeLevel(keptModels, keptCount);
+            if (checkpoint)
+                SearchCheckpoint::write(checkpoint, mgr, j+1, keptModels, keptCount, report);
         }
         delete[] keptModels;
+        if (streaming) {
+            stream.writeSorted(sortedName.c_str());
+            stream.close();
+        }
 
-        report->setAttributes("level$I, h, ddf, lr, alpha, information, aic, bic, incr_alpha, prog_id");
+        report->setAttributes(reportAttrs);
         report->sort("information", Direction::Descending);
         report->print(stdout);
+        const char *reportColumns;
+        if (mgr->getOptionString("report-columns", NULL, &reportColumns))
+            report->writeColumns(reportColumns);
     }
     delete report;
     delete mgr;
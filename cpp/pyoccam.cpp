@@ -7,9 +7,12 @@
 
 #include "AttributeList.h"
 #include "Math.h"
+#include "MemoryAccount.h"
 #include "Report.h"
 #include "SBMManager.h"
 #include "SearchBase.h"
+#include "SearchCheckpoint.h"
+#include "SearchEngine.h"
 #include "VBMManager.h"
 #include <limits>
 #include <unistd.h>
@@ -66,6 +69,138 @@ DefinePyObject(Relation);
 DefinePyObject(Model);
 DefinePyObject(Report);
 
+/****** Beam search, shared by both managers ******/
+
+static PyObject *makeModelList(Model **models) {
+    long count = 0;
+    while (models[count])
+        count++;
+    PyObject *list = PyList_New(count);
+    for (long i = 0; i < count; i++) {
+        PModel *pmodel = ObjNew(Model);
+        pmodel->obj = models[i];
+        PyList_SetItem(list, i, (PyObject*) pmodel);
+    }
+    return list;
+}
+
+static void setupSearchEngine(SearchEngine *engine, int width, const char *sortName, const char *sortDir,
+        int incrementalAlpha) {
+    engine->setWidth(width);
+    engine->setSortAttr(sortName);
+    engine->setSortDirection(strcmp(sortDir, "descending") == 0 ? Direction::Descending : Direction::Ascending);
+    engine->setIncrementalAlpha(incrementalAlpha != 0);
+}
+
+// (Model **, long, long) searchLevel(Model **models, int level, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+static PyObject *searchLevel(ManagerBase *mgr, SearchBase *search, PyObject *args) {
+    PyObject *Plist;
+    int level, width, incrementalAlpha, clear;
+    char *sortName, *sortDir;
+    PyArg_ParseTuple(args, "O!iissii", &PyList_Type, &Plist, &level, &width, &sortName, &sortDir,
+            &incrementalAlpha, &clear);
+    if (search == NULL)
+        onError("No search method defined");
+    long count = PyList_Size(Plist);
+    Model **models = new Model*[count];
+    for (long i = 0; i < count; i++) {
+        models[i] = ObjRef(PyList_GetItem(Plist, i), Model);
+        if (models[i] == NULL) {
+            delete[] models;
+            onError("Model is NULL!");
+        }
+    }
+    SearchEngine engine(mgr, search);
+    setupSearchEngine(&engine, width, sortName, sortDir, incrementalAlpha);
+    Model **kept = engine.searchLevel(models, count, level, clear != 0);
+    delete[] models;
+    PyObject *list = makeModelList(kept);
+    delete[] kept;
+    PyObject *result = Py_BuildValue("(Oll)", list, engine.getLevelGenerated(), engine.getLevelPruned());
+    Py_DECREF(list);
+    return result;
+}
+
+// Model **searchBeam(Model *start, int levels, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+static PyObject *searchBeam(ManagerBase *mgr, SearchBase *search, PyObject *args) {
+    PyObject *Pstart;
+    int levels, width, incrementalAlpha, clear;
+    char *sortName, *sortDir;
+    PyArg_ParseTuple(args, "O!iissii", &TModel, &Pstart, &levels, &width, &sortName, &sortDir,
+            &incrementalAlpha, &clear);
+    if (search == NULL)
+        onError("No search method defined");
+    Model *start = ObjRef(Pstart, Model);
+    if (start == NULL)
+        onError("Model is NULL!");
+    SearchEngine engine(mgr, search);
+    setupSearchEngine(&engine, width, sortName, sortDir, incrementalAlpha);
+    engine.setLevels(levels);
+    engine.setClearCache(clear != 0);
+    Model **kept = engine.search(start);
+    PyObject *list = makeModelList(kept);
+    delete[] kept;
+    return list;
+}
+
+/****** Search checkpoints, shared by both managers ******/
+
+// bool saveCheckpoint(const char *filename, int level, Model **kept, Report *report)
+static PyObject *saveCheckpoint(ManagerBase *mgr, PyObject *args) {
+    char *filename;
+    int level;
+    PyObject *Plist, *Preport;
+    PyArg_ParseTuple(args, "siO!O!", &filename, &level, &PyList_Type, &Plist, &TReport, &Preport);
+    long count = PyList_Size(Plist);
+    Model **models = new Model*[count];
+    for (long i = 0; i < count; i++) {
+        models[i] = ObjRef(PyList_GetItem(Plist, i), Model);
+        if (models[i] == NULL) {
+            delete[] models;
+            onError("Model is NULL!");
+        }
+    }
+    bool success = SearchCheckpoint::write(filename, mgr, level, models, count, ObjRef(Preport, Report));
+    delete[] models;
+    return Py_BuildValue("i", success ? 1 : 0);
+}
+
+// (int, Model **, int) loadCheckpoint(const char *filename, Report *report)
+// returns the level, the models kept at that level, and the largest model ID
+static PyObject *loadCheckpoint(ManagerBase *mgr, PyObject *args) {
+    char *filename;
+    PyObject *Preport;
+    PyArg_ParseTuple(args, "sO!", &filename, &TReport, &Preport);
+    int level, maxID;
+    Model **kept = SearchCheckpoint::read(filename, mgr, ObjRef(Preport, Report), &level, &maxID);
+    if (kept == NULL)
+        onError("couldn't resume from checkpoint");
+    PyObject *list = makeModelList(kept);
+    delete[] kept;
+    PyObject *result = Py_BuildValue("(iOi)", level, list, maxID);
+    Py_DECREF(list);
+    return result;
+}
+
+/****** Memory limits, shared by both managers ******/
+
+// void setMemoryLimit(double bytes)
+static PyObject *setMemoryLimit(ManagerBase *mgr, PyObject *args) {
+    double bytes;
+    PyArg_ParseTuple(args, "d", &bytes);
+    mgr->setMemoryLimit((long long) bytes);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// bool reclaimMemory()
+static PyObject *reclaimMemory(ManagerBase *mgr, PyObject *args) {
+    PyArg_ParseTuple(args, "");
+    return Py_BuildValue("i", mgr->reclaimMemory() ? 1 : 0);
+}
+
 /**************************/
 /****** VBMManager ******/
 /**************************/
@@ -187,6 +322,30 @@ DefinePyFunction(VBMManager, searchOneLevel) {
     return list;
 }
 
+// (Model **, long, long) searchLevel(Model **models, int level, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+DefinePyFunction(VBMManager, searchLevel) {
+    VBMManager *mgr = ObjRef(self, VBMManager);
+    return searchLevel(mgr, mgr->getSearch(), args);
+}
+
+// Model **searchBeam(Model *start, int levels, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+DefinePyFunction(VBMManager, searchBeam) {
+    VBMManager *mgr = ObjRef(self, VBMManager);
+    return searchBeam(mgr, mgr->getSearch(), args);
+}
+
+// bool saveCheckpoint(const char *filename, int level, Model **kept, Report *report)
+DefinePyFunction(VBMManager, saveCheckpoint) {
+    return saveCheckpoint(ObjRef(self, VBMManager), args);
+}
+
+// (int, Model **, int) loadCheckpoint(const char *filename, Report *report)
+DefinePyFunction(VBMManager, loadCheckpoint) {
+    return loadCheckpoint(ObjRef(self, VBMManager), args);
+}
+
 // void setSearchType(const char *name)
 DefinePyFunction(VBMManager, setSearchType) {
     char *name;
@@ -336,6 +495,26 @@ DefinePyFunction(VBMManager, computeL2Statistics) {
     return Py_None;
 }
 
+// void computeL2Statistics(Model **models, long count)
+DefinePyFunction(VBMManager, computeL2StatisticsList) {
+    PyObject *Plist;
+    PyArg_ParseTuple(args, "O!", &PyList_Type, &Plist);
+    long count = PyList_Size(Plist);
+    Model **models = new Model*[count];
+    for (long i = 0; i < count; i++) {
+        PyObject *Pmodel = PyList_GetItem(Plist, i);
+        models[i] = ObjRef(Pmodel, Model);
+        if (models[i] == NULL) {
+            delete[] models;
+            onError("Model is NULL!");
+        }
+    }
+    ObjRef(self, VBMManager)->computeL2Statistics(models, count);
+    delete[] models;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
 // void computePearsonStatistics(Model *model)
 DefinePyFunction(VBMManager, computePearsonStatistics) {
     PyObject *Pmodel;
@@ -564,6 +743,17 @@ DefinePyFunction(VBMManager, makeFitTable) {
     return Py_None;
 }
 
+// bool writeFitTable(const char *name) - the table from the last makeFitTable, as binary columns
+DefinePyFunction(VBMManager, writeFitTable) {
+    const char *file;
+    PyArg_ParseTuple(args, "s", &file);
+    VBMManager *mgr = ObjRef(self, VBMManager);
+    if (mgr->getFitTable() == NULL)
+        onError("No fit table");
+    bool ok = mgr->getFitTable()->writeColumns(file, mgr->getVariableList());
+    return Py_BuildValue("i", ok ? 1 : 0);
+}
+
 // bool isDirected()
 DefinePyFunction(VBMManager, isDirected) {
     PyArg_ParseTuple(args, "");
@@ -637,15 +827,21 @@ DefinePyFunction(VBMManager, computePercentCorrect) {
     return Py_None;
 }
 
-//long getMemUsage()
-// This memory usage function doesn't work on Mac OS X, and perhaps other platforms.
+//double getMemUsage()
+// the bytes of tables, relations, models and fit scratch currently allocated
 DefinePyFunction(VBMManager, getMemUsage) {
-    static char *oldBrk = 0;
     PyArg_ParseTuple(args, "");
-    if (oldBrk == 0)
-        oldBrk = (char*) sbrk(0);
-    double used = ((char*) sbrk(0)) - oldBrk;
-    return Py_BuildValue("d", used);
+    return Py_BuildValue("d", (double) MemoryAccount::total());
+}
+
+// void setMemoryLimit(double bytes)
+DefinePyFunction(VBMManager, setMemoryLimit) {
+    return setMemoryLimit(ObjRef(self, VBMManager), args);
+}
+
+// bool reclaimMemory()
+DefinePyFunction(VBMManager, reclaimMemory) {
+    return reclaimMemory(ObjRef(self, VBMManager), args);
 }
 
 //int hasTestData()
@@ -668,12 +864,15 @@ static struct PyMethodDef VBMManager_methods[] = { PyMethodDef(VBMManager, initF
         PyMethodDef(VBMManager, getDvName),
         PyMethodDef(VBMManager, makeAllChildRelations), PyMethodDef(VBMManager, makeChildModel),
         PyMethodDef(VBMManager, makeModel), PyMethodDef(VBMManager, setFilter),
-        PyMethodDef(VBMManager, searchOneLevel), PyMethodDef(VBMManager, setSearchType),
+        PyMethodDef(VBMManager, searchOneLevel), PyMethodDef(VBMManager, searchLevel),
+        PyMethodDef(VBMManager, searchBeam), PyMethodDef(VBMManager, setSearchType),
+        PyMethodDef(VBMManager, saveCheckpoint), PyMethodDef(VBMManager, loadCheckpoint),
         PyMethodDef(VBMManager, getTopRefModel), PyMethodDef(VBMManager, getBottomRefModel),
         PyMethodDef(VBMManager, getRefModel), PyMethodDef(VBMManager, setRefModel),
         PyMethodDef(VBMManager, computeDF), PyMethodDef(VBMManager, computeH), PyMethodDef(VBMManager, computeT),
         PyMethodDef(VBMManager, computeInformationStatistics), PyMethodDef(VBMManager, computeDFStatistics),
-        PyMethodDef(VBMManager, computeL2Statistics), PyMethodDef(VBMManager, computePearsonStatistics),
+        PyMethodDef(VBMManager, computeL2Statistics), PyMethodDef(VBMManager, computeL2StatisticsList),
+        PyMethodDef(VBMManager, computePearsonStatistics),
         PyMethodDef(VBMManager, computeDependentStatistics), PyMethodDef(VBMManager, computeBPStatistics),
         PyMethodDef(VBMManager, computeIncrementalAlpha), PyMethodDef(VBMManager, compareProgenitors),
         PyMethodDef(VBMManager, setDDFMethod), PyMethodDef(VBMManager, setUseInverseNotation),
@@ -681,11 +880,13 @@ static struct PyMethodDef VBMManager_methods[] = { PyMethodDef(VBMManager, initF
         PyMethodDef(VBMManager, setValuesAreFunctions), PyMethodDef(VBMManager, setSearchDirection),
         PyMethodDef(VBMManager, printFitReport), PyMethodDef(VBMManager, getOption),
         PyMethodDef(VBMManager, getOptionList), PyMethodDef(VBMManager, Report),
-        PyMethodDef(VBMManager, makeFitTable), PyMethodDef(VBMManager, isDirected),
+        PyMethodDef(VBMManager, makeFitTable), PyMethodDef(VBMManager, writeFitTable),
+        PyMethodDef(VBMManager, isDirected),
         PyMethodDef(VBMManager, printOptions), PyMethodDef(VBMManager, deleteTablesFromCache),
         PyMethodDef(VBMManager, deleteModelFromCache), PyMethodDef(VBMManager, getSampleSz),
         PyMethodDef(VBMManager, printBasicStatistics), PyMethodDef(VBMManager, computePercentCorrect),
         PyMethodDef(VBMManager, printSizes), PyMethodDef(VBMManager, getMemUsage),
+        PyMethodDef(VBMManager, setMemoryLimit), PyMethodDef(VBMManager, reclaimMemory),
         PyMethodDef(VBMManager, hasTestData), PyMethodDef(VBMManager, dumpRelations),
         PyMethodDef(VBMManager, getVariableList),
         { NULL, NULL, 0 } };
@@ -803,6 +1004,30 @@ DefinePyFunction(SBMManager, searchOneLevel) {
     return list;
 }
 
+// (Model **, long, long) searchLevel(Model **models, int level, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+DefinePyFunction(SBMManager, searchLevel) {
+    SBMManager *mgr = ObjRef(self, SBMManager);
+    return searchLevel(mgr, mgr->getSearch(), args);
+}
+
+// Model **searchBeam(Model *start, int levels, int width, const char *sortName,
+//     const char *sortDir, int incrementalAlpha, int clearCache)
+DefinePyFunction(SBMManager, searchBeam) {
+    SBMManager *mgr = ObjRef(self, SBMManager);
+    return searchBeam(mgr, mgr->getSearch(), args);
+}
+
+// bool saveCheckpoint(const char *filename, int level, Model **kept, Report *report)
+DefinePyFunction(SBMManager, saveCheckpoint) {
+    return saveCheckpoint(ObjRef(self, SBMManager), args);
+}
+
+// (int, Model **, int) loadCheckpoint(const char *filename, Report *report)
+DefinePyFunction(SBMManager, loadCheckpoint) {
+    return loadCheckpoint(ObjRef(self, SBMManager), args);
+}
+
 // void setSearchType(const char *name)
 DefinePyFunction(SBMManager, setSearchType) {
     char *name;
@@ -1177,15 +1402,21 @@ DefinePyFunction(SBMManager, computePercentCorrect) {
     return Py_None;
 }
 
-//long getMemUsage()
-// This memory usage function doesn't work on Mac OS X, and perhaps other platforms.
+//double getMemUsage()
+// the bytes of tables, relations, models and fit scratch currently allocated
 DefinePyFunction(SBMManager, getMemUsage) {
-    static char *oldBrk = 0;
     PyArg_ParseTuple(args, "");
-    if (oldBrk == 0)
-        oldBrk = (char*) sbrk(0);
-    double used = ((char*) sbrk(0)) - oldBrk;
-    return Py_BuildValue("d", used);
+    return Py_BuildValue("d", (double) MemoryAccount::total());
+}
+
+// void setMemoryLimit(double bytes)
+DefinePyFunction(SBMManager, setMemoryLimit) {
+    return setMemoryLimit(ObjRef(self, SBMManager), args);
+}
+
+// bool reclaimMemory()
+DefinePyFunction(SBMManager, reclaimMemory) {
+    return reclaimMemory(ObjRef(self, SBMManager), args);
 }
 
 //long printBasicStatistics()
@@ -1207,7 +1438,9 @@ DefinePyFunction(SBMManager, hasTestData) {
 }
 
 static struct PyMethodDef SBMManager_methods[] = { PyMethodDef(SBMManager, initFromCommandLine),
-        PyMethodDef(SBMManager, searchOneLevel), PyMethodDef(SBMManager, makeSbModel),
+        PyMethodDef(SBMManager, searchOneLevel), PyMethodDef(SBMManager, searchLevel),
+        PyMethodDef(SBMManager, searchBeam), PyMethodDef(SBMManager, makeSbModel),
+        PyMethodDef(SBMManager, saveCheckpoint), PyMethodDef(SBMManager, loadCheckpoint),
         PyMethodDef(SBMManager, setFilter), PyMethodDef(SBMManager, setSearchType),
         PyMethodDef(SBMManager, getTopRefModel), PyMethodDef(SBMManager, getBottomRefModel),
         PyMethodDef(SBMManager, getRefModel), PyMethodDef(SBMManager, setRefModel),
@@ -1222,6 +1455,7 @@ static struct PyMethodDef SBMManager_methods[] = { PyMethodDef(SBMManager, initF
         PyMethodDef(SBMManager, isDirected), PyMethodDef(SBMManager, printOptions),
         PyMethodDef(SBMManager, deleteModelFromCache), PyMethodDef(SBMManager, deleteTablesFromCache),
         PyMethodDef(SBMManager, computePercentCorrect), PyMethodDef(SBMManager, getSampleSz), PyMethodDef(SBMManager, getMemUsage),
+        PyMethodDef(SBMManager, setMemoryLimit), PyMethodDef(SBMManager, reclaimMemory),
         PyMethodDef(SBMManager, printBasicStatistics), PyMethodDef(SBMManager, hasTestData), { NULL, NULL, 0 } };
 
 /****** Basic Type Operations ******/
@@ -1312,15 +1546,11 @@ static struct PyMethodDef Relation_methods[] = { PyMethodDef(Relation, get), { N
  }
  */
 
-/* commented out because it is currently unused
- static void
- Relation_dealloc(PRelation *self)
- {
- //-- this doesn't delete the Relation, because these
- //-- are generally borrowed from the cache
- delete self;
- }
- */
+static void Relation_dealloc(PRelation *self) {
+    //-- this doesn't delete the Relation, because these
+    //-- are generally borrowed from the cache
+    PyObject_Del(self);
+}
 
 PyObject *
 Relation_getattr(PyObject *self, char *name) {
@@ -1355,7 +1585,7 @@ PyTypeObject TRelation = { PyObject_HEAD_INIT(&PyType_Type) 0, "Relation",
 sizeof(PRelation),
 0,
 //-- standard methods
-        (destructor) 0,
+        (destructor) Relation_dealloc,
         (printfunc) 0,
         (getattrfunc) Relation_getattr,
         (setattrfunc) 0,
@@ -1505,14 +1735,10 @@ static struct PyMethodDef Model_methods[] = { PyMethodDef(Model, getRelation), P
  }
  */
 
-/* commented out because it is currently unused
- static void
- Model_dealloc(PModel *self)
- {
- //-- models are cached also
- delete self;
- }
- */
+static void Model_dealloc(PModel *self) {
+    //-- this frees only the wrapper; the Model belongs to the manager's model cache
+    PyObject_Del(self);
+}
 
 PyObject * Model_getattr(PyObject *self, char *name) {
     PyObject *method = Py_FindMethod(Model_methods, self, name);
@@ -1558,7 +1784,7 @@ int Model_setattr(PyObject *self, char *name, PyObject *value) {
 
 PyTypeObject TModel = { PyObject_HEAD_INIT(&PyType_Type) 0, "Model", sizeof(PModel), 0,
 //-- standard methods
-        (destructor) 0,
+        (destructor) Model_dealloc,
         (printfunc) 0,
         (getattrfunc) Model_getattr,
         (setattrfunc) Model_setattr,
@@ -1701,6 +1927,14 @@ DefinePyFunction(Report, writeReport) {
     return Py_None;
 }
 
+// bool writeColumns(const char *name)
+DefinePyFunction(Report, writeColumns) {
+    const char *file;
+    PyArg_ParseTuple(args, "s", &file);
+    bool ok = ObjRef(self, Report)->writeColumns(file);
+    return Py_BuildValue("i", ok ? 1 : 0);
+}
+
 // void printResiduals(Model *model)
 DefinePyFunction(Report, printResiduals) {
     PyObject *Pmodel;
@@ -1858,7 +2092,8 @@ DefinePyFunction(Report, bestModelData) {
 
 static struct PyMethodDef Report_methods[] = { PyMethodDef(Report, bestModelName), PyMethodDef(Report, bestModelData), PyMethodDef(Report, get), PyMethodDef(Report, addModel),
         PyMethodDef(Report, setDefaultFitModel), PyMethodDef(Report, setAttributes), PyMethodDef(Report, sort),
-        PyMethodDef(Report, printReport), PyMethodDef(Report, writeReport), PyMethodDef(Report, setSeparator),
+        PyMethodDef(Report, printReport), PyMethodDef(Report, writeReport), PyMethodDef(Report, writeColumns),
+        PyMethodDef(Report, setSeparator),
         PyMethodDef(Report, printResiduals), PyMethodDef(Report, printConditional_DV), PyMethodDef(Report, variableList), PyMethodDef(Report, dvName), PyMethodDef(Report, bestModelBIC), { NULL, NULL, 0 } };
 /****** Basic Type Operations ******/
 
@@ -10,6 +10,13 @@
 
 /**
  * AttributeList - associated with models and relations, an attribute carries a name and a numeric value.
+ *
+ * Attribute names are interned in a registry shared by all lists, which gives each
+ * name a small integer ID (names are compared without case, and anything from a "$"
+ * on is formatting, not part of the name). A list keeps its values in slots indexed
+ * by ID, so once a caller has an ID, getting or setting an attribute is an array
+ * access. The name functions look the ID up first; the registry can be read from
+ * several threads without locking.
  */
 class AttributeList {
     public:
@@ -19,22 +26,42 @@ class AttributeList {
         long size();
         void reset();
 
-        // Add an attribute. Names are not copied so the name argument must point to a
-        // permanent string. If an attribute by this name already exists, it is replaced.
+        // the ID for a name, registering the name if it is new. The registry keeps
+        // its own copy of the name.
+        static int getAttributeId(const char *name);
+        // the ID for a name, or -1 if no attribute by that name was ever set
+        static int findAttributeId(const char *name);
+        // the registered name for an ID
+        static const char *getAttributeName(int id);
+
+        // Add an attribute. If an attribute by this name already exists, it is replaced.
         void setAttribute(const char *name, double value);
         double getAttribute(const char *name);
+        void setAttributeById(int id, double value);
+        bool hasAttributeById(int id) {
+            return id >= 0 && id < slotCount && positions[id] >= 0;
+        }
+        double getAttributeById(int id) {
+            return (id >= 0 && id < slotCount && positions[id] >= 0) ? values[id] : -1.0;
+        }
+
+        // attributes by position, in the order they were first set
         int getAttributeIndex(const char *name);
         int getAttributeCount();
         double getAttributeByIndex(int index);
+        const char *getAttributeNameByIndex(int index);
+        int getAttributeIdByIndex(int index);
 
         // Print out values
         void dump();
 
     private:
-        const char** names;
-        double *values;
+        int *order; // attribute IDs, in the order they were set
         int attrCount;
         int maxAttrCount;
+        double *values; // by ID
+        int *positions; // by ID, the position in order, or -1 if not set
+        int slotCount;
 };
 
 #endif
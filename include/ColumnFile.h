@@ -0,0 +1,114 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___ColumnFile
+#define ___ColumnFile
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/**
+ * ColumnFile - a binary, column-ordered file of search results (Report::writeColumns)
+ * or of a fit or projection table (Table::writeColumns). It is meant to be mapped
+ * into memory and read in place, e.g. with numpy.memmap, rather than parsed.
+ *
+ * Numbers are in the byte order of the machine which wrote the file (byteOrder
+ * reads as 0x01020304 when the reader's order is the same), and every section
+ * starts on an 8-byte boundary. All offsets are from the start of the file, and a
+ * string is an offset into the string pool, which holds null-terminated strings.
+ *
+ * A file starts with a ColumnFileHeader; the sections which follow depend on kind.
+ *
+ * ColumnFileModels - one row per model, in report order:
+ *     columnsOffset: ColumnFileColumn[columns], one per attribute
+ *     rowIdsOffset:  int64_t[rows], the model IDs
+ *     rowNamesOffset: uint64_t[rows], the model names (strings)
+ *     each column's dataOffset: double[rows], NaN where a model lacks the attribute
+ *
+ * ColumnFileTable - one row per tuple, in table order:
+ *     columnsOffset: ColumnFileVariable[columns], one per variable, to decode keys:
+ *         a variable's state is (key[segment] & mask) >> shift, and a state with
+ *         all of its bits on means the variable is not in the table's relation
+ *     rowIdsOffset:  keys, rows * keySize segments of keySegmentBytes each
+ *     valuesOffset:  double[rows], the tuple values
+ */
+
+enum ColumnFileKind {
+    ColumnFileModels = 1, ColumnFileTable = 2
+};
+
+struct ColumnFileHeader {
+    char magic[8]; // "OCCAMCOL"
+    uint32_t version; // 1
+    uint32_t kind; // a ColumnFileKind
+    uint32_t byteOrder; // 0x01020304
+    uint32_t keySegmentBytes; // size of one key segment
+    uint64_t rows;
+    uint32_t columns; // attributes, or variables
+    uint32_t keySize; // key segments per tuple (tables only)
+    uint64_t columnsOffset;
+    uint64_t rowIdsOffset; // model IDs, or table keys
+    uint64_t rowNamesOffset; // models only
+    uint64_t valuesOffset; // tables only
+    uint64_t stringsOffset;
+    uint64_t stringsBytes;
+};
+
+struct ColumnFileColumn {
+    int32_t attrId; // interned attribute ID (see AttributeList::getAttributeId)
+    uint32_t pad;
+    uint64_t name; // string
+    uint64_t dataOffset;
+};
+
+struct ColumnFileVariable {
+    uint64_t name; // string
+    uint64_t abbrev; // string
+    uint64_t mask; // bits of the variable's value in its key segment
+    int32_t cardinality;
+    int32_t segment; // which segment of the key holds the variable
+    int32_t shift; // rightmost bit of the value in the segment
+    int32_t dv; // 1 for a dependent variable
+    uint64_t stateNames; // offset of uint64_t[cardinality], the names of the states (strings)
+};
+
+/**
+ * ColumnFileWriter - writes a column file section by section. The file is written
+ * under a temporary name and renamed into place by finish(), so a reader never
+ * maps a partly written file.
+ */
+class ColumnFileWriter {
+    public:
+        ColumnFileWriter();
+        ~ColumnFileWriter();
+
+        // Open filename for writing. Returns false (with a message) on failure.
+        bool open(const char *filename, ColumnFileKind kind);
+
+        // append data as a new section, and return its offset
+        uint64_t write(const void *data, size_t bytes);
+
+        // add a string to the pool, and return its offset in the pool
+        uint64_t addString(const char *text);
+
+        // write the string pool and header (whose kind, offsets and sizes for the
+        // pool are filled in), and close the file. Returns false (with a message)
+        // if any write failed.
+        bool finish(ColumnFileHeader &header);
+
+    private:
+        FILE *fd;
+        std::string filename;
+        std::string temp;
+        std::string strings;
+        uint64_t offset;
+        ColumnFileKind kind;
+        bool failed;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___ExpansionIterator
+#define ___ExpansionIterator
+
+#include "Types.h"
+
+class Table;
+class VariableList;
+
+/**
+ * ExpansionIterator - walks the orthogonal expansion of a table (or of a single
+ * key) across a set of missing variables, without storing it. Each source tuple is
+ * visited once for every combination of values of the missing variables, with the
+ * last missing variable changing fastest. This is the same order in which
+ * ManagerBase::expandTuple adds tuples, so for a sorted source with missing
+ * variables in index order the keys come out sorted.
+ *
+ * Usage:
+ *     ExpansionIterator it(table, vars, missing, missingCount);
+ *     while (it.next()) { ... it.getKey() ... it.getValue() ... }
+ */
+class ExpansionIterator {
+    public:
+        // expand every tuple of the given table
+        ExpansionIterator(Table *source, VariableList *vars, int *missingVars, int missingCount);
+
+        // expand a single key, giving every cell the same value
+        ExpansionIterator(KeySegment *source, double value, VariableList *vars, int *missingVars,
+                int missingCount);
+
+        ~ExpansionIterator();
+
+        // move to the next cell of the expansion. Returns false when there are no more.
+        bool next();
+
+        // restart the iteration from the first cell
+        void reset();
+
+        // the key of the current cell. The storage belongs to the iterator, and is
+        // overwritten by the next call to next().
+        KeySegment *getKey() {
+            return key;
+        }
+
+        // the value of the source tuple for the current cell
+        double getValue() {
+            return value;
+        }
+
+        // the number of cells each source tuple expands into
+        double getExpansionFactor();
+
+        // the number of cells in the whole expansion
+        double getExpansionSize();
+
+    private:
+        void init(VariableList *vars, int *missingVars, int missingCount);
+        void loadTuple(); // copy the current source tuple into key, with missing values zeroed
+
+        Table *table; // source table, or NULL when expanding a single key
+        KeySegment *sourceKey; // source key when table is NULL
+        double sourceValue;
+        VariableList *varList;
+        int keysize;
+        int *missing; // indices of the variables being expanded
+        int *values; // current value of each missing variable
+        int missingCount;
+        long long tupleIndex; // current source tuple; -1 before the first call to next()
+        long long tupleCount;
+        KeySegment *key;
+        double value;
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include "Options.h"
 #include "VarIntersect.h"
 #include <map>
+#include <mutex>
+#include <vector>
 
 /**
  * ocIntersectProcessor - this is a base class for processing classes
@@ -37,6 +39,38 @@ class ocIntersectProcessor {
         virtual void process(bool sign, Relation *rel, int count = 1) = 0;
 };
 
+/**
+ * FitWorkspace - the scratch storage used while fitting a model: the IPF fit and
+ * projection tables, the intersection list used for DF and H, and the sorted
+ * variables and mask used to look up a relation in the cache. A manager has
+ * one for the thread that owns it; threads fitting models concurrently each bind
+ * a workspace of their own (see ManagerBase::bindWorkspace).
+ */
+struct FitWorkspace {
+        FitWorkspace();
+        ~FitWorkspace();
+
+        Table *fitTable1;
+        Table *fitTable2;
+        Table *projTable;
+        VarIntersect *intersectArray;
+        int intersectCount;
+        int intersectMax;
+        // bring the memory account up to date after intersectArray is allocated or grown
+        void accountIntersect();
+        long long intersectBytes;
+
+        // make the relation key scratch big enough for varcount variables
+        void reserveRelationKey(int varcount, int keysize);
+        int *relVars;
+        int *relStates;
+        KeySegment *relMask;
+        int relVarMax;
+        int relKeySize;
+
+        long long lastUsed; // when the workspace was last released (see MemoryAccount::nextUse)
+};
+
 /**
  * ManagerBase - implements base functionality of an ocManager.  This class is the
  * provider for algorithms which manipulate core objects.  The class is extensible,
@@ -102,6 +136,14 @@ class ManagerBase {
         virtual bool makeMaxProjection(Table *t1, Table *t2, Table *inputData, Relation *indRel,
                 Relation *depRel, double* missedValues);
 
+        // the number of distinct states of rel among the tuples of a table; that is, the
+        // size of the (variable-based) projection, without building it
+        long long countMaskedStates(Table *table, Relation *rel);
+
+        // true if the persistent statistics cache applies to the current input data
+        // (it doesn't while inputData is temporarily replaced by a projection)
+        bool useStatsCache();
+
         // make projections for all relations in a model. This just calls makeProject
         // as many times as needed.
         virtual bool makeProjections(Model *model);
@@ -112,6 +154,23 @@ class ManagerBase {
         // delete a model from the model cache
         virtual bool deleteModelFromCache(Model *model);
 
+        // the memory (in bytes, as counted by MemoryAccount) above which cached tables
+        // are evicted during search; 0 for no limit. Unless set, this is taken from
+        // the "memory-limit" option.
+        void setMemoryLimit(long long bytes);
+        long long getMemoryLimit();
+
+        // if the cached tables (relation projections, model fit tables and the tables
+        // of spare fit workspaces) take more memory than the limit, evict the least
+        // recently used of them until they take less than a low-water mark below it;
+        // they are recomputed when next needed. This must only be called while no
+        // model is being fitted. Returns false if the memory which can't be evicted
+        // (the data, and the relation and model objects) is itself over the limit.
+        bool reclaimMemory();
+        long getEvictionCount() {
+            return evictionCount;
+        }
+
 
         // Make a fit table. This function uses the IPF algorithm. The fit table is
         // linked to the model.  If the model already has a fit table, the function
@@ -121,6 +180,11 @@ class ManagerBase {
         virtual bool makeFitTableIPF(Model *model);
         virtual bool makeFitTableAlgebraic(Model *model);
 
+        // Get the column mapping each input data tuple to the matching tuple in the
+        // relation's projection, building (and caching on the relation) if needed.
+        // The column is owned by the relation.
+        long long *getInputIndexColumn(Relation *rel);
+
         // Expand a single tuple into all values of all missing variables, recursively
         void expandTuple(double tupleValue, KeySegment *key, int *missingVars, int missingCount, Table *outTable,
                 int currentMissingVar);
@@ -128,6 +192,11 @@ class ManagerBase {
         void makeOrthoExpansion(Relation *rel, Table *table);
         void makeSbExpansion(Relation *rel, Table *table);
 
+        // Create an iterator over the orthogonal expansion of a relation's projection,
+        // without storing it. The caller deletes the iterator. Values are those of the
+        // projection, not normalized.
+        class ExpansionIterator *makeOrthoIterator(Relation *rel);
+
         // Process relations and intersections, as need for DF and H computation
         void doIntersectionProcessing(Model *model, ocIntersectProcessor *proc);
 
@@ -153,6 +222,29 @@ class ManagerBase {
         double computeLR(Model *model);
         virtual double computeDDF(Model *model);
 
+        //-- the groups of model statistics, which each manager computes in its own way
+        virtual void computeInformationStatistics(Model *model) = 0;
+        virtual void computeDFStatistics(Model *model) = 0;
+        virtual void computeL2Statistics(Model *model) = 0;
+        virtual void computeDependentStatistics(Model *model) = 0;
+        virtual void computeBPStatistics(Model *model) = 0;
+        virtual void computePercentCorrect(Model *model) = 0;
+
+        //-- compute the statistics needed to rank a model by the given attribute
+        //-- during search, from whichever group provides it
+        void computeSortStatistic(Model *model, const char *attr);
+
+        //-- find an upper bound on the sort attribute attr of a model, more cheaply than
+        //-- computing it. Returns false if the manager has no bound for attr.
+        virtual bool boundSortStatistic(Model *, const char *, double *) {
+            return false;
+        }
+
+        //-- true if several models can be fitted at once (from different threads)
+        virtual bool isThreadSafe() {
+            return false;
+        }
+
         //-- computes the incremental alpha relative to a model's progenitor
         void computeIncrementalAlpha(Model *model);
         //-- compares a new progenitor to an existing one, so the best is kept
@@ -206,9 +298,15 @@ class ManagerBase {
         class ModelCache *getModelCache() {
             return modelCache;
         }
+        class StatsCache *getStatsCache() {
+            return statsCache;
+        }
         class Table *getInputData() {
             return inputData;
         }
+        class Options *getOptions() {
+            return options;
+        }
         class Table *getTestData() {
             return testData;
         }
@@ -243,8 +341,16 @@ class ManagerBase {
         void printOptions(bool printHTML = false, bool skipNominal = false);
 
         class Table *getFitTable() {
-            return fitTable1;
+            return getWorkspace()->fitTable1;
         }
+
+        //-- the fit workspace for the calling thread
+        FitWorkspace *getWorkspace();
+
+        //-- give the calling thread a workspace of its own, so it can fit models
+        //-- while other threads do the same. Workspaces are kept for reuse after unbinding.
+        void bindWorkspace();
+        void unbindWorkspace();
         // state based Model functions
         // calculates the number of state constraints generated
         // by a particular relation
@@ -280,22 +386,24 @@ class ManagerBase {
         int keysize;
         double sampleSize;
         double testSampleSize;
-        unsigned long long stateSpaceSize;
         Table *inputData;
         Table *testData;
         double inputH;
         class RelCache *relCache;
         class ModelCache *modelCache;
+        class StatsCache *statsCache; // persistent relation statistics; NULL if not enabled
+        Table *statsCacheData; // the input data the statistics cache was opened for
         class Options *options;
-        Table *fitTable1;
-        Table *fitTable2;
-        Table *projTable;
+        FitWorkspace mainWorkspace; // used by any thread without a bound workspace
+        std::vector<FitWorkspace*> spareWorkspaces;
+        std::mutex workspaceLock;
+        std::recursive_mutex relationLock; // guards lazily computed statistics and tables of shared relations
+        long long memoryLimit; // -1 until set, in which case the option is used
+        long evictionCount; // number of times reclaimMemory has had to evict tables
         int dataLines;
         int *DVOrder;
+        std::once_flag dvOrderOnce; // DVOrder is made once, by whichever thread needs it first
         int useInverseNotation;
-        VarIntersect *intersectArray;
-        int intersectCount;
-        int intersectMax;
         double functionConstant;
         double negativeConstant;
         bool valuesAreFunctions;
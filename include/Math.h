@@ -22,12 +22,22 @@
  */
 double ocEntropy(Table *p);
 
+/**
+ * Batched kernels over flat arrays of n values, used by ocEntropy and
+ * ocTransmission. ocPLogPSum returns the sum of p ln(p) over p > PROB_MIN;
+ * ocPLogPQSum returns the sum of p ln(p/q) over p, q > PROB_MIN. These use
+ * SIMD when the processor supports it; see MathKernels.cpp for error bounds.
+ */
+double ocPLogPSum(const double *p, long long n);
+double ocPLogPQSum(const double *p, const double *q, long long n);
+
 /**
  * Compute transmission between two tables. This function requires that the
  * tables be over the same set of variables. This is the sum over all entries
  * i in both tables of pi (log2(pi) / log2(qi)), where the p's come from
  * the first table and the q's from the second. Note that the term is considered
  * zero if either pi or qi are zero.
+ * The tables are matched in one merged pass over their sorted keys.
  */
 double ocTransmission(Table *p, Table *q);
 
@@ -93,5 +103,24 @@ double ppchi (double p, double df, int *ifault);
 double anorm (double x, int upper);
 unsigned chistat (unsigned ntab, double* obs, double* fit, double* g2_ptr, double* p2_ptr);
 
+/**
+ * Memoized forms of the above, for use per model. Repeated arguments (such as the
+ * same DDF across a search level) return the cached result, which is exactly the
+ * value the underlying function gives.
+ *   ocChiSquaredAlpha - csa(x, df)
+ *   ocChiSquaredCritical - ppchi(alpha, df)
+ *   ocChiSquaredPower - 1 - chin2(critX2, df, lambda)
+ */
+double ocChiSquaredAlpha(double x, double df);
+double ocChiSquaredCritical(double alpha, double df, int *ifault);
+double ocChiSquaredPower(double critX2, double df, double lambda, int *ifault);
+
+/**
+ * Alpha and power for a batch of statistics x[i] with df[i] degrees of freedom. Power
+ * is for a test at level critAlpha, or at x[i] itself if critAlpha is not positive.
+ */
+void ocChiSquaredAlphaPower(long count, const double *x, const double *df, double critAlpha, double *alpha,
+        double *power);
+
 
 #endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___MemoryAccount
+#define ___MemoryAccount
+
+#include <stdio.h>
+
+/**
+ * MemoryCategory - the kinds of storage which are counted. Tables are data tables
+ * (input data, relation projections and model fits); Relations and Models are the
+ * objects and their arrays (not their tables); FitScratch is the workspace used
+ * while fitting a model.
+ */
+enum class MemoryCategory {
+    Tables, Relations, Models, FitScratch, Count
+};
+
+/**
+ * MemoryAccount - byte counters for each memory category, kept up to date as
+ * storage is allocated, grown and freed. Unlike the process size, these count
+ * only storage the search can give back, so they can be used to decide when to
+ * evict cached tables (see ManagerBase::reclaimMemory). The counters may be
+ * updated from several threads at once.
+ */
+class MemoryAccount {
+    public:
+        // count bytes allocated (or, if negative, freed) in a category
+        static void add(MemoryCategory cat, long long bytes);
+        static void release(MemoryCategory cat, long long bytes) {
+            add(cat, -bytes);
+        }
+
+        // bytes currently held in one category, or in all of them
+        static long long get(MemoryCategory cat);
+        static long long total();
+
+        static const char *name(MemoryCategory cat);
+
+        // print the counters on one line
+        static void print(FILE *fd);
+
+        // a number larger than any returned before, to stamp a cached table with
+        // when it is used, so the least recently used tables can be evicted first
+        static long long nextUse();
+};
+
+#endif
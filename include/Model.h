@@ -25,13 +25,17 @@ class Model {
         bool isStateBased();
 
         // get/set relations
-        void addRelation(Relation *relation, bool normalize = true, ModelCache *cache=NULL);
+        void addRelation(Relation *relation, bool normalize = true);
         int getRelations(Relation **rels, int maxRelations);
         Relation *getRelation(int index);
         int getRelationCount();
         Table *getFitTable();
         void setFitTable(Table *tbl);
         void deleteFitTable();
+        // when the fit table was set (see MemoryAccount::nextUse)
+        long long getFitTableUsed() {
+            return fitTableUsed;
+        }
         void deleteRelationLinks();
 
         // copy relation references (but not the objects)
@@ -43,6 +47,9 @@ class Model {
         }
         void setAttribute(const char *name, double value);
         double getAttribute(const char *name);
+        // the same, by attribute ID (see AttributeList::getAttributeId)
+        void setAttributeById(int id, double value);
+        double getAttributeById(int id);
 
         // get a printable name for the relation, using the variable abbreviations
         const char *getPrintName(int useInverse = 0);
@@ -57,13 +64,27 @@ class Model {
 
         // Checks if this model contains the specified relation.  That is, checks if any of
         // the model's relations *contain* this relation, not if any of them *are* this relation.
-        bool containsRelation(Relation *relation, ModelCache *cache=NULL);
+        bool containsRelation(Relation *relation);
 
         // Checks to see if this model is parent (or higher) of the specified child model.
         // That is, if the "child" is between this model and the bottom on the lattice.
         bool containsModel(Model *childModel);
 
         bool isEquivalentTo(Model *other);
+
+        // a hash of the model's set of relations, which does not depend on their order;
+        // models with the same relations have the same hash
+        unsigned long long getStructureHash();
+
+        // the structure hash a model with the given relations would have
+        static unsigned long long structureHash(Relation **rels, int count);
+
+        // see if the other model has exactly the same relations
+        bool hasSameStructure(Model *other);
+
+        // see if this model has exactly the given relations, whose structure hash is hash
+        bool hasRelations(Relation **rels, int count, unsigned long long hash);
+
         // set and get for progenitor model.  (The model from which this one was derived in a search.)
         Model *getProgenitor() {
             return progenitor;
@@ -82,33 +103,44 @@ class Model {
         // print out model info
         void dump(bool detail = false);
 
-        // state based models need to make structure matrix for DF calculation
-        void makeStructMatrix(int statespace, VariableList *vars, int **stateSpaceArr);
-        int* getIndicesFromKey(KeySegment *key, VariableList *vars, int statespace,
-                int **stateSpaceArr, int *counter);
+        // state based models need to make structure matrix for DF calculation.
+        // The matrix is 0/1 and very sparse, so it is kept in compressed row form:
+        // row r holds the state indices structMatrix[rowStart[r]] .. structMatrix[rowStart[r+1]-1],
+        // in increasing order. The last row is the default (all states) constraint.
+        void makeStructMatrix(int statespace, VariableList *vars);
+        // the states matched by a constraint key, in increasing order
+        int* getIndicesFromKey(KeySegment *key, VariableList *vars, int *counter);
         void completeSbModel();
-        int** makeStateSpaceArray(VariableList *varList, int statespace = 0);
 
         void printStructMatrix();
-        int **getStructMatrix(int *statespace, int *totalConst);
-//            *statespace = stateSpaceSize;
-//            *totalConst = totalConstraints;
-//            return structMatrix;
-//        }
+        int *getStructMatrix(int *statespace, int *totalConst, long **rowStart);
+
+        // the echelon basis of the structure matrix, kept with the model so that DF
+        // of a model one relation larger can be found incrementally
+        class RankBasis *getRankBasis();
 
- 
     private:
+        void buildStructMatrix();
+
+        // reduce the structure matrix rows of one relation against the rank basis,
+        // adding any independent ones if insert is true. Returns true if all were spanned.
+        bool reduceRelationRows(Relation *rel, bool insert);
+
         Relation **relations;
         Model *progenitor; // the model from which this one was derived in a search
         int ID; // ID of the model in a search list
         int relationCount;
         int maxRelationCount;
         class Table *fitTable;
+        long long fitTableUsed;
         class AttributeList *attributeList;
         Model *hashNext;
         char *printName;
         char *inverseName;
-        int **structMatrix;
+        unsigned long long structHash; // 0 until computed
+        int *structMatrix;
+        long *structRowStart;
+        class RankBasis *rankBasis;
         long totalConstraints;
         int stateSpaceSize;
 };
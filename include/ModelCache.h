@@ -11,12 +11,20 @@
 /**
  * ModelCache.h - defines the model cache.  This provides a way to reuse model
  * objects.
- * the cache matches on the printName for the model, which uniquely identifies the
- * set of relations.
+ * the cache matches on the set of relations in the model, by the model's structure
+ * hash (Model::getStructureHash), so models with the same relations are found
+ * whatever order the relations were added in, without building their names.
  * There must be a separate model cache for each different problem instance.
  *
+ * As with the relation cache, the models are split into shards, each a growing
+ * hash table with its own lock, so models can be looked up and added from several
+ * threads at once.
  */
-#define MODELCACHE_HASHSIZE 1001
+#include <mutex>
+#include <vector>
+
+#define MODELCACHE_SHARDS 64
+#define MODELCACHE_SHARDSIZE 16 // initial hash chains per shard
 class ModelCache {
     public:
 	//-- construct an empty model cache
@@ -27,24 +35,48 @@ class ModelCache {
 
 	long size();
 
+	//-- delete the fit tables of all models in cache
+	void deleteFitTables();
+
+	//-- append to models each model in cache which has a fit table
+	void collectFitTables(std::vector<class Model*> &models);
+
 	//-- addModel - put a new model in the cache. If a matching model already
 	//-- exists, an error is returned.
 	bool addModel(class Model *model);
 
+	//-- findOrAddModel - put a new model in the cache, unless a matching one is already
+	//-- there. Returns the cached model: model if it was added, otherwise the existing
+	//-- match (and the caller still owns model).
+	class Model *findOrAddModel(class Model *model);
+
 	//-- deleteModel - deletes a model from the cache.
 	//-- returns true if successful, false if not found.
 	bool deleteModel(class Model *model);
 
-	//-- findModel - find a model in the cache.  Null is returned if the given
-	//-- model doesn't exist.
-	class Model *findModel(const char *name);
+	//-- findModel - find the cached model with the same relations as the given one.
+	//-- Null is returned if there is none.
+	class Model *findModel(class Model *model);
+
+	//-- findModel - find the cached model with exactly the given relations, without
+	//-- having to make a model of them. Null is returned if there is none.
+	class Model *findModel(class Relation **rels, int count);
 
 	void dump();
 
     private:
-	class Model **hash;
+	struct Shard {
+	    std::mutex lock;
+	    class Model **hash;
+	    long hashSize;
+	    long count;
+	};
+
+	class Model *findInChain(Shard &shard, class Model *model);
+	void grow(Shard &shard);
+
+	Shard shards[MODELCACHE_SHARDS];
 };
 
 #endif
 
-
@@ -0,0 +1,59 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___RankBasis
+#define ___RankBasis
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * RankBasis - a row echelon basis for the span of a set of sparse 0/1 rows, such
+ * as the rows of a state-based model's structure matrix. Rows can be added one at
+ * a time, so the rank of a model plus one more relation can be found by inserting
+ * just that relation's constraint rows into a copy of the model's basis.
+ *
+ * Elimination is exact, over the integers modulo the Mersenne prime 2^61-1. The rows
+ * are 0/1, so the rank mod p can only fall short of the real rank if p divides every
+ * maximal nonzero minor.
+ */
+class RankBasis {
+    public:
+        RankBasis();
+        RankBasis(const RankBasis &other);
+
+        // add a 0/1 row, given by its nonzero column indices in increasing order.
+        // Returns true if the row was independent of the basis (and so increased the rank).
+        bool addRow(const int *cols, int count);
+
+        // true if the row is already in the span of the basis. The basis is unchanged,
+        // so several threads may call this on one basis at once (but not with addRow).
+        bool spans(const int *cols, int count);
+
+        long getRank() {
+            return rows.size();
+        }
+
+        // approximate storage used by the basis, in bytes
+        long size();
+
+    private:
+        struct Row {
+            std::vector<int> cols;
+            std::vector<unsigned long long> vals;
+        };
+
+        // reduce row against the basis until its leading column has no pivot. The
+        // caller's scratch row holds each step's result before it is swapped in.
+        void reduce(Row &row, Row &scratch);
+        void eliminate(Row &row, const Row &pivot, unsigned long long factor, Row &scratch);
+
+        std::vector<Row> rows; // each row normalized to a leading 1
+        std::unordered_map<int, int> pivotOf; // leading column -> index in rows
+};
+
+#endif
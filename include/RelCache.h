@@ -13,11 +13,22 @@
  * objects, since once constructed a relation object can be used by any model
  * containing that relation.
  * the cache matches on the mask for the relation, which uniquely identifies the
- * set of variables in the relation.
+ * set of variables in the relation, and for a state-based relation on its states
+ * as well. Since these can be computed without a relation object, a relation is
+ * looked up before one is constructed, and finding a cached relation allocates nothing.
  * There must be a separate relation cache for each different problem instance.
  *
+ * Lookups and insertions may come from several threads at once. The relations are
+ * split into shards, each a hash table with its own lock, so threads working on
+ * different relations rarely wait on each other. A shard's table doubles in size
+ * when it holds more than two relations per hash chain.
  */
-#define RELCACHE_HASHSIZE 1001
+#include "Types.h"
+#include <mutex>
+#include <vector>
+
+#define RELCACHE_SHARDS 64
+#define RELCACHE_SHARDSIZE 16 // initial hash chains per shard
 class RelCache {
     public:
 	//-- construct an empty relation cache
@@ -28,22 +39,43 @@ class RelCache {
 
 	long size();
 
-	//-- delete projection tables from all relations in cache
-	void deleteTables();
+	//-- delete projection tables from all relations in cache, except any which is keep
+	//-- (a relation may be given a table it doesn't own, such as the input data)
+	void deleteTables(class Table *keep = NULL);
+
+	//-- append to rels each relation in cache which has a table, except keep
+	void collectTables(std::vector<class Relation*> &rels, class Table *keep = NULL);
 
 	//-- addRelation - put a new relation in the cache. If a matching relation already
 	//-- exists, an error is returned.
 	bool addRelation(class Relation *rel);
 
-	//-- findRelation - find a relation in the cache.  Null is returned if the given
-	//-- relation doesn't exist.
-	class Relation *findRelation(const char *name);
+	//-- findOrAddRelation - put a new relation in the cache, unless a matching one is
+	//-- already there. Returns the cached relation: rel if it was added, otherwise the
+	//-- existing match (and the caller still owns rel).
+	class Relation *findOrAddRelation(class Relation *rel);
+
+	//-- findRelation - find a relation in the cache, by its mask (as built by
+	//-- Key::buildMask) and, for a state-based relation, the states of its variables
+	//-- in sorted variable order. Null states match a relation with no states, or one
+	//-- whose states are all DONT_CARE. Null is returned if the relation doesn't exist.
+	class Relation *findRelation(const KeySegment *mask, int keysize, const int *states, int varcount);
 
 	void dump();
 
     private:
-	class Relation **hash;
+	struct Shard {
+	    std::mutex lock;
+	    class Relation **hash;
+	    long hashSize;
+	    long count;
+	};
+
+	class Relation *findInChain(Shard &shard, unsigned long long key, const KeySegment *mask, int keysize,
+		const int *states, int varcount);
+	void grow(Shard &shard);
+
+	Shard shards[RELCACHE_SHARDS];
 };
 
 #endif
-
@@ -65,8 +65,24 @@ class Relation {
 
         // returns a reference to the table for this relation, NULL if none computed yet.
         Table *getTable();
-        // deletes the projection table to recover storage
+        // deletes the projection table (and index column) to recover storage
         void deleteTable();
+        // when the table was last used (see MemoryAccount::nextUse)
+        long long getLastUsed() {
+            return lastUsed;
+        }
+        void setLastUsed(long long use) {
+            lastUsed = use;
+        }
+
+        // sets/gets a column mapping each tuple of a data table (source) to the index
+        // of the matching tuple in this relation's table (-1 where there is none). The
+        // relation owns the column, and deletes it along with the table. getIndexColumn
+        // returns NULL if there is no column for the given source.
+        void setIndexColumn(long long *column, Table *source);
+        long long *getIndexColumn(Table *source) {
+            return source == indexSource ? indexColumn : NULL;
+        }
 
         // sets/gets the state constraints for the relation
         void setStateConstraints(class StateConstraint *constraints);
@@ -103,6 +119,17 @@ class Relation {
         void sort();
         static void sort(int *vars, int varcount, int *states = nullptr);
 
+        // a hash of the relation's variables (by mask) and states, used to find it in
+        // the relation cache; equal relations have equal hashes. The static form gives
+        // the hash for a relation that has not been built, from its mask and its states
+        // in sorted variable order (null states are the same as all DONT_CARE).
+        unsigned long long getStructureHash();
+        static unsigned long long structureHash(const KeySegment *mask, int keysize, const int *states,
+                int varcount);
+
+        // see if this relation has the given mask and states (as for structureHash)
+        bool hasStructure(const KeySegment *mask, int keysize, const int *states, int varcount);
+
         // set, get hash chain linkages
         Relation *getHashNext() {
             return hashNext;
@@ -117,6 +144,9 @@ class Relation {
         }
         void setAttribute(const char *name, double value);
         double getAttribute(const char *name);
+        // the same, by attribute ID (see AttributeList::getAttributeId)
+        void setAttributeById(int id, double value);
+        double getAttributeById(int id);
 
         // get a printable name for the relation, using the variable abbreviations
         const char *getPrintName(int useInverse = 0);
@@ -139,6 +169,9 @@ class Relation {
         int varCount; // number of vars in relation
         int maxVarCount; // size of vars array
         class Table *table;
+        long long lastUsed; // when table was last used
+        long long *indexColumn; // source tuple -> table index, or NULL if not built
+        Table *indexSource; // the table indexColumn was built from
         class StateConstraint *stateConstraints; // state constraints
         Relation *hashNext; // linkage for storing relations in a hash table
         KeySegment *mask; // mask has zero for variables in this rel, 1's elsewhere
@@ -146,6 +179,9 @@ class Relation {
         char *printName;
         char *inverseName;
         int indepOnly; // remembers if relation is independent only
+        unsigned long long structHash; // 0 until computed
+        long long accounted; // bytes of this object and its arrays in the memory account
+        long long indexBytes; // bytes of indexColumn in the memory account
 };
 
 #endif
@@ -71,6 +71,9 @@ class Report {
 	//-- Print a tabular output format.
 	void print(FILE *fd);
 	void print(int fnum);	// use a file number instead of FILE*
+	//-- Write the models, with all of their attributes, as a column file (see
+	//-- ColumnFile.h). Returns false (with a message) if it can't be written.
+	bool writeColumns(const char *filename);
 	//-- Set report separator type: 1=tab, 2=comma, 3=space filled
 	void setSeparator(int sep) { separator = sep; }
 
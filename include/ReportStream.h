@@ -0,0 +1,79 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___ReportStream
+#define ___ReportStream
+
+#include "Types.h"
+#include <stdio.h>
+#include <vector>
+
+class Model;
+
+/**
+ * ReportStream - writes search results to a file as the search goes, rather than
+ * all at the end as Report does. Each level's kept models are written, sorted,
+ * as soon as the level is finished, and the file is flushed, so the results so far
+ * can be read during a long search and survive if it is stopped.
+ *
+ * Each model is one row: its ID, its name, and the chosen attributes, in CSV, TSV
+ * or NDJSON (one JSON object per line). Rows are not kept in memory; each level is
+ * also saved as a sorted run in a temporary file, and the final sorted report is
+ * made by merging the runs, so memory does not grow with the number of models.
+ */
+class ReportStream {
+    public:
+        enum Format {
+            CSV, TSV, NDJSON
+        };
+
+        ReportStream();
+        ~ReportStream();
+
+        // the format named "csv", "tsv" or "ndjson"; false if there is no such format
+        static bool findFormat(const char *name, Format *format);
+
+        // Open filename for writing. attrList gives the attributes to write, as for
+        // Report::setAttributes (a "$I" suffix writes an integer). Models are sorted
+        // by sortAttr in the given direction; ties go to the later level in an
+        // ascending search (the earlier in a descending one), then to the lower ID.
+        // Returns false (with a message) if the file can't be written.
+        bool open(const char *filename, Format format, const char *attrList, const char *sortAttr, Direction dir,
+                Direction searchDir);
+
+        // write the kept models of one level, and flush the file
+        void writeLevel(Model **models, long count);
+
+        // write every model written so far, in sorted order, to filename
+        bool writeSorted(const char *filename);
+
+        void close();
+
+    private:
+        struct Attr {
+            char *name;
+            bool integer;
+        };
+        struct Run {
+            long offset; // in runFile
+            long count;
+        };
+
+        void writeHeader(FILE *fd);
+        void formatRow(Model *model, std::vector<char> &row);
+
+        FILE *out;
+        FILE *runFile; // sorted runs, one per level
+        std::vector<Attr> attrs;
+        std::vector<Run> runs;
+        Format format;
+        char *sortAttr;
+        Direction sortDir;
+        Direction searchDir;
+};
+
+#endif
@@ -91,6 +91,9 @@ class SBMManager: public ManagerBase {
         //-- compute log likelihood statistics
         void computeL2Statistics(Model *model);
 
+        //-- compute log likelihood statistics for a whole level of models
+        void computeL2Statistics(Model **models, long count);
+
         //-- compute Pearson statistics
         void computePearsonStatistics(Model *model);
 
@@ -103,6 +106,12 @@ class SBMManager: public ManagerBase {
         //-- compute percentage correct of a model for a directed system
         void computePercentCorrect(Model *model);
 
+        //-- as for VBMManager, the caches are locked and each thread fits in its own
+        //-- workspace; state constraint lookups and rank bases may also be shared
+        bool isThreadSafe() {
+            return true;
+        }
+
         //-- Filter definitions. If a filter is set on a search object, then
         //-- generated models which do not pass the filter are not kept.
         enum RelOp {
@@ -19,8 +19,9 @@ class SearchFullDown : public SearchBase {
 
 class SearchFullUp : public SearchBase {
     public:
-	SearchFullUp(): parentList(0), parentListCount(0), parentListMax(0) {};
-	virtual ~SearchFullUp() {};
+	SearchFullUp(): parentList(0), parentListCount(0), parentListMax(0), stack(0), stackMax(0), sets(0), setsMax(0),
+		candidates(0), candidateCount(0), candidateMax(0), scratchRels(0), words(0) {};
+	virtual ~SearchFullUp();
 	Model **search(Model *start);
 	void makeCandidate(class SearchStackEntry *stack, int top, Model *start);
 	static SearchBase *make() { return new SearchFullUp(); }
@@ -29,6 +30,19 @@ class SearchFullUp : public SearchBase {
 	Model **parentList;
 	long parentListCount;
 	long parentListMax;
+
+	//-- storage reused from one search to the next: the stack, the variable sets of the
+	//-- starting relations and the stack entries, the candidate relations found so far
+	//-- (as variable sets), and the relation list of a parent being looked up
+	class SearchStackEntry *stack;
+	int stackMax;
+	unsigned long long *sets;
+	long setsMax;
+	unsigned long long *candidates;
+	long candidateCount;
+	long candidateMax;
+	Relation **scratchRels;
+	int words;
 };
 
 class SearchLooplessDown : public SearchBase {
@@ -45,8 +59,8 @@ class SearchSbFullUp : public SearchBase {
 	virtual ~SearchSbFullUp() {};
 	Model **search(Model *start);
 	static SearchBase *make() { return new SearchSbFullUp(); }
-    void recurseDirected(Model *start, int cur_var, int cur_index, int *var_indices, int *state_indices, int &models_found, Model **model_list);
-    bool addToCache(Model *model, int &models_found, Model **model_list);
+    Model *makeParent(Model *start, int count, int *var_indices, int *state_indices);
+    bool addToList(Model *model, int &models_found, Model **model_list);
 };
 
 class SearchSbLooplessUp : public SearchBase {
@@ -55,8 +69,9 @@ class SearchSbLooplessUp : public SearchBase {
 	virtual ~SearchSbLooplessUp() {};
 	Model **search(Model *start);
 	static SearchBase *make() { return new SearchSbLooplessUp(); }
-    void recurseDirected(int cur_var, int cur_index, int *var_indices, int *state_indices, int &models_found, Model **model_list);
+    Model *makeParent(int count, int *var_indices, int *state_indices);
     bool addToCache(Model *model, int &models_found, Model **model_list);
+    bool addToList(Model *model, int &models_found, Model **model_list);
 };
 
 class SearchLooplessUp : public SearchBase {
@@ -11,6 +11,9 @@
 #include "ManagerBase.h"
 #include "VBMManager.h"
 #include "SBMManager.h"
+#include <functional>
+
+class ThreadPool;
 
 class SearchBase {
     friend class SearchFactory;
@@ -24,6 +27,16 @@ class SearchBase {
     bool makeProjection() { return projection; }
     ManagerBase *getManager() { return manager; }
 
+    //-- threads used by searches which generate models in parallel (the
+    //-- state-based upward searches); the default is the "search-threads" option
+    void setThreadCount(int count);
+    int getThreadCount() { return threadCount; }
+
+    //-- call task(i) for each i in [0, count) on the search's threads. Each thread
+    //-- has a manager workspace of its own while it runs a task. The tasks run one
+    //-- at a time unless the manager is thread-safe (ManagerBase::isThreadSafe).
+    void forEach(long count, const std::function<void(long)> &task);
+
     protected:
     void setManager(ManagerBase *mgr) { manager = mgr; }
     void setDirected(bool dir) { directed = dir; }
@@ -33,6 +46,8 @@ class SearchBase {
     ManagerBase *manager;
     bool directed;	// system is directed (has dependent variables)
     bool projection; // create a projection table for all new relations
+    int threadCount;
+    ThreadPool *pool; // created when first needed
 };
 
 class SearchFactory {
@@ -0,0 +1,45 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___SearchCheckpoint
+#define ___SearchCheckpoint
+
+class ManagerBase;
+class Model;
+class Report;
+
+/**
+ * SearchCheckpoint - saves the state of a search after a level, so that a search
+ * which is stopped can be resumed from the last level finished. A checkpoint holds
+ * the level, the models kept at that level, and the models in the report, each
+ * with its relations, attributes, ID and progenitor (progenitors are saved too,
+ * even if they are in neither list). It also records the options and a fingerprint
+ * of the data, which are checked when the checkpoint is read.
+ *
+ * Projection tables are not saved; with the "stats-cache" option (and
+ * "stats-cache-tables"), the statistics and projections computed before the search
+ * stopped are read back from the statistics cache instead.
+ *
+ * The file is text, and is replaced atomically, so a run killed while writing
+ * leaves the previous checkpoint intact.
+ */
+class SearchCheckpoint {
+    public:
+        // write a checkpoint to filename, after the given level has been searched.
+        // Returns false (with a message) if the file could not be written.
+        static bool write(const char *filename, ManagerBase *mgr, int level, Model **kept, long keptCount,
+                Report *report);
+
+        // read a checkpoint written for the same data. The report models are added to
+        // report (if it is not NULL), and the kept models are returned as a
+        // null-terminated array, which the caller must delete; *level is set to the
+        // level they were kept at, and *maxID (if not NULL) to the largest model ID.
+        // Returns NULL (with a message) if the checkpoint cannot be used.
+        static Model **read(const char *filename, ManagerBase *mgr, Report *report, int *level, int *maxID = 0);
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___SearchEngine
+#define ___SearchEngine
+
+#include "Types.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class ManagerBase;
+class Model;
+class SearchBase;
+class ThreadPool;
+
+/**
+ * SearchEngine - runs a beam search over the model lattice. At each level, every
+ * kept model is expanded with the search object (SearchBase::search), the models
+ * not seen before are evaluated for the sort attribute, and the best "width" of
+ * them are kept for the next level.
+ *
+ * Models are ranked by the sort attribute, in the sort direction, with ties broken
+ * by model name; models equivalent to one already kept are skipped. A model reached
+ * again from another progenitor is not re-evaluated, but if incremental alpha is on,
+ * the manager is asked whether the new progenitor is the better one.
+ *
+ * New models are evaluated on a thread pool when the manager allows concurrent
+ * fitting (ManagerBase::isThreadSafe), each thread fitting in its own workspace;
+ * otherwise they are evaluated in order on the calling thread. After each
+ * progenitor's models are evaluated, the manager may evict the least recently
+ * used cached tables if they hold more memory than its limit
+ * (ManagerBase::reclaimMemory).
+ *
+ * With pruning on (the "search-prune" option), a descending sort, and no
+ * incremental alpha, each new model is first given an upper bound on its sort
+ * attribute (ManagerBase::boundSortStatistic). Models are then evaluated best
+ * bound first, and once "width" models are ranked, those whose bound is below
+ * the last of them are not evaluated, since they cannot be kept.
+ */
+class SearchEngine {
+    public:
+        // computes (at least) the sort attribute for a newly generated model
+        typedef std::function<void(Model*)> Evaluator;
+
+        // search with the given manager and search object. The defaults are width 3,
+        // 7 levels, sorting by ascending ddf, and the number of threads
+        // from the "search-threads" option (or the number of cores).
+        SearchEngine(ManagerBase *mgr, SearchBase *search);
+        ~SearchEngine();
+
+        void setWidth(int w) {
+            width = w;
+        }
+        void setLevels(int l) {
+            levels = l;
+        }
+        void setSortAttr(const char *name);
+        const char *getSortAttr() {
+            return sortAttr;
+        }
+        void setSortDirection(Direction dir) {
+            sortDirection = dir;
+        }
+        Direction getSortDirection() {
+            return sortDirection;
+        }
+        void setIncrementalAlpha(bool flag) {
+            incrementalAlpha = flag;
+        }
+        // remove the models which were generated but not kept from the model cache
+        // (except after the last level, whose models may still be reported)
+        void setClearCache(bool flag) {
+            clearCache = flag;
+        }
+        void setPruning(bool flag) {
+            pruning = flag;
+        }
+        void setThreadCount(int count);
+        int getThreadCount();
+
+        // track the models this search has seen in the given map, rather than by their
+        // "processed" attribute, so that several searches can share the model cache
+        // (see MultiBeamSearch). Each model is mapped to the progenitor this search
+        // first reached it from. A model's own level and progenitor are still only set
+        // by the first search to reach it.
+        void setSeenModels(std::unordered_map<Model*, Model*> *models) {
+            seenModels = models;
+        }
+
+        // replace the evaluator; the default is the manager's computeSortStatistic
+        void setEvaluator(const Evaluator &fn) {
+            evaluator = fn;
+        }
+
+        // Expand one level. Returns the kept models as a null-terminated array, which
+        // the caller must delete. New models get their level and progenitor set.
+        Model **searchLevel(Model **models, long count, int level, bool clear);
+
+        // Run all levels from start, stopping early if a level keeps nothing. Returns
+        // the kept models of every level, in level order, as a null-terminated array.
+        Model **search(Model *start);
+
+        // models generated / kept by the last searchLevel call, and since construction
+        long getLevelGenerated() {
+            return levelGenerated;
+        }
+        long getLevelKept() {
+            return levelKept;
+        }
+        long getTotalGenerated() {
+            return totalGenerated;
+        }
+        long getTotalKept() {
+            return totalKept;
+        }
+        // models not evaluated because of their bounds, by the last searchLevel call
+        // and since construction
+        long getLevelPruned() {
+            return levelPruned;
+        }
+        long getTotalPruned() {
+            return totalPruned;
+        }
+
+    private:
+        // run task(i) for each i in [0, count), on the pool if the manager allows it
+        void forEach(long count, const std::function<void(long)> &task);
+        void evaluate(Model **models, long count);
+
+        ManagerBase *manager;
+        SearchBase *searcher;
+        ThreadPool *pool;
+        Evaluator evaluator;
+        char *sortAttr;
+        int sortAttrId; // see AttributeList::getAttributeId
+        Direction sortDirection;
+        int width;
+        int levels;
+        int threadCount;
+        bool incrementalAlpha;
+        bool clearCache;
+        bool pruning;
+        bool warmedUp; // a model has been evaluated on its own before any in parallel
+        bool memoryWarned; // the memory limit has been found to be below what can't be evicted
+        std::unordered_map<Model*, Model*> *seenModels;
+        long levelGenerated, levelKept;
+        long totalGenerated, totalKept;
+        long levelPruned, totalPruned;
+};
+
+/**
+ * MultiBeamSearch - several beam searches over the same data, run together, each
+ * with its own sort attribute, direction and width (for instance, one beam sorted
+ * by information and one by BIC). All the beams use one manager, so they share its
+ * relation and model caches, projections and statistics cache; a model reached by
+ * several beams is fitted once, and only the statistics the later beams sort by are
+ * added to it.
+ *
+ * The beams advance a level at a time. Each beam keeps its own models and tracks the
+ * models it has seen, so a model evaluated by one beam is still ranked by another
+ * which reaches it. A model's level and progenitor are those of the first beam to
+ * reach it; the progenitor within each beam is kept by the beam (getProgenitor).
+ * Models are never cleared from the cache, since another beam may yet reach them.
+ */
+class MultiBeamSearch {
+    public:
+        MultiBeamSearch(ManagerBase *mgr, SearchBase *search);
+        ~MultiBeamSearch();
+
+        // add a beam which keeps the best "width" models by attr in the given direction
+        SearchEngine *addBeam(const char *attr, Direction dir, int width);
+
+        // add beams from a comma-separated list of "attribute[:direction]", where the
+        // direction is "ascending" or "descending" (the default). Returns false, with a
+        // message, if the list can't be read.
+        bool addBeams(const char *list, int width);
+
+        int getBeamCount() {
+            return beams.size();
+        }
+        SearchEngine *getBeam(int beam) {
+            return beams[beam].engine;
+        }
+
+        // start every beam from the given model, once all the beams are added
+        void start(Model *model);
+
+        // expand each beam which kept models at the last level. Returns false once
+        // no beam has any models left to expand.
+        bool searchLevel(int level);
+
+        // the models kept by a beam at the last level, and over all levels so far
+        const std::vector<Model*> &getKept(int beam) {
+            return beams[beam].kept;
+        }
+        const std::vector<Model*> &getAllKept(int beam) {
+            return beams[beam].all;
+        }
+        // the model a beam first reached the given model from; NULL for the start
+        // model, or a model the beam hasn't seen
+        Model *getProgenitor(int beam, Model *model);
+
+    private:
+        struct Beam {
+            SearchEngine *engine;
+            std::unordered_map<Model*, Model*> seen;
+            std::vector<Model*> kept;
+            std::vector<Model*> all;
+        };
+        ManagerBase *manager;
+        SearchBase *searcher;
+        std::vector<Beam> beams;
+};
+
+#endif
@@ -9,6 +9,8 @@
 #define ___StateConstraint
 
 #include "Types.h"
+#include <atomic>
+#include <mutex>
 
 /**
  * StateConstraint - defines the set of states (variable combinations) within a relation
@@ -32,11 +34,27 @@ class StateConstraint {
         // get the key size for this constraint table
         int getKeySize();
 
+        // find the constraint matching the given key, returning its index
+        // (0 .. constraintCount-1), or -1 if the key is not constrained.
+        // This uses a sorted index which is built on first use and kept
+        // until another constraint is added. Several threads may look up
+        // keys at once, once all the constraints are added.
+        long indexOf(KeySegment *key);
+
+        // returns true if the key matches one of the constraints
+        bool contains(KeySegment *key) {
+            return indexOf(key) >= 0;
+        }
+
     private:
+        long *buildIndex(); // sort the constraint indices by key, if not yet done
+
         KeySegment *constraints;
         long constraintCount;
         long maxConstraintCount;
         int keysize;
+        std::atomic<long *> sortedIndex; // constraint indices in key order; NULL if not built
+        std::mutex indexLock; // held while the index is built
 };
 
 #endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___StatsCache
+#define ___StatsCache
+
+#include "Types.h"
+#include <stdio.h>
+#include <map>
+#include <string>
+
+class Relation;
+class Table;
+class VariableList;
+
+/**
+ * StatsCache - an on-disk cache of relation statistics, shared between runs.
+ * Each dataset gets its own file in the cache directory, named by a fingerprint
+ * of the variable definitions and the (normalized) input data. Records are keyed
+ * by the relation's variable mask, and hold the relation's H and DF, and
+ * optionally its projection table.
+ * Records are appended as they are computed, so a run that dies still leaves
+ * its results for the next one. Only variable-based relations are cached.
+ */
+class StatsCache {
+    public:
+        // open (or create) the cache file for the given data in directory dir.
+        // If the file cannot be opened, the cache is disabled, and lookups miss.
+        StatsCache(const char *dir, VariableList *vars, Table *data, bool saveTables);
+        ~StatsCache();
+
+        // true if the cache file was opened
+        bool isOpen() {
+            return file != NULL;
+        }
+
+        // look up H and DF for a relation. Returns false on a miss.
+        bool findStatistics(Relation *rel, double *h, double *df);
+
+        // read a cached projection table for the relation. Returns NULL on a miss.
+        Table *findTable(Relation *rel);
+
+        // record statistics for a relation (and its table, if tables are being saved)
+        void addStatistics(Relation *rel, double h, double df);
+
+        // fingerprint of a dataset; used to name the cache file
+        static unsigned long long fingerprint(VariableList *vars, Table *data);
+
+        long getHits() {
+            return hits;
+        }
+        long getMisses() {
+            return misses;
+        }
+
+    private:
+        struct Entry {
+            double h;
+            double df;
+            long long tupleCount; // -1 if no table was stored
+            long tableOffset; // file position of the table tuples
+        };
+
+        bool cacheable(Relation *rel);
+        std::string maskKey(Relation *rel);
+        // read the records of a file made for the data with the given fingerprint.
+        // Returns false if the file is for other data, or isn't a cache file.
+        bool load(unsigned long long print);
+        // bytes in a record before its table: the mask, h, df and tuple count
+        long headerBytes() {
+            return keysize * sizeof(KeySegment) + 2 * sizeof(double) + sizeof(long long);
+        }
+
+        FILE *file;
+        int keysize;
+        bool saveTables;
+        std::map<std::string, Entry> entries;
+        long hits;
+        long misses;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "Key.h"
 #include "Constants.h"
 #include "Globals.h"
+#include "MemoryAccount.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -21,6 +22,7 @@
  */
 
 class Relation;
+class VariableList;
 
 class Table {
     public:
@@ -28,6 +30,9 @@ class Table {
         ~Table();
         long long size();
 
+        // the category the table's storage is counted in (Tables, unless set)
+        void setMemoryCategory(MemoryCategory cat);
+
         void copy(const Table *from); // copy data table
 
         //-- add or sum tuples in the table.  These take into account the type of table
@@ -42,6 +47,10 @@ class Table {
         KeySegment *getKey(long long index);
         void copyKey(long long index, KeySegment *key);
 
+        //-- copy count values, starting at index, into a flat array. Returns the
+        //-- number copied (fewer than count at the end of the table).
+        long long copyValues(long long index, long long count, double *values);
+
         //-- find the given key. If matchOnly is true, -1 is returned on no match.
         //-- if matchOnly is false, the position of the next higher tuple is returned
         long long indexOf(KeySegment *key, bool matchOnly = true); //
@@ -58,6 +67,10 @@ class Table {
         // dump debug output
         void dump(bool detail = false);
 
+        // write the keys and values as a column file (see ColumnFile.h), with the
+        // variables needed to decode the keys. Returns false (with a message) on failure.
+        bool writeColumns(const char *filename, VariableList *vars);
+
         // normalize information-theoretic table.  No effect for set-theoretic tables.
         // if these are counts, then the return value is the sample size
         double normalize();
@@ -71,11 +84,15 @@ class Table {
         double getLowestValue();
 
     private:
+        void accountStorage(); // bring the memory account up to date after allocating
+
         void* data; // storage for all keys and values
         int keysize; // number of key segments in the key for each tuple
         long long tupleCount; // number of tuples in the tuple array
         long long maxTupleCount; // the total size of the data member, in terms of tuples
         TableType type; // one of INFO_TYPE, SET_TYPE
+        long long accounted; // bytes of data counted in the memory account
+        MemoryCategory category;
 };
 
 template <typename F>
@@ -0,0 +1,60 @@
+/*
+ * Copyright © 1990 The Portland State University OCCAM Project Team
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file LICENSE in the source
+ * distribution of this software for license terms.
+ */
+
+#ifndef ___ThreadPool
+#define ___ThreadPool
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * ThreadPool - a fixed set of worker threads which run batches of indexed tasks.
+ * A batch is a task function and a count; each index in [0, count) is handed to
+ * exactly one thread, and run() returns once all of them are done. The calling
+ * thread works on the batch as well, so a pool of one thread has no workers and
+ * runs everything inline.
+ */
+class ThreadPool {
+    public:
+        // create a pool which runs batches on threadCount threads (including the caller)
+        ThreadPool(int threadCount);
+        ~ThreadPool();
+
+        int getThreadCount() {
+            return workers.size() + 1;
+        }
+
+        // call task(i) for each i in [0, count), and wait for all calls to finish
+        void run(long count, const std::function<void(long)> &task);
+
+        // number of threads to use when none was requested
+        static int defaultThreadCount();
+
+        // true on a thread which is running a task of some pool's batch, where
+        // starting more threads would oversubscribe the cores the pool already uses
+        static bool inBatch();
+
+    private:
+        void workerLoop();
+        void runTasks();
+
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable wake; // a new batch is ready, or the pool is shutting down
+        std::condition_variable done; // a worker has finished with the current batch
+        const std::function<void(long)> *task;
+        long taskCount;
+        long nextTask;
+        long generation; // incremented for each batch, so workers join each batch once
+        int busy; // workers still in the current batch
+        bool stopping;
+};
+
+#endif
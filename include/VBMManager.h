@@ -102,6 +102,10 @@ public:
     //-- compute log likelihood statistics
     void computeL2Statistics(Model *model);
 
+    //-- compute log likelihood statistics for a whole level of models, evaluating
+    //-- alpha and power together so that models with the same DDF share the work
+    void computeL2Statistics(Model **models, long count);
+
     //-- compute Pearson statistics
     void computePearsonStatistics(Model *model);
 
@@ -118,6 +122,23 @@ public:
     //-- compute percentage correct of a model for a directed system
     void computePercentCorrect(Model *model);
 
+    //-- bound information, aic or bic (relative to the top or bottom reference) of a
+    //-- model with loops, from a lower bound on its H; see computeHLowerBound
+    bool boundSortStatistic(Model *model, const char *attr, double *upper);
+
+    //-- a lower bound on the H of a model. This is exact for loopless models; for
+    //-- others it is the H of a loopless model containing this one.
+    double computeHLowerBound(Model *model);
+
+    //-- how far below its exact value IPF may leave the H of a model with loops
+    double computeIPFAllowance();
+
+    //-- the caches are locked and each thread fits in its own workspace, so models
+    //-- can be evaluated concurrently
+    bool isThreadSafe() {
+        return true;
+    }
+
     //-- Filter definitions. If a filter is set on a search object, then
     //-- generated models which do not pass the filter are not kept.
     enum RelOp {
@@ -55,6 +55,8 @@ class ocUtils:
         self.__PercentCorrect = 0
         self.__IncrementalAlpha = 0
         self.__NoIPF = 0
+        self.__checkpointFile = ""
+        self.__resumeFile = ""
         
         self.graphs = {}
         self.__graphWidth = 500
@@ -162,6 +164,14 @@ class ocUtils:
             levels = 0
         self.__searchLevels = levels
 
+    # save the search state to this file after each level
+    def setCheckpointFile(self, fileName):
+        self.__checkpointFile = fileName
+
+    # resume a search from a file saved with setCheckpointFile
+    def setResumeFile(self, fileName):
+        self.__resumeFile = fileName
+
     def setReportSortName(self, sortName):
         self.__reportSortName = sortName
 
@@ -224,80 +234,20 @@ class ocUtils:
             if a1 < a2: result = 1
         return result
 
-    # this function decides which statistic to computed, based
-    # on how search is sorting the models. We want to avoid any
-    # extra expensive computations
-    def computeSortStatistic(self, model):
-        if self.sortName == "h" or self.sortName == "information" or self.sortName == "unexplained" or self.sortName == "alg_t" :
-            self.__manager.computeInformationStatistics(model)
-        elif self.sortName == "df" or self.sortName == "ddf" :
-            self.__manager.computeDFStatistics(model)
-        elif self.sortName == "bp_t" or self.sortName == "bp_information" or self.sortName == "bp_alpha" :
-            self.__manager.computeBPStatistics(model)
-        elif self.sortName == "pct_correct_data":
-            self.__manager.computePercentCorrect(model)
-        # anything else, just compute everything we might need
-        else:
-            self.__manager.computeL2Statistics(model)
-            self.__manager.computeDependentStatistics(model)
- 
-    # this function generates the parents/children of the given model, and for
-    # any which haven't been seen before puts them into the newModel list
-    # this function also computes the LR statistics (H, LR, DF, etc.) as well
-    # as the dependent statistics (dH, %dH, etc.)
-    def processModel(self, level, newModelsHeap, model):
-        addCount = 0
-        generatedModels = self.__manager.searchOneLevel(model)
-        for newModel in generatedModels:
-            if newModel.get("processed") <= 0.0 :
-                newModel.processed = 1.0
-                newModel.level = level
-                newModel.setProgenitor(model)
-                self.computeSortStatistic(newModel)
-    # need a fix here (or somewhere) to check for (and remove) models that have the same DF as the progenitor
-                # decorate model with a key for sorting, & push onto heap
-                key = newModel.get(self.sortName)
-                if self.__searchSortDir == "descending":
-                    key = -key
-                heapq.heappush(newModelsHeap, ([key, newModel.get("name")] , newModel))     # appending the model name makes sort alphabet-consistent
-                addCount += 1
-            else:
-                if self.__IncrementalAlpha:
-                    # this model has been made already, but this progenitor might lead to a better Incr.Alpha
-                    # so we ask the manager to check on that, and save the best progenitor
-                    self.__manager.compareProgenitors(newModel, model)
-        return addCount
-
-            
     # This function processes models from one level, and return models for the next level.
+    # The manager's search engine generates, evaluates and ranks the new models.
     def processLevel(self, level, oldModels, clear_cache_flag):
-        # start a new heap
-        newModelsHeap = []
-        fullCount = 0
-        for model in oldModels:
-            fullCount += self.processModel(level, newModelsHeap, model)
-        # if searchWidth < heapsize, pop off searchWidth and add to bestModels
-        bestModels = []
-        lastKey = ['','']
-        while len(newModelsHeap) > 0:
-            # make sure that we're adding unique models to the list (mostly for state-based)
-            key, candidate = heapq.heappop(newModelsHeap)
-            if (len(bestModels) < self.__searchWidth): # or key[0] == lastKey[0]:      # comparing keys allows us to select more than <width> models,
-                if True not in [n.isEquivalentTo(candidate) for n in bestModels]:   # in the case of ties
-                    bestModels.append(candidate)
-                    lastKey = key
-            else:
-                break
+        bestModels, fullCount, prunedCount = self.__manager.searchLevel(oldModels, level, self.__searchWidth, self.sortName,
+                                                           self.__searchSortDir, self.__IncrementalAlpha, clear_cache_flag)
         truncCount = len(bestModels)
         self.totalgen  = fullCount + self.totalgen
         self.totalkept = truncCount + self.totalkept
         memUsed = self.__manager.getMemUsage()
         if not self.__hide_intermediate_output:
             print '%d new models, %ld kept; %ld total models, %ld total kept; %ld kb memory used; ' % (fullCount, truncCount, self.totalgen+1, self.totalkept+1, memUsed/1024),
+            if prunedCount > 0:
+                print '%ld not evaluated (pruned by bound); ' % prunedCount,
         sys.stdout.flush()
-        if clear_cache_flag:
-            for item in newModelsHeap:
-                self.__manager.deleteModelFromCache(item[1])
         return bestModels
 
 
@@ -404,11 +354,17 @@ class ocUtils:
         if self.__IncrementalAlpha:
             self.__manager.computeIncrementalAlpha(start)
         start.level = 0
-        self.__report.addModel(start)
         self.__nextID = 1
         start.setID(self.__nextID)
         start.setProgenitor(start)
         oldModels = [start]
+        firstLevel = 1
+        if self.__resumeFile != "":
+            level, oldModels, self.__nextID = self.__manager.loadCheckpoint(self.__resumeFile, self.__report)
+            firstLevel = level + 1
+            print "Resuming after level", level
+        else:
+            self.__report.addModel(start)
         try:
             self.__manager.setSearchType(self.searchType())
         except:
@@ -420,8 +376,11 @@ class ocUtils:
         print "Searching levels:"
         start_time = time.time()
         last_time = start_time
-        for i in xrange(1,self.__searchLevels+1):
-            if self.__manager.getMemUsage() > maxMemoryToUse:
+        # cached tables are evicted to stay under the limit; stop only if that isn't enough
+        if self.__manager.getOption("memory-limit") == "":
+            self.__manager.setMemoryLimit(maxMemoryToUse)
+        for i in xrange(firstLevel,self.__searchLevels+1):
+            if not self.__manager.reclaimMemory():
                 print "Memory limit exceeded: stopping search"
                 break
             print i,':',    # progress indicator
@@ -430,6 +389,8 @@ class ocUtils:
             print '%.1f seconds, %.1f total' % (current_time - last_time, current_time - start_time)
             sys.stdout.flush()
             last_time = current_time
+            if not self.__NoIPF:
+                self.__manager.computeL2StatisticsList(newModels)
             for model in newModels:
                 # Make sure all statistics are calculated. This won't do anything if we did it already.
                 if not self.__NoIPF:
@@ -445,6 +406,8 @@ class ocUtils:
                 model.setID(self.__nextID)
                 #model.deleteFitTable()  #recover fit table memory
                 self.__report.addModel(model)
+            if self.__checkpointFile != "":
+                self.__manager.saveCheckpoint(self.__checkpointFile, i, newModels, self.__report)
             oldModels = newModels
             # if the list is empty, stop. Also, only do one step for chain search
             if self.__searchFilter == "chain" or len(oldModels) == 0:
@@ -483,11 +446,17 @@ class ocUtils:
         if self.__IncrementalAlpha:
             self.__manager.computeIncrementalAlpha(start)
         start.level = 0
-        self.__report.addModel(start)
         self.__nextID = 1
         start.setID(self.__nextID)
         start.setProgenitor(start)
         oldModels = [start]
+        firstLevel = 1
+        if self.__resumeFile != "":
+            level, oldModels, self.__nextID = self.__manager.loadCheckpoint(self.__resumeFile, self.__report)
+            firstLevel = level + 1
+            print "Resuming after level", level
+        else:
+            self.__report.addModel(start)
         try:
             self.__manager.setSearchType(self.sbSearchType())
         except:
@@ -497,8 +466,11 @@ class ocUtils:
         print "Searching levels:"
         start_time = time.time()
         last_time = start_time
-        for i in xrange(1,self.__searchLevels+1):
-            if self.__manager.getMemUsage() > maxMemoryToUse:
+        # cached tables are evicted to stay under the limit; stop only if that isn't enough
+        if self.__manager.getOption("memory-limit") == "":
+            self.__manager.setMemoryLimit(maxMemoryToUse)
+        for i in xrange(firstLevel,self.__searchLevels+1):
+            if not self.__manager.reclaimMemory():
                 print "Memory limit exceeded: stopping search"
                 break
             print i,':',    # progress indicator
@@ -521,6 +493,8 @@ class ocUtils:
                 model.setID(self.__nextID)
                 model.deleteFitTable()  #recover fit table memory
                 self.__report.addModel(model)
+            if self.__checkpointFile != "":
+                self.__manager.saveCheckpoint(self.__checkpointFile, i, newModels, self.__report)
             oldModels = newModels
             # if the list is empty, stop. Also, only do one step for chain search
             if self.__searchFilter == "chain" or len(oldModels) == 0:
@@ -808,6 +782,12 @@ class ocUtils:
         option = self.__manager.getOption("search-direction")
         if option != "":
             self.searchDir = option
+        option = self.__manager.getOption("search-checkpoint")
+        if option != "":
+            self.__checkpointFile = option
+        option = self.__manager.getOption("search-resume")
+        if option != "":
+            self.__resumeFile = option
         option = self.__manager.getOptionList("short-model")
         # for search, only one specified model allowed
         if len(option) > 0:
@@ -906,18 +886,15 @@ class ocUtils:
         start.setID(self.__nextID)
         start.setProgenitor(start)
         
-        # Perform the search to find the best model
-        oldModels = [start]
-        for i in xrange(1, self.__searchLevels + 1):
-            sys.stdout.write('.')
-            newModels = self.processLevel(i, oldModels, i != self.__searchLevels)
-            for model in newModels:
-                self.__manager.computeL2Statistics(model)
-                self.__manager.computeDependentStatistics(model)
-                self.__nextID += 1
-                model.setID(self.__nextID)
-                self.__report.addModel(model)
-            oldModels = newModels
+        # Perform the search to find the best model; the whole beam search is one call
+        newModels = self.__manager.searchBeam(start, self.__searchLevels, self.__searchWidth, self.sortName,
+                                              self.__searchSortDir, self.__IncrementalAlpha, True)
+        for model in newModels:
+            self.__manager.computeL2Statistics(model)
+            self.__manager.computeDependentStatistics(model)
+            self.__nextID += 1
+            model.setID(self.__nextID)
+            self.__report.addModel(model)
 
         self.__report.sort(self.sortName, self.__sortDir)
         best = self.__report.bestModelData()
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "../include/ColumnFile.h"
+#include "../include/Model.h"
+#include "../include/Report.h"
+#include "../include/VBMManager.h"
+
+// Fixture class: a scratch column file, and a way to read it back
+class ColumnFileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "columns_" + std::to_string(getpid()) + ".occol";
+    }
+
+    void TearDown() override {
+        remove(path.c_str());
+    }
+
+    // the whole file
+    std::string readFile() {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream bytes;
+        bytes << file.rdbuf();
+        return bytes.str();
+    }
+
+    // a copy of the item at offset in the file
+    template<class T> static T at(const std::string &bytes, uint64_t offset) {
+        T item;
+        memcpy(&item, bytes.data() + offset, sizeof(T));
+        return item;
+    }
+
+    std::string path;
+};
+
+// The header describes the file, and every section starts on an 8-byte boundary
+TEST_F(ColumnFileTest, HeaderAndSections) {
+    ColumnFileWriter writer;
+    ASSERT_TRUE(writer.open(path.c_str(), ColumnFileModels));
+    const char odd[3] = { 1, 2, 3 };
+    uint64_t first = writer.write(odd, sizeof(odd));
+    int64_t ids[] = { 4, 5 };
+    uint64_t second = writer.write(ids, sizeof(ids));
+    uint64_t name = writer.addString("one");
+    uint64_t other = writer.addString("two");
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rows = 2;
+    header.rowIdsOffset = second;
+    ASSERT_TRUE(writer.finish(header));
+    EXPECT_NE(access((path + ".tmp").c_str(), F_OK), 0) << "the temporary file was left behind";
+
+    std::string bytes = readFile();
+    ASSERT_GE(bytes.size(), sizeof(ColumnFileHeader));
+    ColumnFileHeader read = at<ColumnFileHeader>(bytes, 0);
+    EXPECT_EQ(memcmp(read.magic, "OCCAMCOL", 8), 0);
+    EXPECT_EQ(read.version, 1u);
+    EXPECT_EQ(read.kind, (uint32_t) ColumnFileModels);
+    EXPECT_EQ(read.byteOrder, 0x01020304u);
+    EXPECT_EQ(read.rows, 2u);
+
+    EXPECT_EQ(first, sizeof(ColumnFileHeader));
+    EXPECT_EQ(second % 8, 0u);
+    EXPECT_GE(second, first + sizeof(odd));
+    EXPECT_EQ(read.rowIdsOffset, second);
+    EXPECT_EQ(at<int64_t>(bytes, second), 4);
+    EXPECT_EQ(at<int64_t>(bytes, second + 8), 5);
+
+    EXPECT_EQ(read.stringsOffset % 8, 0u);
+    EXPECT_EQ(read.stringsBytes, 8u);
+    EXPECT_EQ(read.stringsOffset + read.stringsBytes, bytes.size());
+    EXPECT_STREQ(bytes.data() + read.stringsOffset + name, "one");
+    EXPECT_STREQ(bytes.data() + read.stringsOffset + other, "two");
+}
+
+// A report's column file has a row per model and a column per attribute
+TEST_F(ColumnFileTest, ReportColumns) {
+    char *argv[] = { (char *) "test_ColumnFile", (char *) "./tests/data/readFile.txt" };
+    VBMManager *mgr = new VBMManager();
+    mgr->initFromCommandLine(2, argv);
+    Model *first = mgr->makeModel("AB:CD", false);
+    Model *second = mgr->makeModel("ABC:D", false);
+    first->setID(3);
+    first->setAttribute("h", 1.5);
+    first->setAttribute("df", 4);
+    second->setID(8);
+    second->setAttribute("h", 2.5);
+    Report report(mgr);
+    report.addModel(first);
+    report.addModel(second);
+    ASSERT_TRUE(report.writeColumns(path.c_str()));
+
+    std::string bytes = readFile();
+    ColumnFileHeader header = at<ColumnFileHeader>(bytes, 0);
+    EXPECT_EQ(header.kind, (uint32_t) ColumnFileModels);
+    ASSERT_EQ(header.rows, 2u);
+    ASSERT_EQ(header.columns, 2u);
+    EXPECT_EQ(header.columnsOffset % 8, 0u);
+    EXPECT_EQ(header.rowIdsOffset % 8, 0u);
+    EXPECT_EQ(header.rowNamesOffset % 8, 0u);
+    EXPECT_EQ(at<int64_t>(bytes, header.rowIdsOffset), 3);
+    EXPECT_EQ(at<int64_t>(bytes, header.rowIdsOffset + 8), 8);
+    const char *strings = bytes.data() + header.stringsOffset;
+    EXPECT_STREQ(strings + at<uint64_t>(bytes, header.rowNamesOffset), first->getPrintName());
+    EXPECT_STREQ(strings + at<uint64_t>(bytes, header.rowNamesOffset + 8), second->getPrintName());
+
+    for (uint32_t c = 0; c < header.columns; c++) {
+        ColumnFileColumn column = at<ColumnFileColumn>(bytes, header.columnsOffset + c * sizeof(ColumnFileColumn));
+        EXPECT_EQ(column.dataOffset % 8, 0u);
+        double firstValue = at<double>(bytes, column.dataOffset);
+        double secondValue = at<double>(bytes, column.dataOffset + 8);
+        if (strcmp(strings + column.name, "h") == 0) {
+            EXPECT_EQ(firstValue, 1.5);
+            EXPECT_EQ(secondValue, 2.5);
+        } else {
+            EXPECT_STREQ(strings + column.name, "df");
+            EXPECT_EQ(firstValue, 4);
+            EXPECT_TRUE(isnan(secondValue)) << "a model without the attribute should have NaN";
+        }
+    }
+    delete mgr;
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
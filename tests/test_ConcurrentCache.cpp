@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../include/Model.h"
+#include "../include/ModelCache.h"
+#include "../include/RelCache.h"
+#include "../include/Relation.h"
+#include "../include/VariableList.h"
+#include "../include/VBMManager.h"
+
+// Twelve binary variables, so there are 4095 relations: more than enough for the
+// shards of a cache to grow while the threads are adding to them
+static const int VARS = 12, THREADS = 4;
+static const int SUBSETS = (1 << VARS) - 1;
+
+// Fixture class: a manager for a data file written for the test, giving the
+// variable list the relations are built on
+class ConcurrentCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "concurrentcache_" + std::to_string(getpid()) + ".in";
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\n");
+        for (int v = 0; v < VARS; v++)
+            fprintf(file, "v%d,2,1,%c\n", v, 'a' + v);
+        fprintf(file, "\n:data\n");
+        for (int row = 0; row < 4; row++) {
+            for (int v = 0; v < VARS; v++)
+                fprintf(file, "%d ", (row >> (v % 2)) & 1);
+            fprintf(file, "1\n");
+        }
+        fclose(file);
+        char *argv[] = { (char *) "test_ConcurrentCache", (char *) path.c_str() };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        varList = mgr->getVariableList();
+    }
+
+    void TearDown() override {
+        delete mgr;
+        remove(path.c_str());
+    }
+
+    // a new relation on the variables whose bits are set in subset
+    Relation *makeRelation(int subset) {
+        Relation *rel = new Relation(varList, varList->getVarCount());
+        for (int v = 0; v < VARS; v++)
+            if (subset & (1 << v))
+                rel->addVariable(v);
+        return rel;
+    }
+
+    std::string path;
+    VBMManager *mgr;
+    VariableList *varList;
+};
+
+// Threads each building every relation, starting at different places, all get back
+// the same cached relation for each, and the cache finds it afterwards
+TEST_F(ConcurrentCacheTest, RelationsAddedOnce) {
+    RelCache cache;
+    std::vector<std::vector<Relation*>> found(THREADS, std::vector<Relation*>(SUBSETS + 1));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < SUBSETS; i++) {
+                int subset = (i + t * SUBSETS / THREADS) % SUBSETS + 1;
+                Relation *rel = makeRelation(subset);
+                Relation *cached = cache.findOrAddRelation(rel);
+                if (cached != rel)
+                    delete rel;
+                found[t][subset] = cached;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (int subset = 1; subset <= SUBSETS; subset++) {
+        Relation *rel = found[0][subset];
+        ASSERT_NE(rel, nullptr);
+        for (int t = 1; t < THREADS; t++)
+            EXPECT_EQ(found[t][subset], rel) << "relation " << subset;
+        EXPECT_EQ(rel->getVariableCount(), __builtin_popcount(subset));
+        EXPECT_EQ(cache.findRelation(rel->getMask(), rel->getKeySize(), NULL, rel->getVariableCount()), rel);
+    }
+    //-- each relation is cached once, so no two subsets share one
+    std::vector<Relation*> all(found[0].begin() + 1, found[0].end());
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::unique(all.begin(), all.end()), all.end());
+}
+
+// Threads each building every model of a relation and its complement get back
+// the same cached model for each, whichever way round its relations were given
+TEST_F(ConcurrentCacheTest, ModelsAddedOnce) {
+    RelCache relCache;
+    std::vector<Relation*> rels(SUBSETS + 1);
+    for (int subset = 1; subset <= SUBSETS; subset++) {
+        rels[subset] = makeRelation(subset);
+        relCache.addRelation(rels[subset]);
+    }
+
+    ModelCache cache;
+    std::vector<std::vector<Model*>> found(THREADS, std::vector<Model*>(SUBSETS));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < SUBSETS - 1; i++) {
+                int subset = (i + t * SUBSETS / THREADS) % (SUBSETS - 1) + 1;
+                Model *model = new Model();
+                model->addRelation(rels[subset], true);
+                model->addRelation(rels[SUBSETS ^ subset], true);
+                Model *cached = cache.findOrAddModel(model);
+                if (cached != model)
+                    delete model;
+                found[t][subset] = cached;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (int subset = 1; subset < SUBSETS; subset++) {
+        Model *model = found[0][subset];
+        ASSERT_NE(model, nullptr);
+        for (int t = 1; t < THREADS; t++)
+            EXPECT_EQ(found[t][subset], model) << "model " << subset;
+        EXPECT_EQ(found[0][SUBSETS ^ subset], model) << "model " << subset;
+        Relation *pair[] = { rels[subset], rels[SUBSETS ^ subset] };
+        EXPECT_EQ(cache.findModel(pair, 2), model);
+    }
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/Constants.h"
+#include "../include/Key.h"
+#include "../include/Model.h"
+#include "../include/VariableList.h"
+#include "../include/VBMManager.h"
+
+// Four variables of different cardinalities, so each has its own radix
+static const int VARS = 4;
+static const int CARDS[VARS] = { 3, 4, 2, 3 };
+
+// Fixture class: a manager for a data file written for the test, and a model to
+// call getIndicesFromKey on
+class ConstraintIndicesTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "constraintindices_" + std::to_string(getpid()) + ".in";
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\n");
+        for (int v = 0; v < VARS; v++)
+            fprintf(file, "v%d,%d,1,%c\n", v, CARDS[v], 'a' + v);
+        fprintf(file, "\n:data\n");
+        for (int row = 0; row < 12; row++) {
+            for (int v = 0; v < VARS; v++)
+                fprintf(file, "%d ", row % CARDS[v] + 1);
+            fprintf(file, "1\n");
+        }
+        fclose(file);
+        char *argv[] = { (char *) "test_ConstraintIndices", (char *) path.c_str() };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        varList = mgr->getVariableList();
+        model = mgr->makeModel("A:B:C:D", false);
+    }
+
+    void TearDown() override {
+        delete mgr;
+        remove(path.c_str());
+    }
+
+    std::string path;
+    VBMManager *mgr;
+    VariableList *varList;
+    Model *model;
+};
+
+// For every constraint, fixing any of the variables to any of their values, the
+// states returned are those of the state space, numbered with the last variable
+// changing fastest, which agree with every fixed value
+TEST_F(ConstraintIndicesTest, MatchesStateSpace) {
+    int statespace = 1;
+    for (int v = 0; v < VARS; v++)
+        statespace *= CARDS[v];
+    int keysize = mgr->getKeySize();
+    KeySegment *key = new KeySegment[keysize];
+    int varindices[VARS] = { 0, 1, 2, 3 };
+    int values[VARS] = { 0, 0, 0, 0 };
+    //-- step through every constraint, each variable taking DONT_CARE (as its
+    //-- cardinality) or one of its values
+    long keys = 0;
+    for (;;) {
+        int fixed[VARS];
+        bool anyFixed = false;
+        for (int v = 0; v < VARS; v++) {
+            fixed[v] = values[v] == CARDS[v] ? DONT_CARE : values[v];
+            anyFixed = anyFixed || fixed[v] != DONT_CARE;
+        }
+        Key::buildKey(key, keysize, varList, varindices, fixed, VARS);
+
+        std::vector<int> expected;
+        if (anyFixed) {
+            for (int state = 0; state < statespace; state++) {
+                bool match = true;
+                int rest = state;
+                for (int v = VARS - 1; v >= 0; v--) {
+                    if (fixed[v] != DONT_CARE && rest % CARDS[v] != fixed[v])
+                        match = false;
+                    rest /= CARDS[v];
+                }
+                if (match)
+                    expected.push_back(state);
+            }
+        }
+        int counter = -1;
+        int *indices = model->getIndicesFromKey(key, varList, &counter);
+        ASSERT_EQ(counter, (int) expected.size()) << "constraint " << keys;
+        EXPECT_EQ(std::vector<int>(indices, indices + counter), expected) << "constraint " << keys;
+        delete[] indices;
+        keys++;
+
+        int v = VARS - 1;
+        while (v >= 0 && ++values[v] > CARDS[v]) {
+            values[v] = 0;
+            v--;
+        }
+        if (v < 0)
+            break;
+    }
+    EXPECT_EQ(keys, 4 * 5 * 3 * 4);
+    delete[] key;
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/Key.h"
+#include "../include/Model.h"
+#include "../include/Relation.h"
+#include "../include/Table.h"
+#include "../include/VariableList.h"
+#include "../include/VBMManager.h"
+
+typedef std::vector<KeySegment> KeyVec;
+
+// Fixture class: a directed data file written for the test, with three IVs and a
+// DV, and test data which has IV states the training data doesn't
+class MaxProjectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "maxprojection_" + std::to_string(getpid()) + ".in";
+        srand(1618);
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\nva,3,1,a\nvb,2,1,b\nvc,3,1,c\nvz,3,2,z\n\n:data\n");
+        writeRows(file, 300, false);
+        fprintf(file, "\n:test\n");
+        writeRows(file, 100, true);
+        fclose(file);
+        char *argv[] = { (char *) "test_MaxProjection", (char *) path.c_str() };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        varList = mgr->getVariableList();
+        keysize = mgr->getKeySize();
+    }
+
+    void TearDown() override {
+        delete mgr;
+        remove(path.c_str());
+    }
+
+    // rows with the DV mostly following a; training rows never have a and c both 3
+    void writeRows(FILE *file, int rows, bool all) {
+        for (int n = 0; n < rows; n++) {
+            int a = rand() % 3, b = rand() % 2, c = rand() % 3;
+            if (!all && a == 2 && c == 2)
+                c = rand() % 2;
+            int z = rand() % 4 ? a : rand() % 3;
+            fprintf(file, "%d %d %d %d 1\n", a + 1, b + 1, c + 1, z + 1);
+        }
+    }
+
+    KeyVec masked(KeySegment *key, KeySegment *mask) {
+        KeyVec result(keysize);
+        for (int k = 0; k < keysize; k++)
+            result[k] = key[k] | mask[k];
+        return result;
+    }
+
+    // a copy of the fit table of the named model
+    Table *fit(const char *name) {
+        Model *model = mgr->makeModel(name, true);
+        EXPECT_TRUE(mgr->makeFitTable(model));
+        Table *qt = new Table(keysize, mgr->getFitTable()->getTupleCount());
+        qt->copy(mgr->getFitTable());
+        return qt;
+    }
+
+    // the max projection, found tuple by tuple: for each IV state in qt, the p value
+    // of its DV state with the greatest q, ties going to the earlier DV in DV order
+    std::map<KeyVec, double> expectedMax(Table *qt, Table *data) {
+        KeySegment *mask = mgr->getIndRelation()->getMask();
+        int dv = varList->getDV();
+        std::map<KeyVec, std::pair<double, int>> best;
+        std::map<KeyVec, double> result;
+        for (long long i = 0; i < qt->getTupleCount(); i++) {
+            KeyVec iv = masked(qt->getKey(i), mask);
+            double q = qt->getValue(i);
+            int qdv = Key::getKeyValue(qt->getKey(i), keysize, varList, dv);
+            auto found = best.find(iv);
+            if (found != best.end()) {
+                double maxq = found->second.first;
+                int maxdv = found->second.second;
+                if (fabs(maxq - q) < DBL_EPSILON ? mgr->getDvOrder(qdv) >= mgr->getDvOrder(maxdv) : q <= maxq)
+                    continue;
+            }
+            best[iv] = std::make_pair(q, qdv);
+            long long p = data->indexOf(qt->getKey(i));
+            result[iv] = p >= 0 ? data->getValue(p) : 0.0;
+        }
+        return result;
+    }
+
+    std::string path;
+    VBMManager *mgr;
+    VariableList *varList;
+    int keysize;
+};
+
+// On the training data, the max projection has one tuple per IV state of the
+// fit, holding the p value of the most likely DV state
+TEST_F(MaxProjectionTest, MatchesArgmax) {
+    Table *qt = fit("IV:AZ:BCZ");
+    Table *data = mgr->getInputData();
+    std::map<KeyVec, double> expected = expectedMax(qt, data);
+    Table *maxpt = new Table(keysize, qt->getTupleCount());
+    ASSERT_TRUE(mgr->makeMaxProjection(qt, maxpt, data, mgr->getIndRelation(), mgr->getDepRelation(), NULL));
+    ASSERT_EQ(maxpt->getTupleCount(), (long long) expected.size());
+    long long i = 0;
+    for (auto &entry : expected) {
+        EXPECT_EQ(KeyVec(maxpt->getKey(i), maxpt->getKey(i) + keysize), entry.first);
+        EXPECT_DOUBLE_EQ(maxpt->getValue(i), entry.second);
+        i++;
+    }
+    delete maxpt;
+    delete qt;
+}
+
+// On test data, IV states the fit doesn't have are missed; each is predicted by
+// the default rule, from its first tuple with the default DV value
+TEST_F(MaxProjectionTest, DefaultRuleForMissedStates) {
+    Table *qt = fit("IV:AZ:BCZ");
+    Table *test = mgr->getTestData();
+    ASSERT_NE(test, nullptr);
+    KeySegment *mask = mgr->getIndRelation()->getMask();
+    std::map<KeyVec, double> expected = expectedMax(qt, test);
+    int dv = varList->getDV();
+    int defaultDV = mgr->getDefaultDVIndex();
+    double expectedMissed = 0;
+    //-- in table order, a tuple is missed if its IV state has no prediction yet; the
+    //-- first with the default DV value gives its state one
+    for (long long i = 0; i < test->getTupleCount(); i++) {
+        KeyVec iv = masked(test->getKey(i), mask);
+        if (expected.count(iv))
+            continue;
+        expectedMissed += test->getValue(i);
+        if (test->getValue(i) > 0 && Key::getKeyValue(test->getKey(i), keysize, varList, dv) == defaultDV)
+            expected[iv] = test->getValue(i);
+    }
+    ASSERT_GT(expectedMissed, 0);
+
+    Table *maxpt = new Table(keysize, qt->getTupleCount());
+    double missed = -1;
+    ASSERT_TRUE(mgr->makeMaxProjection(qt, maxpt, test, mgr->getIndRelation(), mgr->getDepRelation(), &missed));
+    EXPECT_DOUBLE_EQ(missed, expectedMissed);
+    ASSERT_EQ(maxpt->getTupleCount(), (long long) expected.size());
+    long long i = 0;
+    for (auto &entry : expected) {
+        EXPECT_EQ(KeyVec(maxpt->getKey(i), maxpt->getKey(i) + keysize), entry.first);
+        EXPECT_DOUBLE_EQ(maxpt->getValue(i), entry.second);
+        i++;
+    }
+    delete maxpt;
+    delete qt;
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
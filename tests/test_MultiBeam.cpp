@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "../include/Constants.h"
+#include "../include/Model.h"
+#include "../include/Report.h"
+#include "../include/SearchEngine.h"
+#include "../include/VBMManager.h"
+
+// Load a manager from a data file, as occ does, set up for a full-up search
+static VBMManager *loadManager(const char *filename) {
+    char *argv[] = { (char *) "test_MultiBeam", (char *) filename };
+    VBMManager *mgr = new VBMManager();
+    mgr->initFromCommandLine(2, argv);
+    mgr->setSearch("full-up");
+    mgr->setRefModel("bottom");
+    return mgr;
+}
+
+// Fixture class: a manager for the test data, with its bottom model as the start
+class MultiBeamTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mgr = loadManager("./tests/data/readFile.txt");
+        start = mgr->getBottomRefModel();
+        mgr->computeL2Statistics(start);
+        start->setAttribute(ATTRIBUTE_LEVEL, 0.0);
+    }
+
+    void TearDown() override {
+        delete mgr;
+    }
+
+    VBMManager *mgr;
+    Model *start;
+};
+
+// Each beam keeps the models a search by its attribute alone would keep
+TEST_F(MultiBeamTest, BeamsMatchSingleSearches) {
+    MultiBeamSearch search(mgr, mgr->getSearch());
+    ASSERT_TRUE(search.addBeams("information, bic:ascending", 2));
+    ASSERT_EQ(search.getBeamCount(), 2);
+    search.start(start);
+    for (int level = 1; level <= 2; level++)
+        search.searchLevel(level);
+
+    for (int b = 0; b < search.getBeamCount(); b++) {
+        SearchEngine *beam = search.getBeam(b);
+        VBMManager *other = loadManager("./tests/data/readFile.txt");
+        Model *otherStart = other->getBottomRefModel();
+        other->computeL2Statistics(otherStart);
+        SearchEngine single(other, other->getSearch());
+        single.setSortAttr(beam->getSortAttr());
+        single.setSortDirection(beam->getSortDirection());
+        single.setWidth(2);
+        single.setLevels(2);
+        Model **models = single.search(otherStart);
+
+        const std::vector<Model*> &kept = search.getAllKept(b);
+        size_t count = 0;
+        for (; models[count]; count++) {
+            ASSERT_LT(count, kept.size()) << "beam " << b;
+            EXPECT_STREQ(kept[count]->getPrintName(), models[count]->getPrintName()) << "beam " << b;
+        }
+        EXPECT_EQ(count, kept.size()) << "beam " << b;
+        delete[] models;
+        delete other;
+    }
+}
+
+// A model kept by a beam has as its progenitor, in that beam, the start or a model
+// the beam kept at the level before
+TEST_F(MultiBeamTest, ProgenitorsPerBeam) {
+    MultiBeamSearch search(mgr, mgr->getSearch());
+    ASSERT_TRUE(search.addBeams("information, bic:ascending", 2));
+    search.start(start);
+    for (int level = 1; level <= 2; level++)
+        search.searchLevel(level);
+
+    for (int b = 0; b < search.getBeamCount(); b++) {
+        EXPECT_EQ(search.getProgenitor(b, start), nullptr);
+        const std::vector<Model*> &kept = search.getAllKept(b);
+        for (size_t i = 0; i < kept.size(); i++) {
+            Model *progen = search.getProgenitor(b, kept[i]);
+            ASSERT_NE(progen, nullptr) << kept[i]->getPrintName();
+            bool found = progen == start;
+            for (size_t j = 0; j < i && !found; j++)
+                found = kept[j] == progen;
+            EXPECT_TRUE(found) << kept[i]->getPrintName() << " in beam " << b;
+        }
+    }
+}
+
+// A report of models whose IDs aren't 1..n is numbered from 1, with the
+// progenitor IDs following, and a progenitor outside the report shown as 0
+TEST_F(MultiBeamTest, ReportMapsSparseIds) {
+    Model *first = mgr->makeModel("AB:C:D", true);
+    Model *second = mgr->makeModel("AB:CD", true);
+    Model *outside = mgr->makeModel("AC:B:D", true);
+    Model *models[] = { start, first, second, outside };
+    for (Model *model : models) {
+        mgr->computeL2Statistics(model);
+        mgr->computeDFStatistics(model);
+    }
+    start->setID(40);
+    first->setID(57);
+    second->setID(99);
+    outside->setID(1000);
+    first->setProgenitor(start);
+    second->setProgenitor(first);
+    start->setAttribute(ATTRIBUTE_PROG_ID, 0);
+    first->setAttribute(ATTRIBUTE_PROG_ID, 40);
+    second->setAttribute(ATTRIBUTE_PROG_ID, 1000);
+
+    Report report(mgr);
+    report.addModel(second);
+    report.addModel(first);
+    report.addModel(start);
+    report.setAttributes("level$I, h, ddf, prog_id");
+    FILE *out = tmpfile();
+    ASSERT_NE(out, nullptr);
+    report.print(out);
+    fclose(out);
+
+    //-- the search direction is ascending, so the first model listed has the largest ID
+    EXPECT_EQ(second->getID(), 3);
+    EXPECT_EQ(first->getID(), 2);
+    EXPECT_EQ(start->getID(), 1);
+    EXPECT_EQ(first->getAttribute(ATTRIBUTE_PROG_ID), 1);
+    EXPECT_EQ(second->getAttribute(ATTRIBUTE_PROG_ID), 0);
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
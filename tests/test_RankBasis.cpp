@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/RankBasis.h"
+
+// Rank of a dense 0/1 matrix by Gaussian elimination with partial pivoting
+static int denseRank(std::vector<std::vector<double> > rows, int columns) {
+    int rank = 0;
+    for (int c = 0; c < columns && rank < (int) rows.size(); c++) {
+        int best = rank;
+        for (int r = rank + 1; r < (int) rows.size(); r++) {
+            if (fabs(rows[r][c]) > fabs(rows[best][c]))
+                best = r;
+        }
+        if (fabs(rows[best][c]) < 1e-9)
+            continue;
+        std::swap(rows[best], rows[rank]);
+        for (int r = rank + 1; r < (int) rows.size(); r++) {
+            double factor = rows[r][c] / rows[rank][c];
+            for (int k = c; k < columns; k++)
+                rows[r][k] -= factor * rows[rank][k];
+        }
+        rank++;
+    }
+    return rank;
+}
+
+// Rows which are independent raise the rank; a dependent row does not
+TEST(RankBasisTest, AddRow) {
+    RankBasis basis;
+    const int ab[] = { 0, 1 }, bc[] = { 1, 2 }, ac[] = { 0, 2 }, abc[] = { 0, 1, 2 };
+    EXPECT_TRUE(basis.addRow(ab, 2));
+    EXPECT_TRUE(basis.addRow(bc, 2));
+    EXPECT_FALSE(basis.spans(ac, 2));
+    EXPECT_TRUE(basis.addRow(ac, 2));
+    EXPECT_EQ(basis.getRank(), 3);
+
+    //-- three columns are now spanned, so nothing more is independent
+    EXPECT_TRUE(basis.spans(abc, 3));
+    EXPECT_FALSE(basis.addRow(abc, 3));
+    EXPECT_FALSE(basis.addRow(ab, 2));
+    EXPECT_EQ(basis.getRank(), 3);
+}
+
+// A copy grows on its own, leaving the original as it was
+TEST(RankBasisTest, Copy) {
+    RankBasis basis;
+    const int a[] = { 0 }, b[] = { 1 }, ab[] = { 0, 1 };
+    basis.addRow(a, 1);
+    RankBasis copy(basis);
+    EXPECT_TRUE(copy.addRow(b, 1));
+    EXPECT_TRUE(copy.spans(ab, 2));
+    EXPECT_EQ(copy.getRank(), 2);
+    EXPECT_FALSE(basis.spans(ab, 2));
+    EXPECT_EQ(basis.getRank(), 1);
+}
+
+// Rows added one at a time give the same rank as dense elimination
+TEST(RankBasisTest, MatchesDenseRank) {
+    srand(12345);
+    const int columns = 12;
+    for (int trial = 0; trial < 50; trial++) {
+        int rowCount = 1 + rand() % 16;
+        std::vector<std::vector<double> > dense;
+        RankBasis basis;
+        for (int r = 0; r < rowCount; r++) {
+            std::vector<int> cols;
+            std::vector<double> row(columns, 0);
+            for (int c = 0; c < columns; c++) {
+                if (rand() % 3 == 0) {
+                    cols.push_back(c);
+                    row[c] = 1;
+                }
+            }
+            dense.push_back(row);
+            long before = basis.getRank();
+            bool grew = basis.addRow(cols.data(), cols.size());
+            EXPECT_EQ(grew, basis.getRank() == before + 1);
+            EXPECT_EQ(basis.getRank(), denseRank(dense, columns));
+        }
+    }
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
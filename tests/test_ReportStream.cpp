@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/Model.h"
+#include "../include/ReportStream.h"
+#include "../include/VBMManager.h"
+
+// Fixture class: a manager for the test data, and scratch report files
+class ReportStreamTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char *argv[] = { (char *) "test_ReportStream", (char *) "./tests/data/readFile.txt" };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        std::string base = ::testing::TempDir() + "stream_" + std::to_string(getpid());
+        path = base + ".csv";
+        sortedPath = base + ".sorted.csv";
+    }
+
+    void TearDown() override {
+        remove(path.c_str());
+        remove(sortedPath.c_str());
+        delete mgr;
+    }
+
+    // a model with the given ID, level and score
+    Model *model(const char *name, int id, int level, double score) {
+        Model *model = mgr->makeModel(name, false);
+        model->setID(id);
+        model->setAttribute("Level", level);
+        model->setAttribute("score", score);
+        return model;
+    }
+
+    // the lines of a file
+    static std::vector<std::string> readLines(const std::string &filename) {
+        std::ifstream file(filename);
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(file, line))
+            lines.push_back(line);
+        return lines;
+    }
+
+    VBMManager *mgr;
+    std::string path, sortedPath;
+};
+
+// Each level is written as it comes, and the sorted report merges the levels
+TEST_F(ReportStreamTest, MergesLevels) {
+    ReportStream stream;
+    ASSERT_TRUE(stream.open(path.c_str(), ReportStream::CSV, "score", "score", Direction::Descending,
+            Direction::Ascending));
+    Model *level1[] = { model("AB:C:D", 1, 1, 3.0), model("A:BC:D", 2, 1, 7.0) };
+    Model *level2[] = { model("ABC:D", 3, 2, 5.0), model("AB:CD", 4, 2, 9.0), model("AB:BC:D", 5, 2, 1.0) };
+    Model *level3[] = { model("ABCD", 6, 3, 7.0), model("ABC:BD", 7, 3, 4.0) };
+    stream.writeLevel(level1, 2);
+    stream.writeLevel(level2, 3);
+    stream.writeLevel(level3, 2);
+
+    //-- the streamed file has each level sorted, in the order the levels were written
+    std::vector<std::string> lines = readLines(path);
+    ASSERT_EQ(lines.size(), 8u);
+    EXPECT_EQ(lines[0], "ID,MODEL,score");
+    std::vector<std::string> ids;
+    for (size_t i = 1; i < lines.size(); i++)
+        ids.push_back(lines[i].substr(0, lines[i].find(',')));
+    EXPECT_EQ(ids, std::vector<std::string>({ "2", "1", "4", "3", "5", "6", "7" }));
+
+    //-- the sorted file has every model by score; the tie goes to the later level
+    ASSERT_TRUE(stream.writeSorted(sortedPath.c_str()));
+    lines = readLines(sortedPath);
+    ASSERT_EQ(lines.size(), 8u);
+    EXPECT_EQ(lines[0], "ID,MODEL,score");
+    ids.clear();
+    for (size_t i = 1; i < lines.size(); i++)
+        ids.push_back(lines[i].substr(0, lines[i].find(',')));
+    EXPECT_EQ(ids, std::vector<std::string>({ "4", "6", "2", "3", "7", "1", "5" }));
+    EXPECT_EQ(lines[1], std::string("4,") + level2[1]->getPrintName() + ",9");
+    stream.close();
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "../include/Model.h"
+#include "../include/Report.h"
+#include "../include/SearchCheckpoint.h"
+#include "../include/VBMManager.h"
+
+// Load a manager from a data file, as occ does
+static VBMManager *loadManager(const char *filename) {
+    char *argv[] = { (char *) "test_SearchCheckpoint", (char *) filename };
+    VBMManager *mgr = new VBMManager();
+    mgr->initFromCommandLine(2, argv);
+    return mgr;
+}
+
+// Fixture class: a manager for the test data, and a scratch checkpoint file
+class SearchCheckpointTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mgr = loadManager("./tests/data/readFile.txt");
+        path = ::testing::TempDir() + "checkpoint_" + std::to_string(getpid()) + ".txt";
+    }
+
+    void TearDown() override {
+        remove(path.c_str());
+        delete mgr;
+    }
+
+    // make and fit a model, so that it has some attributes to save
+    Model *fitModel(const char *name) {
+        Model *model = mgr->makeModel(name, true);
+        mgr->computeL2Statistics(model);
+        mgr->computeDFStatistics(model);
+        return model;
+    }
+
+    VBMManager *mgr;
+    std::string path;
+};
+
+// A checkpoint read back by a new manager for the same data gives the same level,
+// report and kept models, with the same IDs, progenitors and attributes
+TEST_F(SearchCheckpointTest, RoundTrip) {
+    Model *bottom = fitModel("A:B:C:D");
+    Model *first = fitModel("AB:C:D");
+    Model *second = fitModel("AB:CD");
+    bottom->setID(1);
+    first->setID(2);
+    second->setID(7);
+    first->setProgenitor(bottom);
+    second->setProgenitor(first);
+
+    Report report(mgr);
+    report.addModel(first);
+    Model *kept[] = { second };
+    ASSERT_TRUE(SearchCheckpoint::write(path.c_str(), mgr, 2, kept, 1, &report));
+
+    VBMManager *other = loadManager("./tests/data/readFile.txt");
+    Report restored(other);
+    int level = 0, maxID = 0;
+    Model **models = SearchCheckpoint::read(path.c_str(), other, &restored, &level, &maxID);
+    ASSERT_NE(models, nullptr);
+    EXPECT_EQ(level, 2);
+    EXPECT_EQ(maxID, 7);
+
+    ASSERT_NE(models[0], nullptr);
+    EXPECT_EQ(models[1], nullptr) << "expected one kept model";
+    Model *model = models[0];
+    EXPECT_STREQ(model->getPrintName(), second->getPrintName());
+    EXPECT_EQ(model->getID(), 7);
+    EXPECT_DOUBLE_EQ(model->getAttribute("h"), second->getAttribute("h"));
+    EXPECT_DOUBLE_EQ(model->getAttribute("df"), second->getAttribute("df"));
+    ASSERT_NE(model->getProgenitor(), nullptr);
+    EXPECT_STREQ(model->getProgenitor()->getPrintName(), first->getPrintName());
+    ASSERT_NE(model->getProgenitor()->getProgenitor(), nullptr);
+    EXPECT_STREQ(model->getProgenitor()->getProgenitor()->getPrintName(), bottom->getPrintName());
+
+    ASSERT_EQ(restored.modelCount, 1);
+    EXPECT_STREQ(restored.models[0]->getPrintName(), first->getPrintName());
+    EXPECT_EQ(restored.models[0], model->getProgenitor());
+
+    delete[] models;
+    delete other;
+}
+
+// A checkpoint made for other data is rejected
+TEST_F(SearchCheckpointTest, RejectsOtherData) {
+    Model *model = fitModel("AB:CD");
+    Model *kept[] = { model };
+    ASSERT_TRUE(SearchCheckpoint::write(path.c_str(), mgr, 1, kept, 1, NULL));
+
+    // the same variables, with one count changed
+    std::ifstream in("./tests/data/readFile.txt");
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string data = text.str();
+    size_t pos = data.find(" 1 1 1 1  19");
+    ASSERT_NE(pos, std::string::npos);
+    data.replace(pos, 12, " 1 1 1 1  20");
+    std::string otherPath = ::testing::TempDir() + "checkpoint_data_" + std::to_string(getpid()) + ".txt";
+    std::ofstream(otherPath) << data;
+
+    VBMManager *other = loadManager(otherPath.c_str());
+    int level = 0;
+    Model **models = SearchCheckpoint::read(path.c_str(), other, NULL, &level);
+    EXPECT_EQ(models, nullptr);
+
+    delete other;
+    remove(otherPath.c_str());
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
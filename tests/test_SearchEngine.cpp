@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../include/Constants.h"
+#include "../include/Model.h"
+#include "../include/SearchBase.h"
+#include "../include/SearchEngine.h"
+#include "../include/VBMManager.h"
+
+// Load a manager from a data file, as occ does, set up for a full-up search
+static VBMManager *loadManager(const char *filename) {
+    char *argv[] = { (char *) "test_SearchEngine", (char *) filename };
+    VBMManager *mgr = new VBMManager();
+    mgr->initFromCommandLine(2, argv);
+    mgr->setSearch("full-up");
+    mgr->setRefModel("bottom");
+    return mgr;
+}
+
+// Fixture class: a manager for the test data, with its bottom model as the start
+class SearchEngineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mgr = loadManager("./tests/data/readFile.txt");
+        start = mgr->getBottomRefModel();
+        mgr->computeL2Statistics(start);
+    }
+
+    void TearDown() override {
+        delete mgr;
+    }
+
+    // the names of a null-terminated model list
+    static std::vector<std::string> names(Model **models) {
+        std::vector<std::string> result;
+        for (Model **model = models; *model; model++)
+            result.push_back((*model)->getPrintName());
+        return result;
+    }
+
+    VBMManager *mgr;
+    Model *start;
+};
+
+// One level keeps the best "width" of the generated models, best first, with
+// ties broken by name, and gives each its level and progenitor
+TEST_F(SearchEngineTest, SearchLevelKeepsBest) {
+    //-- the expected beam, ranked by hand from the same candidates
+    Model **generated = mgr->getSearch()->search(start);
+    ASSERT_NE(generated, nullptr);
+    std::vector<Model*> candidates;
+    for (Model **model = generated; *model; model++) {
+        mgr->computeSortStatistic(*model, ATTRIBUTE_EXPLAINED_I);
+        candidates.push_back(*model);
+    }
+    delete[] generated;
+    ASSERT_GT(candidates.size(), 3u);
+    std::sort(candidates.begin(), candidates.end(), [](Model *a, Model *b) {
+        double ia = a->getAttribute(ATTRIBUTE_EXPLAINED_I), ib = b->getAttribute(ATTRIBUTE_EXPLAINED_I);
+        if (ia != ib)
+            return ia > ib;
+        return strcmp(a->getPrintName(), b->getPrintName()) < 0;
+    });
+
+    SearchEngine engine(mgr, mgr->getSearch());
+    engine.setSortAttr(ATTRIBUTE_EXPLAINED_I);
+    engine.setSortDirection(Direction::Descending);
+    engine.setWidth(3);
+    engine.setThreadCount(1);
+    Model **kept = engine.searchLevel(&start, 1, 1, false);
+    EXPECT_EQ(engine.getLevelGenerated(), (long) candidates.size());
+    EXPECT_EQ(engine.getLevelKept(), 3);
+    std::vector<std::string> keptNames = names(kept);
+    ASSERT_EQ(keptNames.size(), 3u);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(keptNames[i], candidates[i]->getPrintName());
+        EXPECT_EQ(kept[i]->getAttribute(ATTRIBUTE_LEVEL), 1);
+        EXPECT_EQ(kept[i]->getProgenitor(), start);
+    }
+    delete[] kept;
+}
+
+// A whole search returns the kept models of each level in level order, and
+// evaluating on several threads keeps the same models
+TEST_F(SearchEngineTest, SearchMatchesAcrossThreads) {
+    SearchEngine engine(mgr, mgr->getSearch());
+    engine.setSortAttr(ATTRIBUTE_EXPLAINED_I);
+    engine.setSortDirection(Direction::Descending);
+    engine.setWidth(2);
+    engine.setLevels(3);
+    engine.setThreadCount(1);
+    Model **serial = engine.search(start);
+    std::vector<std::string> serialNames = names(serial);
+    EXPECT_EQ(engine.getTotalKept(), (long) serialNames.size());
+    int level = 1;
+    for (Model **model = serial; *model; model++) {
+        EXPECT_GE((*model)->getAttribute(ATTRIBUTE_LEVEL), level);
+        level = (int) (*model)->getAttribute(ATTRIBUTE_LEVEL);
+    }
+    delete[] serial;
+
+    VBMManager *other = loadManager("./tests/data/readFile.txt");
+    Model *otherStart = other->getBottomRefModel();
+    other->computeL2Statistics(otherStart);
+    SearchEngine threaded(other, other->getSearch());
+    threaded.setSortAttr(ATTRIBUTE_EXPLAINED_I);
+    threaded.setSortDirection(Direction::Descending);
+    threaded.setWidth(2);
+    threaded.setLevels(3);
+    threaded.setThreadCount(4);
+    Model **parallel = threaded.search(otherStart);
+    EXPECT_EQ(names(parallel), serialNames);
+    delete[] parallel;
+    delete other;
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/Model.h"
+#include "../include/ModelCache.h"
+#include "../include/Relation.h"
+#include "../include/SearchBase.h"
+#include "../include/VariableList.h"
+#include "../include/VBMManager.h"
+
+typedef std::vector<int> VarSet;
+
+// Seventy binary variables, so that variable sets take two 64-bit words
+static const int VARS = 70;
+
+// Fixture class: a manager for a data file written for the test, set up for a
+// full-up search
+class SearchFullUpTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "searchfullup_" + std::to_string(getpid()) + ".in";
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\n");
+        for (int v = 0; v < VARS; v++)
+            fprintf(file, "v%d,2,1,%c%c\n", v, 'a' + v / 26, 'a' + v % 26);
+        fprintf(file, "\n:data\n");
+        for (int row = 0; row < 2; row++) {
+            for (int v = 0; v < VARS; v++)
+                fprintf(file, "%d ", (row + v) % 2 + 1);
+            fprintf(file, "1\n");
+        }
+        fclose(file);
+        char *argv[] = { (char *) "test_SearchFullUp", (char *) path.c_str() };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        ASSERT_EQ(mgr->getVariableList()->getVarCount(), VARS);
+        mgr->setSearch("full-up");
+    }
+
+    void TearDown() override {
+        delete mgr;
+        remove(path.c_str());
+    }
+
+    Relation *relation(const VarSet &vars) {
+        return mgr->getRelation((int *) vars.data(), vars.size());
+    }
+
+    // the model with the given relations, and a single-variable relation for each
+    // variable in none of them
+    Model *makeModel(const std::vector<VarSet> &rels) {
+        std::vector<bool> used(VARS, false);
+        Model *model = new Model();
+        for (const VarSet &vars : rels) {
+            model->addRelation(relation(vars), true);
+            for (int v : vars)
+                used[v] = true;
+        }
+        for (int v = 0; v < VARS; v++)
+            if (!used[v])
+                model->addRelation(relation(VarSet(1, v)), true);
+        Model *cached = mgr->getModelCache()->findOrAddModel(model);
+        if (cached != model)
+            delete model;
+        return cached;
+    }
+
+    // the parents of a model, found from the definition: for each set of variables
+    // not in any one relation, but with every subset one smaller in some relation,
+    // the model with that set added as a relation
+    std::vector<Model*> expectedParents(Model *start) {
+        int relCount = start->getRelationCount();
+        auto covered = [&](const VarSet &vars) {
+            for (int r = 0; r < relCount; r++) {
+                Relation *rel = start->getRelation(r);
+                bool all = true;
+                for (int v : vars)
+                    all = all && rel->findVariable(v) >= 0;
+                if (all)
+                    return true;
+            }
+            return false;
+        };
+        auto isParent = [&](const VarSet &vars) {
+            if (covered(vars))
+                return false;
+            for (size_t skip = 0; skip < vars.size(); skip++) {
+                VarSet less;
+                for (size_t i = 0; i < vars.size(); i++)
+                    if (i != skip)
+                        less.push_back(vars[i]);
+                if (!covered(less))
+                    return false;
+            }
+            return true;
+        };
+        std::vector<VarSet> sets;
+        //-- any two variables not together in a relation
+        for (int a = 0; a < VARS; a++)
+            for (int b = a + 1; b < VARS; b++)
+                if (isParent(VarSet { a, b }))
+                    sets.push_back(VarSet { a, b });
+        //-- larger sets only use variables which share a relation with another
+        VarSet rich;
+        for (int v = 0; v < VARS; v++) {
+            for (int r = 0; r < relCount; r++) {
+                Relation *rel = start->getRelation(r);
+                if (rel->getVariableCount() > 1 && rel->findVariable(v) >= 0) {
+                    rich.push_back(v);
+                    break;
+                }
+            }
+        }
+        for (long bits = 0; bits < (1L << rich.size()); bits++) {
+            if (__builtin_popcountl(bits) < 3)
+                continue;
+            VarSet vars;
+            for (size_t i = 0; i < rich.size(); i++)
+                if (bits & (1L << i))
+                    vars.push_back(rich[i]);
+            if (isParent(vars))
+                sets.push_back(vars);
+        }
+        std::vector<Model*> parents;
+        for (const VarSet &vars : sets) {
+            Model *parent = new Model();
+            for (int r = 0; r < relCount; r++)
+                parent->addRelation(start->getRelation(r), true);
+            parent->addRelation(relation(vars), true);
+            parents.push_back(parent);
+        }
+        return parents;
+    }
+
+    // check the search's parents of start against those from the definition
+    void checkParents(const std::vector<VarSet> &rels) {
+        Model *start = makeModel(rels);
+        std::vector<Model*> expected = expectedParents(start);
+        Model **generated = mgr->getSearch()->search(start);
+        ASSERT_NE(generated, nullptr);
+        size_t count = 0;
+        for (Model **model = generated; *model; model++) {
+            count++;
+            bool found = false;
+            for (Model *parent : expected)
+                found = found || parent->hasSameStructure(*model);
+            EXPECT_TRUE(found) << (*model)->getPrintName() << " from " << start->getPrintName();
+        }
+        EXPECT_EQ(count, expected.size()) << start->getPrintName();
+        delete[] generated;
+        for (Model *parent : expected)
+            delete parent;
+    }
+
+    std::string path;
+    VBMManager *mgr;
+};
+
+// From the independence model, every pair of variables is a parent
+TEST_F(SearchFullUpTest, Independence) {
+    checkParents({});
+}
+
+// Starting models with loops, overlaps, and relations whose variables fall in
+// both words of a variable set, each searched in turn with the same searcher
+TEST_F(SearchFullUpTest, LoopsAndOverlaps) {
+    checkParents({ { 0, 1 }, { 1, 2 }, { 0, 2 } });
+    checkParents({ { 0, 63 }, { 63, 64 }, { 64, 69 }, { 0, 69 } });
+    checkParents({ { 3, 4, 5 }, { 4, 5, 6 }, { 5, 6, 7 }, { 3, 7 } });
+    checkParents({ { 10, 62, 63, 64 }, { 62, 63, 64, 65 }, { 10, 65 } });
+    checkParents({ { 0, 1 }, { 1, 2 }, { 0, 2 } });
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/Constants.h"
+#include "../include/Model.h"
+#include "../include/SearchBase.h"
+#include "../include/SearchEngine.h"
+#include "../include/VBMManager.h"
+
+// Fixture class: a data file written for the test, of five binary variables with
+// a chain A-B-C and a separate, stronger, pair D-E. A model with a loop among A, B
+// and D, such as AB:AD:BD:C:DE, is bounded by its cover {ABDE, C}, which like it
+// lacks BC; so once AB:BC:DE is in the beam it can be skipped.
+class SearchPruneTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "searchprune_" + std::to_string(getpid()) + ".in";
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\n");
+        for (int v = 0; v < 5; v++)
+            fprintf(file, "v%c,2,1,%c\n", 'a' + v, 'a' + v);
+        fprintf(file, "\n:data\n");
+        for (int state = 0; state < 32; state++) {
+            int a = (state >> 4) & 1, b = (state >> 3) & 1, c = (state >> 2) & 1;
+            int d = (state >> 1) & 1, e = state & 1;
+            double p = 0.25 * (a == b ? 0.9 : 0.1) * (b == c ? 0.8 : 0.2) * (d == e ? 0.95 : 0.05);
+            fprintf(file, "%d %d %d %d %d %.0f\n", a + 1, b + 1, c + 1, d + 1, e + 1, round(p * 10000));
+        }
+        fclose(file);
+    }
+
+    void TearDown() override {
+        remove(path.c_str());
+    }
+
+    // run a full-up search from the bottom, returning the names of the kept models
+    std::vector<std::string> search(const char *attr, bool prune, long *pruned) {
+        char *argv[] = { (char *) "test_SearchPrune", (char *) path.c_str() };
+        VBMManager *mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        mgr->setSearch("full-up");
+        mgr->setRefModel("bottom");
+        Model *start = mgr->getBottomRefModel();
+        mgr->computeL2Statistics(start);
+        SearchEngine engine(mgr, mgr->getSearch());
+        engine.setSortAttr(attr);
+        engine.setSortDirection(Direction::Descending);
+        engine.setWidth(3);
+        engine.setLevels(4);
+        engine.setThreadCount(1);
+        engine.setPruning(prune);
+        Model **models = engine.search(start);
+        std::vector<std::string> names;
+        for (Model **model = models; *model; model++)
+            names.push_back((*model)->getPrintName());
+        *pruned = engine.getTotalPruned();
+        delete[] models;
+        delete mgr;
+        return names;
+    }
+
+    std::string path;
+};
+
+// Pruning skips some models with loops, and keeps the same models as a search
+// which evaluates them all
+TEST_F(SearchPruneTest, SameModelsKept) {
+    const char *attrs[] = { ATTRIBUTE_EXPLAINED_I, ATTRIBUTE_BIC, ATTRIBUTE_AIC };
+    for (const char *attr : attrs) {
+        long pruned, unpruned;
+        std::vector<std::string> all = search(attr, false, &unpruned);
+        std::vector<std::string> kept = search(attr, true, &pruned);
+        EXPECT_EQ(unpruned, 0) << attr;
+        EXPECT_GT(pruned, 0) << attr;
+        EXPECT_EQ(kept, all) << attr;
+    }
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
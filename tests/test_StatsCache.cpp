@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+#include "../include/Relation.h"
+#include "../include/StatsCache.h"
+#include "../include/Table.h"
+#include "../include/VBMManager.h"
+
+// Fixture class: a manager for the test data, and a scratch cache directory
+class StatsCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char *argv[] = { (char *) "test_StatsCache", (char *) "./tests/data/readFile.txt" };
+        mgr = new VBMManager();
+        mgr->initFromCommandLine(2, argv);
+        dir = ::testing::TempDir() + "statscache_" + std::to_string(getpid());
+    }
+
+    void TearDown() override {
+        char print[40];
+        sprintf(print, "/%016llx.occstats", StatsCache::fingerprint(mgr->getVariableList(), mgr->getInputData()));
+        remove((dir + print).c_str());
+        rmdir(dir.c_str());
+        delete mgr;
+    }
+
+    // a variable-based relation, with its projection
+    Relation *relation(int var1, int var2) {
+        int vars[] = { var1, var2 };
+        return mgr->getRelation(vars, 2, true);
+    }
+
+    VBMManager *mgr;
+    std::string dir;
+};
+
+// Statistics and tables added to the cache are found again when it is reopened
+TEST_F(StatsCacheTest, ReopenAndLookup) {
+    Relation *ab = relation(0, 1);
+    Relation *cd = relation(2, 3);
+    double h, df;
+    {
+        StatsCache cache(dir.c_str(), mgr->getVariableList(), mgr->getInputData(), true);
+        ASSERT_TRUE(cache.isOpen());
+        EXPECT_FALSE(cache.findStatistics(ab, &h, &df));
+        cache.addStatistics(ab, 1.25, 5);
+        EXPECT_TRUE(cache.findStatistics(ab, &h, &df));
+    }
+
+    StatsCache cache(dir.c_str(), mgr->getVariableList(), mgr->getInputData(), true);
+    ASSERT_TRUE(cache.isOpen());
+    ASSERT_TRUE(cache.findStatistics(ab, &h, &df));
+    EXPECT_EQ(h, 1.25);
+    EXPECT_EQ(df, 5);
+    EXPECT_FALSE(cache.findStatistics(cd, &h, &df));
+    EXPECT_EQ(cache.getHits(), 1);
+    EXPECT_EQ(cache.getMisses(), 1);
+
+    Table *table = cache.findTable(ab);
+    ASSERT_NE(table, nullptr);
+    Table *projection = ab->getTable();
+    ASSERT_EQ(table->getTupleCount(), projection->getTupleCount());
+    for (long long i = 0; i < table->getTupleCount(); i++) {
+        EXPECT_EQ(memcmp(table->getKey(i), projection->getKey(i), table->getKeySize() * sizeof(KeySegment)), 0);
+        EXPECT_EQ(table->getValue(i), projection->getValue(i));
+    }
+    delete table;
+    EXPECT_EQ(cache.findTable(cd), nullptr);
+}
+
+// A table whose record header was overwritten is a miss, not a wrong table
+TEST_F(StatsCacheTest, DamagedRecord) {
+    Relation *ab = relation(0, 1);
+    double h, df;
+    {
+        StatsCache cache(dir.c_str(), mgr->getVariableList(), mgr->getInputData(), true);
+        ASSERT_TRUE(cache.isOpen());
+        cache.addStatistics(ab, 1.25, 5);
+    }
+
+    StatsCache cache(dir.c_str(), mgr->getVariableList(), mgr->getInputData(), true);
+    ASSERT_TRUE(cache.findStatistics(ab, &h, &df));
+
+    //-- the only record follows the file header; change its h behind the cache's back
+    char print[40];
+    sprintf(print, "/%016llx.occstats", StatsCache::fingerprint(mgr->getVariableList(), mgr->getInputData()));
+    FILE *file = fopen((dir + print).c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    long recordStart = 8 + sizeof(unsigned long long) + sizeof(int);
+    double bad = -1;
+    fseek(file, recordStart + ab->getKeySize() * sizeof(KeySegment), SEEK_SET);
+    fwrite(&bad, sizeof(double), 1, file);
+    fclose(file);
+
+    EXPECT_EQ(cache.findTable(ab), nullptr);
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/MemoryAccount.h"
+#include "../include/Model.h"
+#include "../include/Table.h"
+#include "../include/VBMManager.h"
+
+// Eight variables of six states each, where each variable takes only five of the six
+// states following the one before it. So each two-variable marginal has zeros, and
+// the expansion of any one of them (30 cells times 6^6) is over a million cells, as
+// are the cells nonzero in any two marginals; but those nonzero in all of them
+// (6 times 5^7) are fewer.
+static const int VARS = 8, STATES = 6, STEPS = 5;
+
+// Fixture class: a data file, written for the test, and a manager reading it
+class StreamedIPFTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "streamedipf_" + std::to_string(getpid()) + ".in";
+        srand(2718);
+        std::map<std::vector<int>, int> counts;
+        for (int n = 0; n < 2000; n++) {
+            std::vector<int> row(VARS);
+            row[0] = rand() % STATES;
+            for (int v = 1; v < VARS; v++)
+                row[v] = (row[v - 1] + rand() % STEPS) % STATES;
+            counts[row]++;
+        }
+        for (auto &entry : counts) {
+            for (int v = 0; v + 1 < VARS; v++)
+                seen[v][entry.first[v]][entry.first[v + 1]] = true;
+        }
+        FILE *file = fopen(path.c_str(), "w");
+        fprintf(file, ":nominal\n");
+        for (int v = 0; v < VARS; v++)
+            fprintf(file, "v%d,%d,1,%c\n", v, STATES, 'a' + v);
+        fprintf(file, "\n:data\n");
+        for (auto &entry : counts) {
+            for (int v = 0; v < VARS; v++)
+                fprintf(file, "%d ", entry.first[v] + 1);
+            fprintf(file, "%d\n", entry.second);
+        }
+        fclose(file);
+    }
+
+    void TearDown() override {
+        remove(path.c_str());
+    }
+
+    // fit the chain model with IPF, returning a copy of the fit table, and the bytes
+    // of the workspace tables the fit used. These grow to hold the most cells any
+    // pass stored, and are first made for a million. (A stored start is forced by
+    // raising ipf-maxstored above the expansion size.)
+    Table *fitChain(bool stored, long long *scratchBytes) {
+        std::vector<char *> argv;
+        argv.push_back((char *) "test_StreamedIPF");
+        if (stored)
+            argv.push_back((char *) "--ipf-maxstored=1e12");
+        argv.push_back((char *) path.c_str());
+        VBMManager *mgr = new VBMManager();
+        mgr->initFromCommandLine(argv.size(), argv.data());
+        Model *model = mgr->makeModel("AB:BC:CD:DE:EF:FG:GH", true);
+        EXPECT_GT(model->getRelation(0)->getExpansionSize(), 1000000);
+        long long before = MemoryAccount::get(MemoryCategory::FitScratch);
+        EXPECT_TRUE(mgr->makeFitTableIPF(model));
+        *scratchBytes = MemoryAccount::get(MemoryCategory::FitScratch) - before;
+        Table *fit = new Table(mgr->getKeySize(), mgr->getFitTable()->getTupleCount());
+        fit->copy(mgr->getFitTable());
+        delete mgr;
+        return fit;
+    }
+
+    // the number of states which are nonzero in every marginal of the chain
+    double supportSize() {
+        std::vector<double> paths(STATES, 1);
+        for (int v = 0; v + 1 < VARS; v++) {
+            std::vector<double> next(STATES, 0);
+            for (int from = 0; from < STATES; from++)
+                for (int to = 0; to < STATES; to++)
+                    if (seen[v][from][to])
+                        next[to] += paths[from];
+            paths = next;
+        }
+        double total = 0;
+        for (int s = 0; s < STATES; s++)
+            total += paths[s];
+        return total;
+    }
+
+    std::string path;
+    bool seen[VARS][STATES][STATES] = {};
+};
+
+// A fit from a streamed start keeps only cells nonzero in every marginal, and
+// matches the fit from a stored start
+TEST_F(StreamedIPFTest, MatchesStoredFit) {
+    long long streamedBytes, storedBytes;
+    Table *streamed = fitChain(false, &streamedBytes);
+    Table *stored = fitChain(true, &storedBytes);
+    EXPECT_LT(supportSize(), 1000000);
+    EXPECT_EQ(streamed->getTupleCount(), (long long) supportSize());
+    //-- the stored start has over a million cells; the streamed one shouldn't
+    EXPECT_LT(streamedBytes, storedBytes);
+    ASSERT_EQ(streamed->getTupleCount(), stored->getTupleCount());
+    int keysize = streamed->getKeySize();
+    for (long long i = 0; i < streamed->getTupleCount(); i++) {
+        ASSERT_EQ(memcmp(streamed->getKey(i), stored->getKey(i), keysize * sizeof(KeySegment)), 0);
+        EXPECT_NEAR(streamed->getValue(i), stored->getValue(i), 1e-12 + 1e-9 * stored->getValue(i));
+    }
+    delete streamed;
+    delete stored;
+}
+
+// Main function to run the tests
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}